@@ -2,9 +2,89 @@
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <stdint.h>
+#include <time.h>
+#include <math.h>
+
+#ifdef _WIN32
 #include <windows.h>
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+#include <dirent.h>
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <strings.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#endif
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 #define MAX_TEXT 512
+#define POOL_INITIAL_CAPACITY 16384
+#define POOL_INITIAL_SLOTS 256
+#define POOL_INVALID 0xFFFFFFFFu
+#define FLAT_LEAF 0xFFFFFFFFu
+#define BATCH_READ_BUFFER (1 << 20)
+#define BATCH_OUTPUT_BUFFER 65536
+#define BATCH_RESULT_MAX 32
+#define EVAL_BLOCK_RECORDS 64
+#define LOOKUP_MAX_QUESTIONS 20
+#define KB_FILE_MAGIC "HCKB"
+#define KB_FORMAT_VERSION 1
+#define TOKEN_MAX_ANSWERS 512
+#define TOKEN_MAX_BYTES (26 + TOKEN_MAX_ANSWERS / 8)
+#define TOKEN_MAX_TEXT 128
+#define HTTP_REQUEST_MAX 8192
+#define HTTP_MAX_EVENTS 256
+#define HTTP_DEFAULT_PORT 8080
+#define HTTP_DEFAULT_THREADS 4
+#define KB_MAX_VERSIONS 4
+#define KB_RETAIN_MS (60 * 60 * 1000.0)
+#define KB_CHUNK_DEPTH 4
+#define KB_CHUNK_MAX_NODES ((2 << KB_CHUNK_DEPTH) - 1)
+#define KB_OPEN_RENDER 1
+#define KB_OPEN_SEARCH 2
+#define BATCH_CHUNK_BYTES (256 << 10)
+#define BATCH_MIN_CHUNK_BYTES 4096
+#define BATCH_CHUNKS_PER_THREAD 8
+#define BATCH_SCALING_REPEATS 3
+#define METRICS_LATENCY_BUCKETS 14
+#define SEARCH_FIELDS 5
+#define SEARCH_MAX_TERM 47
+#define SEARCH_MAX_QUERY_TERMS 16
+#define SEARCH_DEFAULT_LIMIT 50
+#define JOURNAL_MAGIC "HCJR"
+#define JOURNAL_FORMAT_VERSION 1
+#define JOURNAL_BUFFER_BYTES (256 << 10)
+#define JOURNAL_FLUSH_MS 5
+#define JOURNAL_ROTATE_BYTES (64 << 20)
+#define FACILITY_FILE_MAGIC "HCFX"
+#define FACILITY_FORMAT_VERSION 1
+#define FACILITY_LEAF_SIZE 8
+#define FACILITY_MAX_RESULTS 100
+#define FACILITY_DEFAULT_RESULTS 10
+#define EARTH_RADIUS_KM 6371.0088
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
 
 
 typedef enum {
@@ -22,62 +102,780 @@ typedef enum {
 
 
 typedef struct {
-    char condition[MAX_TEXT];
+    uint32_t condition;
     Severity severity;
-    char description[MAX_TEXT];
-    char remedies[MAX_TEXT];
-    char medications[MAX_TEXT];
-    char when_to_see_doctor[MAX_TEXT];
-    char prevention[MAX_TEXT];
+    uint32_t description;
+    uint32_t remedies;
+    uint32_t medications;
+    uint32_t when_to_see_doctor;
+    uint32_t prevention;
 } Diagnosis;
 
 
 typedef struct TreeNode {
     NodeType type;
-    char text[MAX_TEXT];
+    uint32_t text;
     struct TreeNode *yes_branch;
     struct TreeNode *no_branch;
     Diagnosis *diagnosis;
+    uint32_t canonical;
 } TreeNode;
 
 
+typedef struct {
+    uint32_t child[2];
+    uint32_t payload;
+    uint32_t question;
+} FlatNode;
+
+
+typedef struct {
+    uint32_t hash;
+    uint32_t text;
+    uint32_t child[2];
+    const Diagnosis* diagnosis;
+} CanonicalNode;
+
+
+typedef struct {
+    CanonicalNode* nodes;
+    uint32_t count;
+    uint32_t capacity;
+    uint32_t* slots;
+    uint32_t slot_count;
+} CanonicalTable;
+
+
+#if defined(__GNUC__) || defined(__clang__)
+#define METRIC_ADD(counter, amount) \
+    __atomic_store_n(&(counter), __atomic_load_n(&(counter), __ATOMIC_RELAXED) + (amount), __ATOMIC_RELAXED)
+#define METRIC_READ(counter) __atomic_load_n(&(counter), __ATOMIC_RELAXED)
+#else
+#define METRIC_ADD(counter, amount) ((counter) += (amount))
+#define METRIC_READ(counter) (counter)
+#endif
+
+
+typedef struct {
+    uint64_t* visits;
+    uint64_t* answers[2];
+    uint64_t* latency_ns;
+    uint64_t* hits;
+    uint64_t latency_buckets[METRICS_LATENCY_BUCKETS];
+    uint64_t latency_count;
+    uint64_t latency_sum_ns;
+    char padding[64];
+} MetricsShard;
+
+
+#define ARENA_BLOCK_SIZE 4096
+#define ARENA_ALIGN 16
+
+
+typedef struct ArenaBlock {
+    struct ArenaBlock* next;
+    size_t used;
+    size_t capacity;
+} ArenaBlock;
+
+
+typedef struct {
+    ArenaBlock* head;
+    size_t total_bytes;
+    int failed;
+} Arena;
+
+
+typedef struct {
+    char* data;
+    uint32_t used;
+    uint32_t capacity;
+    uint32_t* slots;
+    uint32_t slot_count;
+    uint32_t string_count;
+    size_t requested_bytes;
+    int failed;
+} StringPool;
+
+
+typedef enum {
+    RENDER_ANSI,
+    RENDER_PLAIN,
+    RENDER_JSON,
+    RENDER_FORMATS
+} RenderFormat;
+
+
+typedef struct {
+    char* data;
+    size_t used;
+    size_t capacity;
+    int failed;
+} TextBuffer;
+
+
+typedef struct {
+    const char* text;
+    uint32_t first;
+    uint32_t count;
+} SearchTerm;
+
+
+typedef struct {
+    char* terms;
+    SearchTerm* dictionary;
+    uint32_t term_count;
+    uint32_t* postings;
+    uint8_t* fields;
+    uint32_t posting_count;
+    size_t bytes;
+} SearchIndex;
+
+
+typedef struct {
+    uint32_t* diagnoses;
+    uint8_t* fields;
+    uint32_t count;
+    int terms;
+    int owned;
+} SearchResult;
+
+
+typedef struct {
+    Arena nodes;
+    Arena payload;
+    Arena compiled;
+    StringPool strings;
+    TreeNode* root;
+    const FlatNode* flat;
+    const Diagnosis* diagnoses;
+    uint32_t node_count;
+    uint32_t question_count;
+    uint32_t diagnosis_count;
+    uint32_t max_depth;
+    double expected_depth;
+    uint32_t version;
+    int generated;
+    const void* mapping;
+    size_t mapping_size;
+    uint16_t* lookup;
+    uint32_t lookup_bits;
+    char* rendered[RENDER_FORMATS];
+    uint32_t* rendered_spans[RENDER_FORMATS];
+    size_t rendered_bytes;
+    MetricsShard* metrics;
+    int metric_shards;
+    SearchIndex search;
+    const uint32_t* question_order;
+    uint32_t question_order_count;
+} KnowledgeBase;
+
+
+typedef struct {
+    char magic[4];
+    uint32_t format_version;
+    uint32_t header_size;
+    uint32_t flags;
+    uint32_t content_version;
+    uint32_t node_count;
+    uint32_t question_count;
+    uint32_t diagnosis_count;
+    uint32_t string_bytes;
+    uint32_t max_depth;
+    uint32_t expected_depth_milli;
+    uint32_t nodes_offset;
+    uint32_t diagnoses_offset;
+    uint32_t strings_offset;
+    uint32_t file_size;
+    uint32_t checksum;
+} KbFileHeader;
+
+
+_Static_assert(sizeof(KbFileHeader) == 64, "knowledge-base file header must stay 64 bytes");
+_Static_assert(sizeof(FlatNode) == 16, "FlatNode is part of the knowledge-base file format");
+_Static_assert(sizeof(Diagnosis) == 28, "Diagnosis is part of the knowledge-base file format");
+
+
+typedef struct {
+    char magic[4];
+    uint32_t format_version;
+    uint32_t header_size;
+    uint32_t sequence;
+    uint64_t created_ms;
+} JournalFileHeader;
+
+
+typedef enum {
+    JOURNAL_CLI,
+    JOURNAL_API
+} JournalSource;
+
+
+typedef struct {
+    uint32_t length;
+    uint32_t checksum;
+    uint64_t started_ms;
+    uint64_t finished_ms;
+    uint32_t kb_version;
+    uint32_t node;
+    uint32_t diagnosis;
+    uint16_t questions;
+    uint8_t severity;
+    uint8_t source;
+} JournalRecord;
+
+
+_Static_assert(sizeof(JournalFileHeader) == 24, "JournalFileHeader is part of the journal file format");
+_Static_assert(sizeof(JournalRecord) == 40, "JournalRecord is part of the journal file format");
+
+
+typedef struct {
+    char magic[4];
+    uint32_t format_version;
+    uint32_t header_size;
+    uint32_t facility_count;
+    uint32_t leaf_size;
+    uint32_t string_bytes;
+    uint32_t points_offset;
+    uint32_t facilities_offset;
+    uint32_t strings_offset;
+    uint32_t file_size;
+    uint32_t checksum;
+    uint32_t reserved;
+} FacilityFileHeader;
+
+
+typedef struct {
+    float lat;
+    float lon;
+    uint32_t name;
+    uint32_t amenity;
+    uint32_t address;
+    uint32_t phone;
+    uint32_t website;
+} Facility;
+
+
+_Static_assert(sizeof(FacilityFileHeader) == 48, "FacilityFileHeader is part of the facility index format");
+_Static_assert(sizeof(Facility) == 28, "Facility is part of the facility index format");
+
+
+typedef struct {
+    const void* mapping;
+    size_t mapping_size;
+    const float* points;
+    const Facility* facilities;
+    const char* strings;
+    uint32_t count;
+    uint32_t leaf_size;
+    uint32_t string_bytes;
+} FacilityIndex;
+
+
+typedef struct {
+    uint32_t facility;
+    double chord2;
+    double distance_km;
+} FacilityMatch;
+
+
+typedef struct {
+    double query[3];
+    double limit2;
+    FacilityMatch* heap;
+    int count;
+    int capacity;
+} FacilitySearch;
+
+
+typedef struct Journal Journal;
+
+
+typedef struct {
+    const KnowledgeBase* kb;
+    uint32_t node;
+    int questions_asked;
+    uint64_t started_ms;
+    uint8_t answers[TOKEN_MAX_ANSWERS / 8];
+} Session;
+
+
+typedef enum {
+    TOKEN_VALID,
+    TOKEN_MALFORMED,
+    TOKEN_FORGED,
+    TOKEN_STALE
+} TokenStatus;
+
+
+typedef enum {
+    EVAL_SCALAR,
+    EVAL_LOOKUP,
+    EVAL_GENERATED
+} Evaluator;
+
+
+typedef struct {
+    const char* text;
+    uint32_t length;
+} AnswerRecord;
+
+
+typedef struct {
+    char* data;
+    size_t used;
+    unsigned long long records;
+    unsigned long long invalid;
+} BatchOutput;
+
+
+typedef struct {
+    AnswerRecord block[EVAL_BLOCK_RECORDS];
+    uint32_t expected[EVAL_BLOCK_RECORDS];
+    char* storage;
+    int pending;
+    long checked;
+    long failures;
+    uint32_t max_depth;
+} SelfTest;
+
+
+#ifdef __linux__
+typedef struct {
+    char path[128];
+    const char* content_type;
+    char* data;
+    size_t length;
+} StaticFile;
+
+
+typedef struct {
+    KnowledgeBase* kbs[KB_MAX_VERSIONS];
+    double superseded[KB_MAX_VERSIONS];
+    int count;
+} KbSnapshot;
+
+
+typedef struct RetiredVersion {
+    struct RetiredVersion* next;
+    KbSnapshot* snapshot;
+    KnowledgeBase* kb;
+    uint64_t epoch;
+} RetiredVersion;
+
+
+typedef struct {
+    _Atomic uint64_t epoch;
+    char padding[64 - sizeof(uint64_t)];
+} ReaderSlot;
+
+
+typedef struct {
+    _Atomic(KbSnapshot*) current;
+    _Atomic uint64_t epoch;
+    ReaderSlot* readers;
+    int reader_count;
+    RetiredVersion* retired;
+    unsigned long reloads;
+} KbRegistry;
+
+
+struct Journal {
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    pthread_cond_t drained;
+    char* buffers[2];
+    size_t used;
+    int active;
+    int stopping;
+    pthread_t thread;
+    const char* directory;
+    int fd;
+    uint32_t sequence;
+    uint64_t file_bytes;
+    uint64_t rotate_bytes;
+    unsigned long pending;
+    unsigned long records;
+    unsigned long commits;
+    unsigned long files;
+    unsigned long lost;
+};
+
+
+typedef struct {
+    KbRegistry registry;
+    Journal* journal;
+    const FacilityIndex* facilities;
+    const char* kb_path;
+    int listen_fd;
+    StaticFile* files;
+    int file_count;
+} HttpServer;
+
+
+typedef struct HttpConnection {
+    struct HttpConnection* prev;
+    struct HttpConnection* next;
+    int fd;
+    int keep_alive;
+    int want_write;
+    int out_count;
+    int borrowed;
+    size_t in_used;
+    struct iovec out[2];
+    TextBuffer body;
+    char head[256];
+    char in[HTTP_REQUEST_MAX];
+} HttpConnection;
+
+
+typedef struct {
+    HttpServer* server;
+    int epoll_fd;
+    int reader;
+    pthread_t thread;
+    HttpConnection* connections;
+} HttpWorker;
+
+
+typedef struct {
+    char* method;
+    char* path;
+    const char* query;
+    const char* body;
+    size_t body_length;
+} HttpRequest;
+
+
+typedef struct {
+    const KnowledgeBase* kb;
+    int port;
+    int sessions;
+    unsigned int seed;
+    pthread_t thread;
+    long requests;
+    long completed;
+    long mismatches;
+    long failures;
+} ClientWorker;
+
+typedef struct {
+    const char* text;
+    size_t length;
+    int worker;
+    size_t output_offset;
+    size_t output_length;
+    unsigned long long records;
+    unsigned long long invalid;
+} BatchChunk;
+
+
+typedef struct {
+    _Atomic uint64_t range;
+    char padding[64 - sizeof(uint64_t)];
+} ChunkDeque;
+
+
+typedef struct {
+    struct ParallelBatch* batch;
+    int index;
+    pthread_t thread;
+    TextBuffer output;
+    unsigned long chunks;
+    unsigned long steals;
+    char padding[64];
+} BatchWorker;
+
+
+typedef struct ParallelBatch {
+    const KnowledgeBase* kb;
+    Evaluator evaluator;
+    BatchChunk* chunks;
+    uint32_t chunk_count;
+    ChunkDeque* deques;
+    BatchWorker* workers;
+    int worker_count;
+} ParallelBatch;
+#endif
+
+
+typedef void (*PathVisitor)(const KnowledgeBase* kb, const char* answers, uint32_t depth,
+                            uint32_t leaf, void* context);
+
+
+static _Thread_local size_t g_alloc_count = 0;
+static _Thread_local size_t g_alloc_bytes = 0;
+static int g_fast_mode = 0;
+static int g_report_timing = 0;
+static uint8_t g_token_key[16];
+
+
+#ifdef HEALTH_CHECKER_GENERATED
+#include "kb_generated.h"
+#endif
+
+
 void enableANSI();
 void sleepMs(int milliseconds);
+void clearScreen();
+double monotonicMs();
+uint64_t wallClockMs();
+int writeAll(int fd, const char* data, size_t length);
 void printSeparator(char c, int length);
 void displayHeader(const char* title, const char* color);
 void displayProgress(const char* message);
 void clearInputBuffer();
 char getUserResponse();
 void displayWelcome();
-TreeNode* createNode(NodeType type, const char* text);
-Diagnosis* createDiagnosis(const char* condition, Severity severity, 
+void* trackedMalloc(size_t size);
+void arenaInit(Arena* arena);
+void* arenaAlloc(Arena* arena, size_t size);
+void arenaRelease(Arena* arena);
+size_t arenaUsedBytes(const Arena* arena);
+uint32_t hashString(const char* text, size_t length);
+int poolInit(StringPool* pool);
+uint32_t poolIntern(StringPool* pool, const char* text);
+const char* poolString(const StringPool* pool, uint32_t offset);
+void poolRelease(StringPool* pool);
+const char* kbText(const KnowledgeBase* kb, uint32_t offset);
+TreeNode* createNode(KnowledgeBase* kb, NodeType type, const char* text);
+Diagnosis* createDiagnosis(KnowledgeBase* kb, const char* condition, Severity severity,
                            const char* description, const char* remedies,
                            const char* medications, const char* when_to_see,
                            const char* prevention);
-TreeNode* createDiagnosisNode(Diagnosis* diag);
-TreeNode* buildSymptomTree();
-void displayDiagnosis(Diagnosis* diag);
-void traverseTree(TreeNode* root);
-void freeTree(TreeNode* root);
+TreeNode* createDiagnosisNode(KnowledgeBase* kb, Diagnosis* diag);
+void setYesBranch(TreeNode* node, TreeNode* child);
+void setNoBranch(TreeNode* node, TreeNode* child);
+TreeNode* buildSymptomTree(KnowledgeBase* kb);
+uint32_t hashCanonicalNode(const CanonicalNode* node);
+uint32_t internCanonicalNode(CanonicalTable* table, CanonicalNode* node);
+void releaseCanonicalTable(CanonicalTable* table);
+uint32_t canonicalizeTree(TreeNode* root, CanonicalTable* table);
+int compileKnowledgeBase(KnowledgeBase* kb);
+void initKnowledgeBase(KnowledgeBase* kb);
+KnowledgeBase* beginKnowledgeBase();
+int finishKnowledgeBase(KnowledgeBase* kb);
+KnowledgeBase* interpretKnowledgeBase();
+KnowledgeBase* createKnowledgeBase();
+void releaseKnowledgeBase(KnowledgeBase* kb);
+void startSession(Session* session, const KnowledgeBase* kb);
+int sessionFinished(const Session* session);
+const char* sessionQuestion(const Session* session);
+void sessionAnswer(Session* session, char response);
+const Diagnosis* sessionDiagnosis(const Session* session);
+int enableMetrics(KnowledgeBase* kb, int shards);
+void releaseMetrics(KnowledgeBase* kb);
+void recordVisit(const KnowledgeBase* kb, int shard, uint32_t node);
+void recordAnswer(const KnowledgeBase* kb, int shard, uint32_t node, char response, double latency_ms);
+int inheritMetrics(KnowledgeBase* kb, const KnowledgeBase* previous);
+void exportMetrics(const KnowledgeBase* const* kbs, int count, TextBuffer* out);
+int writeMetricsFile(const KnowledgeBase* kb, const char* path);
+uint64_t sipHash24(const uint8_t key[16], const uint8_t* data, size_t length);
+int constantTimeEqual(const void* a, const void* b, size_t length);
+int loadTokenKey();
+size_t encodeSessionToken(const Session* session, char* out);
+TokenStatus decodeSessionToken(const KnowledgeBase* kb, const char* text, size_t length, Session* session);
+const char* tokenStatusMessage(TokenStatus status);
+int parseJournalFileName(const char* name, uint32_t* sequence);
+size_t encodeJournalRecord(const Session* session, JournalSource source, unsigned char* out);
+Journal* openJournal(const char* directory, uint64_t rotate_bytes);
+void appendJournal(Journal* journal, const Session* session, JournalSource source);
+void closeJournal(Journal* journal);
+double expandedNodeCount(const KnowledgeBase* kb);
+void reportKnowledgeBaseMemory(const KnowledgeBase* kb);
+uint32_t crc32Update(uint32_t crc, const void* data, size_t length);
+uint32_t contentChecksum(const KnowledgeBase* kb);
+int computeKnowledgeBaseMetadata(KnowledgeBase* kb);
+int replaceWithFile(FILE* file, const char* temporary, const char* path, int ok);
+int exportKnowledgeBase(const KnowledgeBase* kb, const char* path);
+int exportKnowledgeBaseSource(const KnowledgeBase* kb, const char* path);
+const void* mapFile(const char* path, size_t* size);
+void unmapFile(const void* view, size_t size);
+const char* validateKnowledgeBaseImage(const unsigned char* image, size_t size);
+KnowledgeBase* loadKnowledgeBaseFile(const char* path);
+KnowledgeBase* openKnowledgeBase(const char* path, int features);
+void textAppend(TextBuffer* buffer, const char* text, size_t length);
+void textAppendString(TextBuffer* buffer, const char* text);
+void textAppendRepeat(TextBuffer* buffer, char c, int count);
+void textAppendJson(TextBuffer* buffer, const char* text);
+void renderDiagnosis(const KnowledgeBase* kb, const Diagnosis* diag, RenderFormat format, TextBuffer* out);
+int renderDiagnoses(KnowledgeBase* kb);
+const char* diagnosisOutput(const KnowledgeBase* kb, uint32_t diagnosis, RenderFormat format, size_t* length);
+void displayDiagnosis(const KnowledgeBase* kb, const Diagnosis* diag);
+size_t nextSearchToken(const char** cursor, char* token, int* prefix);
+int buildSearchIndex(KnowledgeBase* kb);
+void releaseSearchIndex(KnowledgeBase* kb);
+int searchKnowledgeBase(const KnowledgeBase* kb, const char* query, SearchResult* result);
+void releaseSearchResult(SearchResult* result);
+const char* searchFieldName(int field);
+int printSearchResults(const KnowledgeBase* kb, const char* query);
+void facilityPoint(double lat, double lon, double point[3]);
+void buildFacilityTree(float* points, Facility* facilities, uint32_t lo, uint32_t hi, int axis);
+int exportFacilityIndex(const float* points, const Facility* facilities, uint32_t count,
+                        const StringPool* strings, const char* path);
+const char* validateFacilityImage(const unsigned char* image, size_t size);
+FacilityIndex* loadFacilityIndex(const char* path);
+void releaseFacilityIndex(FacilityIndex* index);
+const char* facilityText(const FacilityIndex* index, uint32_t offset);
+int findFacilities(const FacilityIndex* index, double lat, double lon, double radius_km, int limit,
+                   FacilityMatch* out);
+int printNearestFacilities(const FacilityIndex* index, double lat, double lon, int limit, double radius_km);
+int traverseTree(Session* session);
+char scriptedResponse(unsigned int* seed);
+void benchmarkSessions(int sessions, Journal* journal);
+const char* severityName(Severity severity);
+int answerBit(char c);
+uint32_t evaluateAnswers(const KnowledgeBase* kb, const char* answers, size_t length);
+size_t formatBatchResult(const KnowledgeBase* kb, uint32_t diagnosis, char* out);
+void parseAnswerBits(const char* text, uint32_t length, uint64_t* yes_bits, uint64_t* valid_bits);
+void evaluateBlockScalar(const KnowledgeBase* kb, const AnswerRecord* records, int count, uint32_t* results);
+void evaluateBlock(const KnowledgeBase* kb, Evaluator evaluator, const AnswerRecord* records, int count,
+                   uint32_t* results);
+int buildLookupTable(KnowledgeBase* kb);
+void evaluateBlockLookup(const KnowledgeBase* kb, const AnswerRecord* records, int count, uint32_t* results);
+void evaluateBlockGenerated(const KnowledgeBase* kb, const AnswerRecord* records, int count, uint32_t* results);
+int parseEvaluator(const char* name, Evaluator* evaluator);
+void emitBatchResults(const KnowledgeBase* kb, const uint32_t* results, int count, BatchOutput* output);
+int runBatch(const KnowledgeBase* kb, const char* path, Evaluator evaluator);
+int enumeratePaths(const KnowledgeBase* kb, PathVisitor visit, void* context);
+int matchesGeneratedCode(const KnowledgeBase* kb);
+int checkGeneratedCode(const KnowledgeBase* kb);
+int runSelfTest(const KnowledgeBase* kb, long random_records);
+void generateRecords(const KnowledgeBase* kb, long count, unsigned int seed);
+void listKnowledgeBase(const KnowledgeBase* kb);
+#ifdef __linux__
+int registryInit(KbRegistry* registry, KnowledgeBase* kb, int readers);
+const KbSnapshot* registryPin(KbRegistry* registry, int reader);
+void registryUnpin(KbRegistry* registry, int reader);
+int registryPublish(KbRegistry* registry, KnowledgeBase* kb, double now);
+int registryReclaim(KbRegistry* registry);
+void registryRelease(KbRegistry* registry);
+void reloadKnowledgeBase(HttpServer* server);
+const char* contentType(const char* name);
+int loadStaticFiles(HttpServer* server, const char* root);
+void releaseStaticFiles(HttpServer* server);
+int httpListen(int port);
+void httpRespond(HttpConnection* conn, int status, const char* content_type, const char* body, size_t length);
+void httpRespondJson(HttpConnection* conn, int status);
+void httpError(HttpConnection* conn, int status, const char* message);
+void appendSessionState(TextBuffer* out, const Session* state);
+int appendKbChunk(TextBuffer* out, const KnowledgeBase* kb, uint32_t root);
+char answerValue(const char* value, size_t length);
+char parseAnswer(const char* body, size_t length);
+int queryParameter(const char* query, const char* name, char* out, size_t size);
+void handleSearch(const KnowledgeBase* kb, HttpConnection* conn, HttpRequest* request);
+void handleFacilities(const FacilityIndex* index, HttpConnection* conn, HttpRequest* request);
+void handleApi(const KbSnapshot* snapshot, HttpConnection* conn, HttpRequest* request, int shard, Journal* journal);
+void handleRequest(HttpServer* server, const KbSnapshot* snapshot, HttpConnection* conn, HttpRequest* request,
+                   int shard);
+int parseRequest(HttpConnection* conn, HttpRequest* request, size_t* consumed);
+int flushConnection(HttpConnection* conn);
+void closeConnection(HttpWorker* worker, HttpConnection* conn);
+void acceptConnections(HttpWorker* worker);
+void serviceConnection(HttpWorker* worker, HttpConnection* conn, uint32_t events);
+void* httpWorkerMain(void* arg);
+void* clientWorkerMain(void* arg);
+void* journalWriterMain(void* arg);
+char* loadBatchInput(const char* path, size_t* length, int* mapped);
+int splitBatchChunks(ParallelBatch* batch, const char* text, size_t length, int threads);
+int64_t chunkDequePop(ChunkDeque* deque);
+int chunkDequeSteal(ChunkDeque* deque, uint32_t* first, uint32_t* last);
+void scoreBatchChunk(BatchWorker* worker, BatchChunk* chunk);
+void* batchWorkerMain(void* arg);
+int runBatchPool(ParallelBatch* batch, int threads);
+void releaseBatchPool(ParallelBatch* batch);
+int writeParallelBatch(const ParallelBatch* batch, int fd);
+uint64_t parallelBatchChecksum(const ParallelBatch* batch);
+#endif
+int runServer(KnowledgeBase* kb, const char* kb_path, int port, int threads, const char* root, Journal* journal,
+              const FacilityIndex* facilities);
+int runClient(const KnowledgeBase* kb, int port, int sessions, int threads);
+int runParallelBatch(const KnowledgeBase* kb, const char* path, Evaluator evaluator, int threads);
+int runBatchScaling(const KnowledgeBase* kb, const char* path, Evaluator evaluator, int max_threads);
 
 
 void enableANSI() {
+#ifdef _WIN32
     HANDLE hOut = GetStdHandle(STD_OUTPUT_HANDLE);
     DWORD dwMode = 0;
     GetConsoleMode(hOut, &dwMode);
     dwMode |= ENABLE_VIRTUAL_TERMINAL_PROCESSING;
     SetConsoleMode(hOut, dwMode);
+#endif
 }
 
 
 void sleepMs(int milliseconds) {
+    if (g_fast_mode) {
+        return;
+    }
+    fflush(stdout);
+#ifdef _WIN32
     Sleep(milliseconds);
+#else
+    struct timespec delay = { milliseconds / 1000, (long)(milliseconds % 1000) * 1000000L };
+    nanosleep(&delay, NULL);
+#endif
+}
+
+
+void clearScreen() {
+    fputs("\033[H\033[2J\033[3J", stdout);
+}
+
+
+int writeAll(int fd, const char* data, size_t length) {
+    while (length > 0) {
+#ifdef _WIN32
+        int written = _write(fd, data, length > 0x40000000u ? 0x40000000u : (unsigned int)length);
+#else
+        ssize_t written = write(fd, data, length);
+#endif
+        if (written <= 0) {
+            return 0;
+        }
+        data += written;
+        length -= (size_t)written;
+    }
+    return 1;
+}
+
+
+double monotonicMs() {
+#ifdef _WIN32
+    LARGE_INTEGER frequency, counter;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return (double)counter.QuadPart * 1000.0 / (double)frequency.QuadPart;
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000.0 + now.tv_nsec / 1e6;
+#endif
+}
+
+
+uint64_t wallClockMs() {
+#ifdef _WIN32
+    FILETIME now;
+    GetSystemTimeAsFileTime(&now);
+    return ((((uint64_t)now.dwHighDateTime << 32) | now.dwLowDateTime) / 10000) - 11644473600000ULL;
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    return (uint64_t)now.tv_sec * 1000 + (uint64_t)now.tv_nsec / 1000000;
+#endif
 }
 
 
 void printSeparator(char c, int length) {
-    for (int i = 0; i < length; i++) {
-        printf("%c", c);
+    char line[128];
+    
+    memset(line, c, sizeof(line));
+    while (length > 0) {
+        int chunk = length < (int)sizeof(line) ? length : (int)sizeof(line);
+        fwrite(line, 1, (size_t)chunk, stdout);
+        length -= chunk;
     }
 }
 
@@ -122,16 +920,17 @@ char getUserResponse() {
     char response;
     
     while (1) {
-        if (fgets(input, sizeof(input), stdin) != NULL) {
-            
-            input[strcspn(input, "\n")] = 0;
+        if (fgets(input, sizeof(input), stdin) == NULL) {
+            return 0;
+        }
+        
+        input[strcspn(input, "\n")] = 0;
+        
+        if (strlen(input) > 0) {
+            response = toupper(input[0]);
             
-            if (strlen(input) > 0) {
-                response = toupper(input[0]);
-                
-                if (response == 'Y' || response == 'N') {
-                    return response;
-                }
+            if (response == 'Y' || response == 'N') {
+                return response;
             }
         }
         
@@ -174,256 +973,1384 @@ void displayWelcome() {
 }
 
 
-TreeNode* createNode(NodeType type, const char* text) {
-    TreeNode* node = (TreeNode*)malloc(sizeof(TreeNode));
+void* trackedMalloc(size_t size) {
+    void* ptr = malloc(size);
+    if (ptr != NULL) {
+        g_alloc_count++;
+        g_alloc_bytes += size;
+    }
+    return ptr;
+}
+
+
+void arenaInit(Arena* arena) {
+    arena->head = NULL;
+    arena->total_bytes = 0;
+    arena->failed = 0;
+}
+
+
+void* arenaAlloc(Arena* arena, size_t size) {
+    ArenaBlock* block = arena->head;
+    size_t header = (sizeof(ArenaBlock) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+    size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+    
+    if (block == NULL || block->capacity - block->used < size) {
+        size_t capacity = size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE;
+        
+        block = (ArenaBlock*)trackedMalloc(header + capacity);
+        if (block == NULL) {
+            arena->failed = 1;
+            return NULL;
+        }
+        block->next = arena->head;
+        block->used = header;
+        block->capacity = header + capacity;
+        arena->head = block;
+        arena->total_bytes += header + capacity;
+    }
+    
+    void* ptr = (char*)block + block->used;
+    block->used += size;
+    return ptr;
+}
+
+
+void arenaRelease(Arena* arena) {
+    ArenaBlock* block = arena->head;
+    while (block != NULL) {
+        ArenaBlock* next = block->next;
+        free(block);
+        block = next;
+    }
+    arenaInit(arena);
+}
+
+
+size_t arenaUsedBytes(const Arena* arena) {
+    size_t used = 0;
+    for (const ArenaBlock* block = arena->head; block != NULL; block = block->next) {
+        used += block->used;
+    }
+    return used;
+}
+
+
+uint32_t hashString(const char* text, size_t length) {
+    uint64_t hash = 0x9E3779B97F4A7C15ull ^ length;
+    uint64_t word;
+    size_t i = 0;
+    
+    for (; i + 8 <= length; i += 8) {
+        memcpy(&word, text + i, 8);
+        hash = (hash ^ word) * 0xFF51AFD7ED558CCDull;
+        hash ^= hash >> 32;
+    }
+    word = 0;
+    memcpy(&word, text + i, length - i);
+    hash = (hash ^ word) * 0xC4CEB9FE1A85EC53ull;
+    hash ^= hash >> 29;
+    
+    return (uint32_t)hash;
+}
+
+
+int poolInit(StringPool* pool) {
+    pool->data = (char*)trackedMalloc(POOL_INITIAL_CAPACITY);
+    pool->slots = (uint32_t*)trackedMalloc(POOL_INITIAL_SLOTS * sizeof(uint32_t));
+    pool->used = 0;
+    pool->capacity = POOL_INITIAL_CAPACITY;
+    pool->slot_count = POOL_INITIAL_SLOTS;
+    pool->string_count = 0;
+    pool->requested_bytes = 0;
+    pool->failed = 0;
+    
+    if (pool->data == NULL || pool->slots == NULL) {
+        poolRelease(pool);
+        pool->failed = 1;
+        return 0;
+    }
+    memset(pool->slots, 0, POOL_INITIAL_SLOTS * sizeof(uint32_t));
+    
+    return poolIntern(pool, "") == 0;
+}
+
+
+static int poolGrowSlots(StringPool* pool) {
+    uint32_t slot_count = pool->slot_count * 2;
+    uint32_t* slots = (uint32_t*)trackedMalloc(slot_count * sizeof(uint32_t));
+    if (slots == NULL) {
+        return 0;
+    }
+    memset(slots, 0, slot_count * sizeof(uint32_t));
+    
+    for (uint32_t i = 0; i < pool->slot_count; i++) {
+        if (pool->slots[i] == 0) {
+            continue;
+        }
+        const char* text = pool->data + pool->slots[i] - 1;
+        uint32_t slot = hashString(text, strlen(text)) & (slot_count - 1);
+        while (slots[slot] != 0) {
+            slot = (slot + 1) & (slot_count - 1);
+        }
+        slots[slot] = pool->slots[i];
+    }
+    
+    free(pool->slots);
+    pool->slots = slots;
+    pool->slot_count = slot_count;
+    return 1;
+}
+
+
+uint32_t poolIntern(StringPool* pool, const char* text) {
+    size_t length = strlen(text);
+    uint32_t slot;
+    
+    if (pool->failed) {
+        return POOL_INVALID;
+    }
+    pool->requested_bytes += length + 1;
+    
+    slot = hashString(text, length) & (pool->slot_count - 1);
+    while (pool->slots[slot] != 0) {
+        uint32_t offset = pool->slots[slot] - 1;
+        if (strcmp(pool->data + offset, text) == 0) {
+            return offset;
+        }
+        slot = (slot + 1) & (pool->slot_count - 1);
+    }
+    
+    if (length + 1 > (size_t)(pool->capacity - pool->used)) {
+        size_t capacity = pool->capacity;
+        while (capacity - pool->used < length + 1) {
+            capacity *= 2;
+        }
+        if (capacity >= POOL_INVALID) {
+            pool->failed = 1;
+            return POOL_INVALID;
+        }
+        char* data = (char*)trackedMalloc(capacity);
+        if (data == NULL) {
+            pool->failed = 1;
+            return POOL_INVALID;
+        }
+        memcpy(data, pool->data, pool->used);
+        free(pool->data);
+        pool->data = data;
+        pool->capacity = (uint32_t)capacity;
+    }
+    
+    uint32_t offset = pool->used;
+    memcpy(pool->data + offset, text, length + 1);
+    pool->used += (uint32_t)(length + 1);
+    pool->slots[slot] = offset + 1;
+    pool->string_count++;
+    
+    if (pool->string_count * 2 > pool->slot_count && !poolGrowSlots(pool)) {
+        pool->failed = 1;
+        return POOL_INVALID;
+    }
+    
+    return offset;
+}
+
+
+const char* poolString(const StringPool* pool, uint32_t offset) {
+    if (offset >= pool->used) {
+        return "";
+    }
+    return pool->data + offset;
+}
+
+
+void poolRelease(StringPool* pool) {
+    free(pool->data);
+    free(pool->slots);
+    pool->data = NULL;
+    pool->slots = NULL;
+    pool->used = 0;
+    pool->capacity = 0;
+    pool->slot_count = 0;
+    pool->string_count = 0;
+}
+
+
+const char* kbText(const KnowledgeBase* kb, uint32_t offset) {
+    return poolString(&kb->strings, offset);
+}
+
+
+TreeNode* createNode(KnowledgeBase* kb, NodeType type, const char* text) {
+    TreeNode* node = (TreeNode*)arenaAlloc(&kb->nodes, sizeof(TreeNode));
     if (node == NULL) {
-        printf("\033[31mMemory allocation failed!\033[0m\n");
-        exit(1);
+        return NULL;
     }
     
     node->type = type;
-    strncpy(node->text, text, MAX_TEXT - 1);
-    node->text[MAX_TEXT - 1] = '\0';
+    node->text = poolIntern(&kb->strings, text);
     node->yes_branch = NULL;
     node->no_branch = NULL;
     node->diagnosis = NULL;
+    node->canonical = FLAT_LEAF;
     
     return node;
 }
 
 
-Diagnosis* createDiagnosis(const char* condition, Severity severity,
+Diagnosis* createDiagnosis(KnowledgeBase* kb, const char* condition, Severity severity,
                           const char* description, const char* remedies,
                           const char* medications, const char* when_to_see,
                           const char* prevention) {
-    Diagnosis* diag = (Diagnosis*)malloc(sizeof(Diagnosis));
+    Diagnosis* diag = (Diagnosis*)arenaAlloc(&kb->payload, sizeof(Diagnosis));
     if (diag == NULL) {
-        printf("\033[31mMemory allocation failed!\033[0m\n");
-        exit(1);
-    }
-    
-    strncpy(diag->condition, condition, MAX_TEXT - 1);
-    diag->condition[MAX_TEXT - 1] = '\0';
-    strncpy(diag->description, description, MAX_TEXT - 1);
-    diag->description[MAX_TEXT - 1] = '\0';
-    strncpy(diag->remedies, remedies, MAX_TEXT - 1);
-    diag->remedies[MAX_TEXT - 1] = '\0';
-    strncpy(diag->medications, medications, MAX_TEXT - 1);
-    diag->medications[MAX_TEXT - 1] = '\0';
-    strncpy(diag->when_to_see_doctor, when_to_see, MAX_TEXT - 1);
-    diag->when_to_see_doctor[MAX_TEXT - 1] = '\0';
-    strncpy(diag->prevention, prevention, MAX_TEXT - 1);
-    diag->prevention[MAX_TEXT - 1] = '\0';
+        return NULL;
+    }
+    
+    diag->condition = poolIntern(&kb->strings, condition);
+    diag->description = poolIntern(&kb->strings, description);
+    diag->remedies = poolIntern(&kb->strings, remedies);
+    diag->medications = poolIntern(&kb->strings, medications);
+    diag->when_to_see_doctor = poolIntern(&kb->strings, when_to_see);
+    diag->prevention = poolIntern(&kb->strings, prevention);
     diag->severity = severity;
     
     return diag;
 }
 
 
-TreeNode* createDiagnosisNode(Diagnosis* diag) {
-    TreeNode* node = (TreeNode*)malloc(sizeof(TreeNode));
+TreeNode* createDiagnosisNode(KnowledgeBase* kb, Diagnosis* diag) {
+    if (diag == NULL) {
+        return NULL;
+    }
+    
+    TreeNode* node = (TreeNode*)arenaAlloc(&kb->nodes, sizeof(TreeNode));
     if (node == NULL) {
-        printf("\033[31mMemory allocation failed!\033[0m\n");
-        exit(1);
+        return NULL;
     }
     
     node->type = DIAGNOSIS_NODE;
-    node->text[0] = '\0';
+    node->text = 0;
     node->yes_branch = NULL;
     node->no_branch = NULL;
     node->diagnosis = diag;
+    node->canonical = FLAT_LEAF;
     
     return node;
 }
 
 
-void displayDiagnosis(Diagnosis* diag) {
-    const char* severity_color;
-    const char* severity_text;
-    const char* severity_icon;
-    
-    
-    switch(diag->severity) {
-        case EMERGENCY:
-            severity_color = "\033[31m";
-            severity_text = "EMERGENCY";
-            severity_icon = "[!!!]";
-            break;
-        case URGENT:
-            severity_color = "\033[33m";
-            severity_text = "URGENT";
-            severity_icon = "[!!]";
-            break;
-        case MODERATE:
-            severity_color = "\033[36m";
-            severity_text = "MODERATE";
-            severity_icon = "[!]";
-            break;
-        case MILD:
-            severity_color = "\033[32m";
-            severity_text = "MILD";
-            severity_icon = "[i]";
-            break;
-        default:
-            severity_color = "\033[37m";
-            severity_text = "UNKNOWN";
-            severity_icon = "[?]";
+void setYesBranch(TreeNode* node, TreeNode* child) {
+    if (node != NULL) {
+        node->yes_branch = child;
     }
+}
+
+
+void setNoBranch(TreeNode* node, TreeNode* child) {
+    if (node != NULL) {
+        node->no_branch = child;
+    }
+}
+
+
+void textAppend(TextBuffer* buffer, const char* text, size_t length) {
+    if (buffer->failed) {
+        return;
+    }
+    if (buffer->used + length > buffer->capacity) {
+        size_t capacity = buffer->capacity > 0 ? buffer->capacity : 4096;
+        while (capacity < buffer->used + length) {
+            capacity *= 2;
+        }
+        char* data = (char*)realloc(buffer->data, capacity);
+        if (data == NULL) {
+            buffer->failed = 1;
+            return;
+        }
+        g_alloc_count++;
+        g_alloc_bytes += capacity - buffer->capacity;
+        buffer->data = data;
+        buffer->capacity = capacity;
+    }
+    memcpy(buffer->data + buffer->used, text, length);
+    buffer->used += length;
+}
+
+
+void textAppendString(TextBuffer* buffer, const char* text) {
+    textAppend(buffer, text, strlen(text));
+}
+
+
+void textAppendRepeat(TextBuffer* buffer, char c, int count) {
+    char run[128];
+    memset(run, c, sizeof(run));
+    while (count > 0) {
+        int chunk = count < (int)sizeof(run) ? count : (int)sizeof(run);
+        textAppend(buffer, run, chunk);
+        count -= chunk;
+    }
+}
+
+
+void textAppendJson(TextBuffer* buffer, const char* text) {
+    static const char hex[] = "0123456789abcdef";
+    const char* start = text;
     
+    textAppend(buffer, "\"", 1);
+    for (; *text != '\0'; text++) {
+        unsigned char c = (unsigned char)*text;
+        if (c >= 0x20 && c != '"' && c != '\\') {
+            continue;
+        }
+        textAppend(buffer, start, text - start);
+        if (c == '"' || c == '\\') {
+            char escaped[2] = { '\\', (char)c };
+            textAppend(buffer, escaped, 2);
+        } else {
+            char escaped[6] = { '\\', 'u', '0', '0', hex[c >> 4], hex[c & 15] };
+            textAppend(buffer, escaped, 6);
+        }
+        start = text + 1;
+    }
+    textAppend(buffer, start, text - start);
+    textAppend(buffer, "\"", 1);
+}
+
+
+void renderDiagnosis(const KnowledgeBase* kb, const Diagnosis* diag, RenderFormat format, TextBuffer* out) {
+    static const char* colors[] = { "\033[31m", "\033[33m", "\033[36m", "\033[32m" };
+    static const char* icons[] = { "[!!!]", "[!!]", "[!]", "[i]" };
+    static const char* headings[] = {
+        "WHAT IS THIS?", "HOME REMEDIES & SELF-CARE:", "RECOMMENDED MEDICATIONS:",
+        "WHEN TO SEE A DOCTOR:", "PREVENTION TIPS:"
+    };
+    static const char* heading_colors[] = { "\033[34m", "\033[32m", "\033[35m", "\033[33m", "\033[36m" };
+    static const char* json_keys[] = { "description", "remedies", "medications", "when_to_see_doctor", "prevention" };
+    uint32_t sections[] = { diag->description, diag->remedies, diag->medications,
+                            diag->when_to_see_doctor, diag->prevention };
+    int known = diag->severity >= EMERGENCY && diag->severity <= MILD;
+    const char* color = known ? colors[diag->severity] : "\033[37m";
+    const char* icon = known ? icons[diag->severity] : "[?]";
+    int ansi = format == RENDER_ANSI;
     
-    printf("\n");
-    printf("\033[1m%s", severity_color);
-    printSeparator('=', 70);
-    printf("\n");
-    printf("  %s DIAGNOSIS: %s\n", severity_icon, diag->condition);
-    printSeparator('=', 70);
-    printf("\033[0m\n");
-    
-    
-    printf("\n\033[1m%s  SEVERITY LEVEL: %s\033[0m\n", severity_color, severity_text);
-    
-    
-    printf("\n\033[1m\033[34m  WHAT IS THIS?\033[0m\n");
-    printf("  %s\n", diag->description);
-    
+    if (format == RENDER_JSON) {
+        textAppendString(out, "{\"condition\":");
+        textAppendJson(out, kbText(kb, diag->condition));
+        textAppendString(out, ",\"severity\":\"");
+        textAppendString(out, severityName(diag->severity));
+        textAppendString(out, "\"");
+        for (int i = 0; i < 5; i++) {
+            textAppendString(out, ",\"");
+            textAppendString(out, json_keys[i]);
+            textAppendString(out, "\":");
+            textAppendJson(out, kbText(kb, sections[i]));
+        }
+        textAppendString(out, "}\n");
+        return;
+    }
     
-    printf("\n\033[1m\033[32m  HOME REMEDIES & SELF-CARE:\033[0m\n");
-    printf("  %s\n", diag->remedies);
+    textAppendString(out, "\n");
+    if (ansi) {
+        textAppendString(out, "\033[1m");
+        textAppendString(out, color);
+    }
+    textAppendRepeat(out, '=', 70);
+    textAppendString(out, "\n  ");
+    textAppendString(out, icon);
+    textAppendString(out, " DIAGNOSIS: ");
+    textAppendString(out, kbText(kb, diag->condition));
+    textAppendString(out, "\n");
+    textAppendRepeat(out, '=', 70);
+    textAppendString(out, ansi ? "\033[0m\n\n\033[1m" : "\n\n");
+    if (ansi) {
+        textAppendString(out, color);
+    }
+    textAppendString(out, "  SEVERITY LEVEL: ");
+    textAppendString(out, severityName(diag->severity));
+    textAppendString(out, ansi ? "\033[0m\n" : "\n");
     
+    for (int i = 0; i < 5; i++) {
+        textAppendString(out, "\n");
+        if (ansi) {
+            textAppendString(out, "\033[1m");
+            textAppendString(out, heading_colors[i]);
+        }
+        textAppendString(out, "  ");
+        textAppendString(out, headings[i]);
+        textAppendString(out, ansi ? "\033[0m\n  " : "\n  ");
+        textAppendString(out, kbText(kb, sections[i]));
+        textAppendString(out, "\n");
+    }
     
-    printf("\n\033[1m\033[35m  RECOMMENDED MEDICATIONS:\033[0m\n");
-    printf("  %s\n", diag->medications);
+    textAppendString(out, "\n");
+    textAppendRepeat(out, '=', 70);
+    textAppendString(out, ansi ? "\n\033[1m\033[31m  IMPORTANT DISCLAIMER:\033[0m\n" : "\n  IMPORTANT DISCLAIMER:\n");
+    textAppendString(out, "  This is for informational purposes only and not a substitute\n"
+                          "  for professional medical advice. Always consult a healthcare\n"
+                          "  provider for proper diagnosis and treatment.\n");
+    textAppendRepeat(out, '=', 70);
+    textAppendString(out, "\n");
+}
+
+
+int renderDiagnoses(KnowledgeBase* kb) {
+    uint32_t slot_count = 16;
+    while (slot_count < kb->diagnosis_count * 2) {
+        slot_count *= 2;
+    }
+    uint32_t* slots = (uint32_t*)trackedMalloc(slot_count * sizeof(uint32_t));
+    if (slots == NULL) {
+        return 0;
+    }
     
+    for (int format = 0; format < RENDER_FORMATS; format++) {
+        TextBuffer out = { NULL, 0, 0, 0 };
+        uint32_t* spans = (uint32_t*)trackedMalloc(((size_t)kb->diagnosis_count * 2 + 1) * sizeof(uint32_t));
+        if (spans == NULL) {
+            free(slots);
+            return 0;
+        }
+        memset(slots, 0xFF, slot_count * sizeof(uint32_t));
+        
+        for (uint32_t d = 0; d < kb->diagnosis_count; d++) {
+            const Diagnosis* diag = &kb->diagnoses[d];
+            uint32_t slot = hashString((const char*)diag, sizeof(Diagnosis)) & (slot_count - 1);
+            while (slots[slot] != 0xFFFFFFFFu && memcmp(&kb->diagnoses[slots[slot]], diag, sizeof(Diagnosis)) != 0) {
+                slot = (slot + 1) & (slot_count - 1);
+            }
+            if (slots[slot] != 0xFFFFFFFFu) {
+                spans[d * 2] = spans[slots[slot] * 2];
+                spans[d * 2 + 1] = spans[slots[slot] * 2 + 1];
+                continue;
+            }
+            slots[slot] = d;
+            spans[d * 2] = (uint32_t)out.used;
+            renderDiagnosis(kb, diag, (RenderFormat)format, &out);
+            spans[d * 2 + 1] = (uint32_t)(out.used - spans[d * 2]);
+        }
+        
+        if (out.failed || out.used > 0xFFFFFFFFu) {
+            free(out.data);
+            free(spans);
+            free(slots);
+            return 0;
+        }
+        char* trimmed = (char*)realloc(out.data, out.used > 0 ? out.used : 1);
+        kb->rendered[format] = trimmed != NULL ? trimmed : out.data;
+        kb->rendered_spans[format] = spans;
+        kb->rendered_bytes += out.used;
+    }
     
-    printf("\n\033[1m\033[33m  WHEN TO SEE A DOCTOR:\033[0m\n");
-    printf("  %s\n", diag->when_to_see_doctor);
+    free(slots);
+    return 1;
+}
+
+
+const char* diagnosisOutput(const KnowledgeBase* kb, uint32_t diagnosis, RenderFormat format, size_t* length) {
+    if (kb->rendered[format] == NULL || diagnosis >= kb->diagnosis_count) {
+        return NULL;
+    }
+    *length = kb->rendered_spans[format][diagnosis * 2 + 1];
+    return kb->rendered[format] + kb->rendered_spans[format][diagnosis * 2];
+}
+
+
+void displayDiagnosis(const KnowledgeBase* kb, const Diagnosis* diag) {
+    size_t length;
+    const char* output = diagnosisOutput(kb, (uint32_t)(diag - kb->diagnoses), RENDER_ANSI, &length);
     
+    fflush(stdout);
+    if (output != NULL) {
+        writeAll(1, output, length);
+        return;
+    }
     
-    printf("\n\033[1m\033[36m  PREVENTION TIPS:\033[0m\n");
-    printf("  %s\n", diag->prevention);
+    TextBuffer out = { NULL, 0, 0, 0 };
+    renderDiagnosis(kb, diag, RENDER_ANSI, &out);
+    if (!out.failed) {
+        writeAll(1, out.data, out.used);
+    }
+    free(out.data);
+}
+
+
+size_t nextSearchToken(const char** cursor, char* token, int* prefix) {
+    const char* p = *cursor;
+    size_t length = 0;
     
+    while (*p != '\0' && !isalnum((unsigned char)*p)) {
+        p++;
+    }
+    while (isalnum((unsigned char)*p)) {
+        if (length < SEARCH_MAX_TERM) {
+            token[length++] = (char)tolower((unsigned char)*p);
+        }
+        p++;
+    }
+    token[length] = '\0';
+    if (prefix != NULL) {
+        *prefix = *p == '*';
+    }
+    *cursor = p;
+    return length;
+}
+
+
+static int growSearchSlots(uint32_t** slots, uint32_t* slot_count, const char* terms, const uint32_t* offsets,
+                           uint32_t term_count) {
+    uint32_t count = *slot_count * 2;
+    uint32_t* larger = (uint32_t*)trackedMalloc(count * sizeof(uint32_t));
     
-    printf("\n");
-    printSeparator('=', 70);
-    printf("\n\033[1m\033[31m  IMPORTANT DISCLAIMER:\033[0m\n");
-    printf("  This is for informational purposes only and not a substitute\n");
-    printf("  for professional medical advice. Always consult a healthcare\n");
-    printf("  provider for proper diagnosis and treatment.\n");
-    printSeparator('=', 70);
-    printf("\n");
+    if (larger == NULL) {
+        return 0;
+    }
+    memset(larger, 0xFF, count * sizeof(uint32_t));
+    for (uint32_t t = 0; t < term_count; t++) {
+        const char* text = terms + offsets[t];
+        uint32_t slot = hashString(text, strlen(text)) & (count - 1);
+        while (larger[slot] != 0xFFFFFFFFu) {
+            slot = (slot + 1) & (count - 1);
+        }
+        larger[slot] = t;
+    }
+    free(*slots);
+    *slots = larger;
+    *slot_count = count;
+    return 1;
+}
+
+
+static int compareSearchTerms(const void* a, const void* b) {
+    return strcmp(((const SearchTerm*)a)->text, ((const SearchTerm*)b)->text);
 }
 
 
-TreeNode* buildSymptomTree() {
+int buildSearchIndex(KnowledgeBase* kb) {
+    SearchIndex* index = &kb->search;
+    TextBuffer terms = { NULL, 0, 0, 0 };
+    uint32_t* occurrences = NULL;
+    size_t occurrence_count = 0;
+    size_t occurrence_capacity = 0;
+    uint32_t* offsets = NULL;
+    uint32_t term_count = 0;
+    uint32_t term_capacity = 0;
+    uint32_t slot_count = 1024;
+    uint32_t* slots = (uint32_t*)trackedMalloc(slot_count * sizeof(uint32_t));
+    uint32_t* last = NULL;
+    int ok = 0;
     
-    TreeNode* root = createNode(QUESTION_NODE, 
-        "Are you experiencing severe chest pain, difficulty breathing, or loss of consciousness?");
+    if (slots == NULL) {
+        return 0;
+    }
+    memset(slots, 0xFF, slot_count * sizeof(uint32_t));
+    for (uint32_t d = 0; d < kb->diagnosis_count; d++) {
+        const Diagnosis* diag = &kb->diagnoses[d];
+        const uint32_t fields[SEARCH_FIELDS] = { diag->condition, diag->description, diag->remedies,
+                                                 diag->medications, diag->prevention };
+        for (int f = 0; f < SEARCH_FIELDS; f++) {
+            const char* cursor = kbText(kb, fields[f]);
+            char token[SEARCH_MAX_TERM + 1];
+            size_t length;
+            while ((length = nextSearchToken(&cursor, token, NULL)) > 0) {
+                if (length < 2) {
+                    continue;
+                }
+                uint32_t slot = hashString(token, length) & (slot_count - 1);
+                while (slots[slot] != 0xFFFFFFFFu && strcmp(terms.data + offsets[slots[slot]], token) != 0) {
+                    slot = (slot + 1) & (slot_count - 1);
+                }
+                uint32_t term = slots[slot];
+                if (term == 0xFFFFFFFFu) {
+                    if (term_count == term_capacity) {
+                        term_capacity = term_capacity == 0 ? 256 : term_capacity * 2;
+                        uint32_t* grown = (uint32_t*)realloc(offsets, term_capacity * sizeof(uint32_t));
+                        if (grown == NULL) {
+                            goto done;
+                        }
+                        offsets = grown;
+                    }
+                    offsets[term_count] = (uint32_t)terms.used;
+                    textAppend(&terms, token, length + 1);
+                    term = term_count++;
+                    slots[slot] = term;
+                    if (terms.failed || (term_count * 2 > slot_count
+                                         && !growSearchSlots(&slots, &slot_count, terms.data, offsets, term_count))) {
+                        goto done;
+                    }
+                }
+                if (occurrence_count + 3 > occurrence_capacity) {
+                    occurrence_capacity = occurrence_capacity == 0 ? 3072 : occurrence_capacity * 2;
+                    uint32_t* grown = (uint32_t*)realloc(occurrences, occurrence_capacity * sizeof(uint32_t));
+                    if (grown == NULL) {
+                        goto done;
+                    }
+                    occurrences = grown;
+                }
+                occurrences[occurrence_count++] = term;
+                occurrences[occurrence_count++] = d;
+                occurrences[occurrence_count++] = 1u << f;
+            }
+        }
+    }
     
+    index->dictionary = (SearchTerm*)trackedMalloc((term_count + 1) * sizeof(SearchTerm));
+    last = (uint32_t*)trackedMalloc((term_count + 1) * sizeof(uint32_t));
+    if (index->dictionary == NULL || last == NULL) {
+        goto done;
+    }
+    memset(index->dictionary, 0, (term_count + 1) * sizeof(SearchTerm));
+    memset(last, 0xFF, (term_count + 1) * sizeof(uint32_t));
+    for (size_t i = 0; i < occurrence_count; i += 3) {
+        if (last[occurrences[i]] != occurrences[i + 1]) {
+            last[occurrences[i]] = occurrences[i + 1];
+            index->dictionary[occurrences[i]].count++;
+            index->posting_count++;
+        }
+    }
+    index->postings = (uint32_t*)trackedMalloc(((size_t)index->posting_count + 1) * sizeof(uint32_t));
+    index->fields = (uint8_t*)trackedMalloc((size_t)index->posting_count + 1);
+    if (index->postings == NULL || index->fields == NULL) {
+        goto done;
+    }
     
-    Diagnosis* emergency = createDiagnosis(
-        "POTENTIAL MEDICAL EMERGENCY",
-        EMERGENCY,
-        "You may be experiencing a life-threatening condition such as heart attack, stroke, or severe allergic reaction.",
-        "DO NOT WAIT - Take immediate action",
-        "Call emergency services (112) immediately",
-        "RIGHT NOW - This is an emergency",
-        "Regular health checkups, manage chronic conditions, know warning signs"
-    );
-    root->yes_branch = createDiagnosisNode(emergency);
+    uint32_t next = 0;
+    for (uint32_t t = 0; t < term_count; t++) {
+        index->dictionary[t].first = next;
+        next += index->dictionary[t].count;
+        index->dictionary[t].count = 0;
+    }
+    memset(last, 0xFF, (term_count + 1) * sizeof(uint32_t));
+    for (size_t i = 0; i < occurrence_count; i += 3) {
+        SearchTerm* term = &index->dictionary[occurrences[i]];
+        if (last[occurrences[i]] != occurrences[i + 1]) {
+            last[occurrences[i]] = occurrences[i + 1];
+            index->postings[term->first + term->count] = occurrences[i + 1];
+            index->fields[term->first + term->count] = 0;
+            term->count++;
+        }
+        index->fields[term->first + term->count - 1] |= (uint8_t)occurrences[i + 2];
+    }
     
+    index->terms = terms.data;
+    terms.data = NULL;
+    for (uint32_t t = 0; t < term_count; t++) {
+        index->dictionary[t].text = index->terms + offsets[t];
+    }
+    qsort(index->dictionary, term_count, sizeof(SearchTerm), compareSearchTerms);
+    index->term_count = term_count;
+    index->bytes = terms.capacity + (size_t)term_count * sizeof(SearchTerm)
+                 + (size_t)index->posting_count * (sizeof(uint32_t) + 1);
+    ok = 1;
     
-    TreeNode* q2 = createNode(QUESTION_NODE, 
-        "Do you have a fever (temperature above 38C)?");
-    root->no_branch = q2;
+done:
+    free(terms.data);
+    free(occurrences);
+    free(offsets);
+    free(slots);
+    free(last);
+    if (!ok) {
+        releaseSearchIndex(kb);
+    }
+    return ok;
+}
+
+
+void releaseSearchIndex(KnowledgeBase* kb) {
+    free(kb->search.terms);
+    free(kb->search.dictionary);
+    free(kb->search.postings);
+    free(kb->search.fields);
+    memset(&kb->search, 0, sizeof(kb->search));
+}
+
+
+static uint32_t findSearchTerm(const SearchIndex* index, const char* token, size_t length) {
+    uint32_t low = 0;
+    uint32_t high = index->term_count;
     
+    while (low < high) {
+        uint32_t middle = low + (high - low) / 2;
+        if (strncmp(index->dictionary[middle].text, token, length) < 0) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+
+static uint32_t gallop(const uint32_t* postings, uint32_t from, uint32_t count, uint32_t target) {
+    uint32_t step = 1;
+    uint32_t low = from;
+    uint32_t high = from;
     
-    TreeNode* q3 = createNode(QUESTION_NODE, 
-        "Is your fever accompanied by severe headache, stiff neck, or sensitivity to light?");
-    q2->yes_branch = q3;
+    while (high < count && postings[high] < target) {
+        low = high + 1;
+        high += step;
+        step *= 2;
+    }
+    if (high > count) {
+        high = count;
+    }
+    while (low < high) {
+        uint32_t middle = low + (high - low) / 2;
+        if (postings[middle] < target) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+
+static int collectSearchTerm(const KnowledgeBase* kb, const char* token, size_t length, int prefix,
+                             SearchResult* term, uint8_t* marks) {
+    const SearchIndex* index = &kb->search;
+    uint32_t first = findSearchTerm(index, token, prefix ? length : length + 1);
+    uint32_t end = first;
     
+    term->count = 0;
+    if (!prefix) {
+        if (first < index->term_count && strcmp(index->dictionary[first].text, token) == 0) {
+            term->diagnoses = index->postings + index->dictionary[first].first;
+            term->fields = index->fields + index->dictionary[first].first;
+            term->count = index->dictionary[first].count;
+        }
+        return 1;
+    }
     
-    Diagnosis* meningitis = createDiagnosis(
-        "POSSIBLE MENINGITIS OR SERIOUS INFECTION",
-        URGENT,
-        "These symptoms suggest a potentially serious infection affecting the brain or nervous system.",
-        "Seek immediate medical attention - do not wait",
-        "IV antibiotics or antivirals (hospital treatment required)",
-        "Immediately - go to emergency room",
-        "Stay up to date with vaccinations (meningococcal, pneumococcal)"
-    );
-    q3->yes_branch = createDiagnosisNode(meningitis);
+    while (end < index->term_count && strncmp(index->dictionary[end].text, token, length) == 0) {
+        end++;
+    }
+    if (end == first + 1) {
+        term->diagnoses = index->postings + index->dictionary[first].first;
+        term->fields = index->fields + index->dictionary[first].first;
+        term->count = index->dictionary[first].count;
+        return 1;
+    }
+    if (end == first) {
+        return 1;
+    }
     
-    TreeNode* q4 = createNode(QUESTION_NODE, 
-        "Have you had the fever for more than 3 days?");
-    q3->no_branch = q4;
+    uint32_t* diagnoses = (uint32_t*)trackedMalloc(((size_t)kb->diagnosis_count + 1) * sizeof(uint32_t));
+    uint8_t* fields = (uint8_t*)trackedMalloc((size_t)kb->diagnosis_count + 1);
+    if (diagnoses == NULL || fields == NULL) {
+        free(diagnoses);
+        free(fields);
+        return 0;
+    }
+    memset(marks, 0, kb->diagnosis_count);
+    for (uint32_t t = first; t < end; t++) {
+        const SearchTerm* entry = &index->dictionary[t];
+        for (uint32_t p = 0; p < entry->count; p++) {
+            marks[index->postings[entry->first + p]] |= index->fields[entry->first + p];
+        }
+    }
+    for (uint32_t d = 0; d < kb->diagnosis_count; d++) {
+        if (marks[d] != 0) {
+            diagnoses[term->count] = d;
+            fields[term->count++] = marks[d];
+        }
+    }
+    term->diagnoses = diagnoses;
+    term->fields = fields;
+    term->owned = 1;
+    return 1;
+}
+
+
+int searchKnowledgeBase(const KnowledgeBase* kb, const char* query, SearchResult* result) {
+    SearchResult terms[SEARCH_MAX_QUERY_TERMS];
+    int term_count = 0;
+    uint8_t* marks = (uint8_t*)trackedMalloc((size_t)kb->diagnosis_count + 1);
+    const char* cursor = query;
+    char token[SEARCH_MAX_TERM + 1];
+    size_t length;
+    int prefix;
+    int ok = 1;
     
-    TreeNode* q5 = createNode(QUESTION_NODE, 
-        "Do you also have body aches, fatigue, and cough?");
-    q4->yes_branch = q5;
+    memset(result, 0, sizeof(*result));
+    if (marks == NULL) {
+        return 0;
+    }
+    while ((length = nextSearchToken(&cursor, token, &prefix)) > 0 && term_count < SEARCH_MAX_QUERY_TERMS) {
+        if (length < 2 && !prefix) {
+            continue;
+        }
+        memset(&terms[term_count], 0, sizeof(SearchResult));
+        if (!collectSearchTerm(kb, token, length, prefix, &terms[term_count], marks)) {
+            ok = 0;
+            break;
+        }
+        term_count++;
+    }
+    result->terms = term_count;
     
+    int smallest = 0;
+    for (int t = 1; t < term_count; t++) {
+        if (terms[t].count < terms[smallest].count) {
+            smallest = t;
+        }
+    }
+    if (ok && term_count > 0 && terms[smallest].count > 0) {
+        result->diagnoses = (uint32_t*)trackedMalloc((size_t)terms[smallest].count * sizeof(uint32_t));
+        result->fields = (uint8_t*)trackedMalloc(terms[smallest].count);
+        result->owned = 1;
+        if (result->diagnoses == NULL || result->fields == NULL) {
+            ok = 0;
+        }
+    }
+    if (ok && result->diagnoses != NULL) {
+        uint32_t cursors[SEARCH_MAX_QUERY_TERMS] = { 0 };
+        for (uint32_t i = 0; i < terms[smallest].count; i++) {
+            uint32_t d = terms[smallest].diagnoses[i];
+            uint8_t fields = terms[smallest].fields[i];
+            int t = 0;
+            for (; t < term_count; t++) {
+                if (t == smallest) {
+                    continue;
+                }
+                cursors[t] = gallop(terms[t].diagnoses, cursors[t], terms[t].count, d);
+                if (cursors[t] == terms[t].count || terms[t].diagnoses[cursors[t]] != d) {
+                    break;
+                }
+                fields |= terms[t].fields[cursors[t]];
+            }
+            if (t == term_count) {
+                result->diagnoses[result->count] = d;
+                result->fields[result->count++] = fields;
+            }
+        }
+    }
     
-    Diagnosis* flu = createDiagnosis(
-        "INFLUENZA (FLU)",
-        MODERATE,
-        "You likely have the flu, a viral infection affecting the respiratory system. Most people recover within 1-2 weeks.",
-        "Rest, drink plenty of fluids (water, warm soups), use a humidifier, gargle with salt water",
-        "Acetaminophen (Tylenol) 500-1000mg every 6 hours OR Ibuprofen (Advil) 400mg every 6 hours for fever/pain. Antiviral medications (Tamiflu) if prescribed within 48 hours of symptom onset",
-        "If fever persists beyond 5 days, difficulty breathing develops, or symptoms worsen",
-        "Annual flu vaccination, frequent handwashing, avoid close contact with sick individuals"
-    );
-    q5->yes_branch = createDiagnosisNode(flu);
+    for (int t = 0; t < term_count; t++) {
+        releaseSearchResult(&terms[t]);
+    }
+    free(marks);
+    if (!ok) {
+        releaseSearchResult(result);
+    }
+    return ok;
+}
+
+
+void releaseSearchResult(SearchResult* result) {
+    if (result->owned) {
+        free(result->diagnoses);
+        free(result->fields);
+    }
+    result->diagnoses = NULL;
+    result->fields = NULL;
+    result->count = 0;
+    result->owned = 0;
+}
+
+
+const char* searchFieldName(int field) {
+    static const char* names[SEARCH_FIELDS] = { "condition", "description", "remedies", "medications", "prevention" };
+    return field >= 0 && field < SEARCH_FIELDS ? names[field] : "";
+}
+
+
+int printSearchResults(const KnowledgeBase* kb, const char* query) {
+    SearchResult result;
+    double started = monotonicMs();
     
+    if (!searchKnowledgeBase(kb, query, &result)) {
+        printf("\033[31mMemory allocation failed!\033[0m\n");
+        return 0;
+    }
+    double elapsed = monotonicMs() - started;
+    if (result.terms == 0) {
+        printf("\033[31mNothing to search for in \"%s\" (use words of two or more letters, or a prefix such as ibu*)\033[0m\n",
+               query);
+        return 0;
+    }
     
-    Diagnosis* bacterial = createDiagnosis(
-        "POSSIBLE BACTERIAL INFECTION",
-        URGENT,
-        "Persistent fever may indicate a bacterial infection requiring antibiotics.",
-        "Monitor temperature, stay hydrated, get plenty of rest",
-        "See a doctor for evaluation - may need antibiotics like Amoxicillin or Azithromycin",
-        "Within 24 hours - persistent fever needs medical evaluation",
-        "Practice good hygiene, complete full course of antibiotics if prescribed"
-    );
-    q5->no_branch = createDiagnosisNode(bacterial);
+    printf("%u %s \"%s\" (%.3f ms over %u indexed terms)\n", result.count,
+           result.count == 1 ? "diagnosis matches" : "diagnoses match", query, elapsed, kb->search.term_count);
+    for (uint32_t i = 0; i < result.count; i++) {
+        const Diagnosis* diag = &kb->diagnoses[result.diagnoses[i]];
+        const char* separator = "";
+        printf("  %4u  %-9s %-44s ", result.diagnoses[i], severityName(diag->severity), kbText(kb, diag->condition));
+        for (int f = 0; f < SEARCH_FIELDS; f++) {
+            if (result.fields[i] & (1u << f)) {
+                printf("%s%s", separator, searchFieldName(f));
+                separator = ", ";
+            }
+        }
+        printf("\n");
+    }
+    releaseSearchResult(&result);
+    return 1;
+}
+
+
+void facilityPoint(double lat, double lon, double point[3]) {
+    double phi = lat * (M_PI / 180.0);
+    double lambda = lon * (M_PI / 180.0);
     
+    point[0] = cos(phi) * cos(lambda);
+    point[1] = cos(phi) * sin(lambda);
+    point[2] = sin(phi);
+}
+
+
+static void swapFacilities(float* points, Facility* facilities, long a, long b) {
+    float point[3];
+    Facility facility;
     
-    Diagnosis* viral = createDiagnosis(
-        "COMMON VIRAL INFECTION",
-        MILD,
-        "You likely have a common viral infection. Your body is fighting off the virus naturally.",
-        "Rest, drink 8-10 glasses of water daily, eat nutritious foods (fruits, vegetables, soup)",
-        "Acetaminophen (Tylenol) 500mg every 6 hours OR Ibuprofen (Advil) 400mg every 6 hours. Do NOT combine both. Take with food",
-        "If fever exceeds 39.4C, lasts more than 3 days, or you develop new symptoms",
-        "Good nutrition, adequate sleep (7-9 hours), regular exercise, stress management"
-    );
-    q4->no_branch = createDiagnosisNode(viral);
+    memcpy(point, points + 3 * a, sizeof(point));
+    memcpy(points + 3 * a, points + 3 * b, sizeof(point));
+    memcpy(points + 3 * b, point, sizeof(point));
+    facility = facilities[a];
+    facilities[a] = facilities[b];
+    facilities[b] = facility;
+}
+
+
+static void selectFacility(float* points, Facility* facilities, long left, long right, long k, int axis) {
+    while (right > left) {
+        float pivot = points[3 * k + axis];
+        long i = left;
+        long j = right;
     
+        swapFacilities(points, facilities, left, k);
+        if (points[3 * right + axis] > pivot) {
+            swapFacilities(points, facilities, left, right);
+        }
+        while (i < j) {
+            swapFacilities(points, facilities, i, j);
+            i++;
+            j--;
+            while (points[3 * i + axis] < pivot) {
+                i++;
+            }
+            while (points[3 * j + axis] > pivot) {
+                j--;
+            }
+        }
+        if (points[3 * left + axis] == pivot) {
+            swapFacilities(points, facilities, left, j);
+        } else {
+            j++;
+            swapFacilities(points, facilities, j, right);
+        }
+        if (j <= k) {
+            left = j + 1;
+        }
+        if (k <= j) {
+            right = j - 1;
+        }
+    }
+}
+
+
+void buildFacilityTree(float* points, Facility* facilities, uint32_t lo, uint32_t hi, int axis) {
+    while (hi - lo > FACILITY_LEAF_SIZE) {
+        uint32_t middle = lo + (hi - lo) / 2;
+        selectFacility(points, facilities, lo, (long)hi - 1, middle, axis);
+        buildFacilityTree(points, facilities, lo, middle, (axis + 1) % 3);
+        lo = middle + 1;
+        axis = (axis + 1) % 3;
+    }
+}
+
+
+int exportFacilityIndex(const float* points, const Facility* facilities, uint32_t count,
+                        const StringPool* strings, const char* path) {
+    FacilityFileHeader header;
+    static const char padding[16] = {0};
+    uint32_t points_bytes = count * 3 * (uint32_t)sizeof(float);
+    uint32_t facilities_bytes = count * (uint32_t)sizeof(Facility);
+    char temporary[1024];
+    FILE* out;
     
-    TreeNode* q6 = createNode(QUESTION_NODE, 
-        "Are you experiencing persistent cough or congestion?");
-    q2->no_branch = q6;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, FACILITY_FILE_MAGIC, 4);
+    header.format_version = FACILITY_FORMAT_VERSION;
+    header.header_size = sizeof(FacilityFileHeader);
+    header.facility_count = count;
+    header.leaf_size = FACILITY_LEAF_SIZE;
+    header.string_bytes = strings->used;
+    header.points_offset = sizeof(FacilityFileHeader);
+    header.facilities_offset = header.points_offset + points_bytes;
+    header.strings_offset = (header.facilities_offset + facilities_bytes + 15) & ~15u;
+    header.file_size = header.strings_offset + header.string_bytes;
     
-    TreeNode* q7 = createNode(QUESTION_NODE, 
-        "Do you have thick yellow/green mucus or cough lasting more than 10 days?");
-    q6->yes_branch = q7;
+    header.checksum = crc32Update(0, points, points_bytes);
+    header.checksum = crc32Update(header.checksum, facilities, facilities_bytes);
+    header.checksum = crc32Update(header.checksum, padding,
+                                  header.strings_offset - header.facilities_offset - facilities_bytes);
+    header.checksum = crc32Update(header.checksum, strings->data, strings->used);
     
+    snprintf(temporary, sizeof(temporary), "%s.tmp", path);
+    out = fopen(temporary, "wb");
+    if (out == NULL) {
+        fprintf(stderr, "Cannot create %s\n", temporary);
+        return 0;
+    }
     
-    Diagnosis* sinusitis = createDiagnosis(
-        "SINUSITIS (SINUS INFECTION)",
-        MODERATE,
-        "You likely have a sinus infection, which can be viral or bacterial. The thick, colored mucus and duration suggest possible bacterial sinusitis.",
-        "Steam inhalation 2-3 times daily, nasal saline irrigation (Neti pot), warm compress on face, drink plenty of fluids, sleep with head elevated",
-        "Decongestants: Pseudoephedrine (Sudafed) 30-60mg every 4-6 hours OR Phenylephrine (Sudafed PE) 10mg every 4 hours. Nasal spray: Fluticasone (Flonase) 2 sprays each nostril daily. Pain relief: Ibuprofen 400mg every 6 hours. If bacterial: doctor may prescribe Amoxicillin-Clavulanate",
-        "If symptoms last more than 10 days, severe facial pain, vision changes, or high fever develops",
-        "Use humidifier, avoid allergens and irritants, manage allergies, stay hydrated"
-    );
-    q7->yes_branch = createDiagnosisNode(sinusitis);
+    uint32_t padding_bytes = header.strings_offset - header.facilities_offset - facilities_bytes;
+    int ok = fwrite(&header, 1, sizeof(header), out) == sizeof(header)
+          && fwrite(points, 1, points_bytes, out) == points_bytes
+          && fwrite(facilities, 1, facilities_bytes, out) == facilities_bytes
+          && fwrite(padding, 1, padding_bytes, out) == padding_bytes
+          && fwrite(strings->data, 1, strings->used, out) == strings->used;
     
-    TreeNode* q8 = createNode(QUESTION_NODE, 
-        "Do you have runny nose, sneezing, and itchy/watery eyes?");
-    q7->no_branch = q8;
+    if (!replaceWithFile(out, temporary, path, ok)) {
+        fprintf(stderr, "Failed to write %s\n", path);
+        return 0;
+    }
+    return 1;
+}
+
+
+const char* validateFacilityImage(const unsigned char* image, size_t size) {
+    const FacilityFileHeader* header = (const FacilityFileHeader*)image;
+    const Facility* facilities;
+    const char* strings;
     
+    if (size < sizeof(FacilityFileHeader) || memcmp(header->magic, FACILITY_FILE_MAGIC, 4) != 0) {
+        return "not a facility index";
+    }
+    if (header->format_version != FACILITY_FORMAT_VERSION || header->header_size != sizeof(FacilityFileHeader)) {
+        return "unsupported format version";
+    }
+    if (header->file_size != size) {
+        return "file size does not match header";
+    }
+    if (header->leaf_size == 0 || header->string_bytes == 0
+        || header->points_offset % 4 != 0 || header->facilities_offset % 4 != 0
+        || (uint64_t)header->points_offset + (uint64_t)header->facility_count * 3 * sizeof(float) > size
+        || (uint64_t)header->facilities_offset + (uint64_t)header->facility_count * sizeof(Facility) > size
+        || (uint64_t)header->strings_offset + header->string_bytes > size
+        || header->points_offset < sizeof(FacilityFileHeader)
+        || header->facilities_offset < sizeof(FacilityFileHeader)
+        || header->strings_offset < sizeof(FacilityFileHeader)) {
+        return "section offsets out of range";
+    }
+    if (crc32Update(0, image + sizeof(FacilityFileHeader), size - sizeof(FacilityFileHeader)) != header->checksum) {
+        return "checksum mismatch";
+    }
     
-    Diagnosis* allergies = createDiagnosis(
+    facilities = (const Facility*)(image + header->facilities_offset);
+    strings = (const char*)(image + header->strings_offset);
+    if (strings[0] != '\0' || strings[header->string_bytes - 1] != '\0') {
+        return "string pool is not terminated";
+    }
+    for (uint32_t i = 0; i < header->facility_count; i++) {
+        const Facility* facility = &facilities[i];
+        if (facility->name >= header->string_bytes || facility->amenity >= header->string_bytes
+            || facility->address >= header->string_bytes || facility->phone >= header->string_bytes
+            || facility->website >= header->string_bytes) {
+            return "facility text out of range";
+        }
+    }
+    
+    return NULL;
+}
+
+
+FacilityIndex* loadFacilityIndex(const char* path) {
+    FacilityIndex* index;
+    const unsigned char* image;
+    const FacilityFileHeader* header;
+    const char* error;
+    size_t size = 0;
+    
+    image = (const unsigned char*)mapFile(path, &size);
+    if (image == NULL) {
+        printf("\033[31mCannot open facility index %s\033[0m\n", path);
+        return NULL;
+    }
+    
+    error = validateFacilityImage(image, size);
+    if (error != NULL) {
+        printf("\033[31mInvalid facility index %s: %s\033[0m\n", path, error);
+        unmapFile(image, size);
+        return NULL;
+    }
+    
+    index = (FacilityIndex*)trackedMalloc(sizeof(FacilityIndex));
+    if (index == NULL) {
+        printf("\033[31mMemory allocation failed!\033[0m\n");
+        unmapFile(image, size);
+        return NULL;
+    }
+    
+    header = (const FacilityFileHeader*)image;
+    index->mapping = image;
+    index->mapping_size = size;
+    index->points = (const float*)(image + header->points_offset);
+    index->facilities = (const Facility*)(image + header->facilities_offset);
+    index->strings = (const char*)(image + header->strings_offset);
+    index->count = header->facility_count;
+    index->leaf_size = header->leaf_size;
+    index->string_bytes = header->string_bytes;
+    
+    return index;
+}
+
+
+void releaseFacilityIndex(FacilityIndex* index) {
+    if (index == NULL) {
+        return;
+    }
+    unmapFile(index->mapping, index->mapping_size);
+    free(index);
+}
+
+
+const char* facilityText(const FacilityIndex* index, uint32_t offset) {
+    return offset < index->string_bytes ? index->strings + offset : "";
+}
+
+
+static void offerFacility(FacilitySearch* search, const FacilityIndex* index, uint32_t facility) {
+    const float* point = index->points + 3 * (size_t)facility;
+    double dx = search->query[0] - point[0];
+    double dy = search->query[1] - point[1];
+    double dz = search->query[2] - point[2];
+    double chord2 = dx * dx + dy * dy + dz * dz;
+    FacilityMatch* heap = search->heap;
+    int slot;
+    
+    if (chord2 > search->limit2) {
+        return;
+    }
+    if (search->count < search->capacity) {
+        slot = search->count++;
+        while (slot > 0 && heap[(slot - 1) / 2].chord2 < chord2) {
+            heap[slot] = heap[(slot - 1) / 2];
+            slot = (slot - 1) / 2;
+        }
+    } else if (chord2 < heap[0].chord2) {
+        slot = 0;
+        for (;;) {
+            int child = 2 * slot + 1;
+            if (child >= search->count) {
+                break;
+            }
+            if (child + 1 < search->count && heap[child + 1].chord2 > heap[child].chord2) {
+                child++;
+            }
+            if (heap[child].chord2 <= chord2) {
+                break;
+            }
+            heap[slot] = heap[child];
+            slot = child;
+        }
+    } else {
+        return;
+    }
+    heap[slot].facility = facility;
+    heap[slot].chord2 = chord2;
+    if (search->count == search->capacity) {
+        search->limit2 = heap[0].chord2;
+    }
+}
+
+
+static void searchFacilityRange(FacilitySearch* search, const FacilityIndex* index, uint32_t lo, uint32_t hi,
+                                int axis) {
+    while (hi - lo > index->leaf_size) {
+        uint32_t middle = lo + (hi - lo) / 2;
+        double delta = search->query[axis] - index->points[3 * (size_t)middle + axis];
+        int next = (axis + 1) % 3;
+    
+        offerFacility(search, index, middle);
+        if (delta < 0) {
+            searchFacilityRange(search, index, lo, middle, next);
+            if (delta * delta > search->limit2) {
+                return;
+            }
+            lo = middle + 1;
+        } else {
+            searchFacilityRange(search, index, middle + 1, hi, next);
+            if (delta * delta > search->limit2) {
+                return;
+            }
+            hi = middle;
+        }
+        axis = next;
+    }
+    for (uint32_t i = lo; i < hi; i++) {
+        offerFacility(search, index, i);
+    }
+}
+
+
+static int compareFacilityMatches(const void* a, const void* b) {
+    double left = ((const FacilityMatch*)a)->chord2;
+    double right = ((const FacilityMatch*)b)->chord2;
+    return left < right ? -1 : left > right;
+}
+
+
+int findFacilities(const FacilityIndex* index, double lat, double lon, double radius_km, int limit,
+                   FacilityMatch* out) {
+    FacilitySearch search;
+    double angle = radius_km / EARTH_RADIUS_KM;
+    
+    if (limit <= 0 || index->count == 0) {
+        return 0;
+    }
+    facilityPoint(lat, lon, search.query);
+    search.limit2 = radius_km > 0 && angle < M_PI ? 4.0 * sin(angle / 2) * sin(angle / 2) : 4.0;
+    search.heap = out;
+    search.count = 0;
+    search.capacity = limit;
+    searchFacilityRange(&search, index, 0, index->count, 0);
+    
+    qsort(out, search.count, sizeof(FacilityMatch), compareFacilityMatches);
+    for (int i = 0; i < search.count; i++) {
+        double chord = sqrt(out[i].chord2);
+        out[i].distance_km = 2.0 * asin(chord < 2.0 ? chord / 2.0 : 1.0) * EARTH_RADIUS_KM;
+    }
+    return search.count;
+}
+
+
+int printNearestFacilities(const FacilityIndex* index, double lat, double lon, int limit, double radius_km) {
+    FacilityMatch matches[FACILITY_MAX_RESULTS];
+    double started = monotonicMs();
+    int count = findFacilities(index, lat, lon, radius_km, limit, matches);
+    double elapsed = monotonicMs() - started;
+    
+    printf("%d nearest of %u facilities to %.5f, %.5f", count, index->count, lat, lon);
+    if (radius_km > 0) {
+        printf(" within %.1f km", radius_km);
+    }
+    printf(" (%.1f us)\n", elapsed * 1000.0);
+    for (int i = 0; i < count; i++) {
+        const Facility* facility = &index->facilities[matches[i].facility];
+        const char* address = facilityText(index, facility->address);
+        printf("  %8.2f km  %-10s %s", matches[i].distance_km, facilityText(index, facility->amenity),
+               facility->name != 0 ? facilityText(index, facility->name) : "(unnamed)");
+        if (address[0] != '\0') {
+            printf(", %s", address);
+        }
+        printf("\n");
+    }
+    return count;
+}
+
+
+TreeNode* buildSymptomTree(KnowledgeBase* kb) {
+    
+    TreeNode* root = createNode(kb, QUESTION_NODE, 
+        "Are you experiencing severe chest pain, difficulty breathing, or loss of consciousness?");
+    
+    
+    Diagnosis* emergency = createDiagnosis(kb,
+        "POTENTIAL MEDICAL EMERGENCY",
+        EMERGENCY,
+        "You may be experiencing a life-threatening condition such as heart attack, stroke, or severe allergic reaction.",
+        "DO NOT WAIT - Take immediate action",
+        "Call emergency services (112) immediately",
+        "RIGHT NOW - This is an emergency",
+        "Regular health checkups, manage chronic conditions, know warning signs"
+    );
+    setYesBranch(root, createDiagnosisNode(kb, emergency));
+    
+    
+    TreeNode* q2 = createNode(kb, QUESTION_NODE, 
+        "Do you have a fever (temperature above 38C)?");
+    setNoBranch(root, q2);
+    
+    
+    TreeNode* q3 = createNode(kb, QUESTION_NODE, 
+        "Is your fever accompanied by severe headache, stiff neck, or sensitivity to light?");
+    setYesBranch(q2, q3);
+    
+    
+    Diagnosis* meningitis = createDiagnosis(kb,
+        "POSSIBLE MENINGITIS OR SERIOUS INFECTION",
+        URGENT,
+        "These symptoms suggest a potentially serious infection affecting the brain or nervous system.",
+        "Seek immediate medical attention - do not wait",
+        "IV antibiotics or antivirals (hospital treatment required)",
+        "Immediately - go to emergency room",
+        "Stay up to date with vaccinations (meningococcal, pneumococcal)"
+    );
+    setYesBranch(q3, createDiagnosisNode(kb, meningitis));
+    
+    TreeNode* q4 = createNode(kb, QUESTION_NODE, 
+        "Have you had the fever for more than 3 days?");
+    setNoBranch(q3, q4);
+    
+    TreeNode* q5 = createNode(kb, QUESTION_NODE, 
+        "Do you also have body aches, fatigue, and cough?");
+    setYesBranch(q4, q5);
+    
+    
+    Diagnosis* flu = createDiagnosis(kb,
+        "INFLUENZA (FLU)",
+        MODERATE,
+        "You likely have the flu, a viral infection affecting the respiratory system. Most people recover within 1-2 weeks.",
+        "Rest, drink plenty of fluids (water, warm soups), use a humidifier, gargle with salt water",
+        "Acetaminophen (Tylenol) 500-1000mg every 6 hours OR Ibuprofen (Advil) 400mg every 6 hours for fever/pain. Antiviral medications (Tamiflu) if prescribed within 48 hours of symptom onset",
+        "If fever persists beyond 5 days, difficulty breathing develops, or symptoms worsen",
+        "Annual flu vaccination, frequent handwashing, avoid close contact with sick individuals"
+    );
+    setYesBranch(q5, createDiagnosisNode(kb, flu));
+    
+    
+    Diagnosis* bacterial = createDiagnosis(kb,
+        "POSSIBLE BACTERIAL INFECTION",
+        URGENT,
+        "Persistent fever may indicate a bacterial infection requiring antibiotics.",
+        "Monitor temperature, stay hydrated, get plenty of rest",
+        "See a doctor for evaluation - may need antibiotics like Amoxicillin or Azithromycin",
+        "Within 24 hours - persistent fever needs medical evaluation",
+        "Practice good hygiene, complete full course of antibiotics if prescribed"
+    );
+    setNoBranch(q5, createDiagnosisNode(kb, bacterial));
+    
+    
+    Diagnosis* viral = createDiagnosis(kb,
+        "COMMON VIRAL INFECTION",
+        MILD,
+        "You likely have a common viral infection. Your body is fighting off the virus naturally.",
+        "Rest, drink 8-10 glasses of water daily, eat nutritious foods (fruits, vegetables, soup)",
+        "Acetaminophen (Tylenol) 500mg every 6 hours OR Ibuprofen (Advil) 400mg every 6 hours. Do NOT combine both. Take with food",
+        "If fever exceeds 39.4C, lasts more than 3 days, or you develop new symptoms",
+        "Good nutrition, adequate sleep (7-9 hours), regular exercise, stress management"
+    );
+    setNoBranch(q4, createDiagnosisNode(kb, viral));
+    
+    
+    TreeNode* q6 = createNode(kb, QUESTION_NODE, 
+        "Are you experiencing persistent cough or congestion?");
+    setNoBranch(q2, q6);
+    
+    TreeNode* q7 = createNode(kb, QUESTION_NODE, 
+        "Do you have thick yellow/green mucus or cough lasting more than 10 days?");
+    setYesBranch(q6, q7);
+    
+    
+    Diagnosis* sinusitis = createDiagnosis(kb,
+        "SINUSITIS (SINUS INFECTION)",
+        MODERATE,
+        "You likely have a sinus infection, which can be viral or bacterial. The thick, colored mucus and duration suggest possible bacterial sinusitis.",
+        "Steam inhalation 2-3 times daily, nasal saline irrigation (Neti pot), warm compress on face, drink plenty of fluids, sleep with head elevated",
+        "Decongestants: Pseudoephedrine (Sudafed) 30-60mg every 4-6 hours OR Phenylephrine (Sudafed PE) 10mg every 4 hours. Nasal spray: Fluticasone (Flonase) 2 sprays each nostril daily. Pain relief: Ibuprofen 400mg every 6 hours. If bacterial: doctor may prescribe Amoxicillin-Clavulanate",
+        "If symptoms last more than 10 days, severe facial pain, vision changes, or high fever develops",
+        "Use humidifier, avoid allergens and irritants, manage allergies, stay hydrated"
+    );
+    setYesBranch(q7, createDiagnosisNode(kb, sinusitis));
+    
+    TreeNode* q8 = createNode(kb, QUESTION_NODE, 
+        "Do you have runny nose, sneezing, and itchy/watery eyes?");
+    setNoBranch(q7, q8);
+    
+    
+    Diagnosis* allergies = createDiagnosis(kb,
         "ALLERGIC RHINITIS (ALLERGIES)",
         MILD,
         "You're experiencing allergic rhinitis, an allergic reaction to airborne substances like pollen, dust, or pet dander.",
@@ -432,10 +2359,10 @@ TreeNode* buildSymptomTree() {
         "If symptoms interfere with daily life, aren't controlled with OTC medications, or you want allergy testing",
         "Identify and avoid allergens, keep home clean, use air purifiers, consider allergy testing"
     );
-    q8->yes_branch = createDiagnosisNode(allergies);
+    setYesBranch(q8, createDiagnosisNode(kb, allergies));
     
     
-    Diagnosis* cold = createDiagnosis(
+    Diagnosis* cold = createDiagnosis(kb,
         "COMMON COLD",
         MILD,
         "You have a common cold, a viral upper respiratory infection. It typically resolves within 7-10 days.",
@@ -444,23 +2371,23 @@ TreeNode* buildSymptomTree() {
         "If symptoms worsen after 7 days, difficulty breathing, ear pain, or fever develops",
         "Frequent handwashing, avoid touching face, get adequate sleep, manage stress, eat nutritious diet"
     );
-    q8->no_branch = createDiagnosisNode(cold);
+    setNoBranch(q8, createDiagnosisNode(kb, cold));
     
     
-    TreeNode* q9 = createNode(QUESTION_NODE, 
+    TreeNode* q9 = createNode(kb, QUESTION_NODE, 
         "Are you experiencing stomach pain, nausea, or digestive issues?");
-    q6->no_branch = q9;
+    setNoBranch(q6, q9);
     
-    TreeNode* q10 = createNode(QUESTION_NODE, 
+    TreeNode* q10 = createNode(kb, QUESTION_NODE, 
         "Do you have diarrhea or vomiting?");
-    q9->yes_branch = q10;
+    setYesBranch(q9, q10);
     
-    TreeNode* q11 = createNode(QUESTION_NODE, 
+    TreeNode* q11 = createNode(kb, QUESTION_NODE, 
         "Have symptoms lasted more than 48 hours or do you have signs of dehydration (dark urine, dizziness)?");
-    q10->yes_branch = q11;
+    setYesBranch(q10, q11);
     
     
-    Diagnosis* severe_gi = createDiagnosis(
+    Diagnosis* severe_gi = createDiagnosis(kb,
         "SEVERE GASTROENTERITIS (STOMACH FLU)",
         URGENT,
         "Prolonged vomiting/diarrhea can lead to dangerous dehydration requiring medical attention.",
@@ -469,10 +2396,10 @@ TreeNode* buildSymptomTree() {
         "Within 24 hours - dehydration is serious and may require IV fluids",
         "Hand hygiene, food safety (proper cooking/storage), avoid contaminated water"
     );
-    q11->yes_branch = createDiagnosisNode(severe_gi);
+    setYesBranch(q11, createDiagnosisNode(kb, severe_gi));
     
     
-    Diagnosis* gastro = createDiagnosis(
+    Diagnosis* gastro = createDiagnosis(kb,
         "VIRAL GASTROENTERITIS (STOMACH BUG)",
         MILD,
         "You have a stomach bug, typically caused by a virus. Most cases resolve within 24-48 hours.",
@@ -481,14 +2408,14 @@ TreeNode* buildSymptomTree() {
         "If symptoms persist beyond 48 hours, blood in stool, severe abdominal pain, signs of dehydration",
         "Wash hands frequently, avoid contaminated food/water, clean surfaces, stay home when sick"
     );
-    q11->no_branch = createDiagnosisNode(gastro);
+    setNoBranch(q11, createDiagnosisNode(kb, gastro));
     
-    TreeNode* q12 = createNode(QUESTION_NODE, 
+    TreeNode* q12 = createNode(kb, QUESTION_NODE, 
         "Do you have heartburn or burning sensation in chest/throat?");
-    q10->no_branch = q12;
+    setNoBranch(q10, q12);
     
     
-    Diagnosis* gerd = createDiagnosis(
+    Diagnosis* gerd = createDiagnosis(kb,
         "ACID REFLUX / GERD (GASTROESOPHAGEAL REFLUX DISEASE)",
         MILD,
         "Stomach acid flowing back into the esophagus causes heartburn. Lifestyle changes and medication can help.",
@@ -497,10 +2424,10 @@ TreeNode* buildSymptomTree() {
         "If symptoms occur more than twice a week, difficulty swallowing, persistent symptoms despite treatment, or unexplained weight loss",
         "Maintain healthy weight, avoid trigger foods, eat smaller meals, quit smoking, limit alcohol"
     );
-    q12->yes_branch = createDiagnosisNode(gerd);
+    setYesBranch(q12, createDiagnosisNode(kb, gerd));
     
     
-    Diagnosis* indigestion = createDiagnosis(
+    Diagnosis* indigestion = createDiagnosis(kb,
         "INDIGESTION (DYSPEPSIA)",
         MILD,
         "Mild stomach discomfort, often related to eating or stress. Usually resolves on its own.",
@@ -509,19 +2436,19 @@ TreeNode* buildSymptomTree() {
         "If pain is severe, persists for several days, or you have unexplained weight loss",
         "Eat balanced diet, manage stress, exercise regularly, avoid overeating, identify food triggers"
     );
-    q12->no_branch = createDiagnosisNode(indigestion);
+    setNoBranch(q12, createDiagnosisNode(kb, indigestion));
     
     
-    TreeNode* q13 = createNode(QUESTION_NODE, 
+    TreeNode* q13 = createNode(kb, QUESTION_NODE, 
         "Are you experiencing headache?");
-    q9->no_branch = q13;
+    setNoBranch(q9, q13);
     
-    TreeNode* q14 = createNode(QUESTION_NODE, 
+    TreeNode* q14 = createNode(kb, QUESTION_NODE, 
         "Is it a severe, sudden headache (worst of your life) or accompanied by vision changes?");
-    q13->yes_branch = q14;
+    setYesBranch(q13, q14);
     
     
-    Diagnosis* severe_headache = createDiagnosis(
+    Diagnosis* severe_headache = createDiagnosis(kb,
         "POSSIBLE SERIOUS HEADACHE CONDITION",
         EMERGENCY,
         "Sudden severe headache or headache with neurological symptoms requires immediate evaluation to rule out serious conditions.",
@@ -530,14 +2457,14 @@ TreeNode* buildSymptomTree() {
         "IMMEDIATELY - Go to emergency room or call 112",
         "Manage blood pressure, avoid triggers, regular health checkups"
     );
-    q14->yes_branch = createDiagnosisNode(severe_headache);
+    setYesBranch(q14, createDiagnosisNode(kb, severe_headache));
     
-    TreeNode* q15 = createNode(QUESTION_NODE, 
+    TreeNode* q15 = createNode(kb, QUESTION_NODE, 
         "Is it a throbbing headache on one side, possibly with nausea or light sensitivity?");
-    q14->no_branch = q15;
+    setNoBranch(q14, q15);
     
     
-    Diagnosis* migraine = createDiagnosis(
+    Diagnosis* migraine = createDiagnosis(kb,
         "MIGRAINE HEADACHE",
         MODERATE,
         "Migraines are intense headaches often with throbbing pain, nausea, and sensitivity to light/sound. They can last 4-72 hours.",
@@ -546,10 +2473,10 @@ TreeNode* buildSymptomTree() {
         "If migraines occur frequently (>4/month), don't respond to OTC medications, or significantly impact daily life - you may need prescription preventive medication",
         "Maintain regular sleep schedule, manage stress, stay hydrated, exercise regularly, identify food triggers, avoid skipping meals"
     );
-    q15->yes_branch = createDiagnosisNode(migraine);
+    setYesBranch(q15, createDiagnosisNode(kb, migraine));
     
     
-    Diagnosis* tension = createDiagnosis(
+    Diagnosis* tension = createDiagnosis(kb,
         "TENSION HEADACHE",
         MILD,
         "Most common type of headache, causing mild to moderate pain, often described as a tight band around the head. Usually related to stress or muscle tension.",
@@ -558,143 +2485,4807 @@ TreeNode* buildSymptomTree() {
         "If headaches occur frequently (>15 days/month), interfere with daily activities, or change in pattern",
         "Manage stress, maintain good posture, regular exercise, adequate sleep, stay hydrated, take frequent breaks from computer work"
     );
-    q15->no_branch = createDiagnosisNode(tension);
+    setNoBranch(q15, createDiagnosisNode(kb, tension));
     
     
-    TreeNode* q16 = createNode(QUESTION_NODE, 
+    TreeNode* q16 = createNode(kb, QUESTION_NODE, 
         "Are you experiencing muscle or joint pain?");
-    q13->no_branch = q16;
+    setNoBranch(q13, q16);
+    
+    TreeNode* q17 = createNode(kb, QUESTION_NODE, 
+        "Is the pain related to a recent injury or overuse?");
+    setYesBranch(q16, q17);
+    
+    
+    Diagnosis* strain = createDiagnosis(kb,
+        "MUSCLE STRAIN OR SPRAIN",
+        MILD,
+        "Overstretched or torn muscles/ligaments from injury or overuse. Usually heals within 1-2 weeks with proper care.",
+        "RICE protocol: Rest (avoid painful activity), Ice (20 min every 2-3 hours for first 48-72 hours), Compression (elastic bandage), Elevation (above heart level). Gentle stretching after 48 hours",
+        "Pain: Ibuprofen 400-600mg every 6 hours (better than acetaminophen for inflammation) OR Naproxen 500mg twice daily with food. Topical: Voltaren Gel (diclofenac) apply to affected area 4 times daily. Ice packs first 48 hours, then heat therapy",
+        "If severe pain, inability to bear weight, significant swelling, numbness/tingling, or no improvement after 1 week",
+        "Proper warm-up before exercise, gradual increase in activity, proper technique, adequate rest between workouts, maintain flexibility and strength"
+    );
+    setYesBranch(q17, createDiagnosisNode(kb, strain));
+    
+    
+    Diagnosis* body_aches = createDiagnosis(kb,
+        "GENERAL BODY ACHES (MYALGIA)",
+        MILD,
+        "Widespread muscle aches without specific injury, often from stress, tension, or minor viral infections.",
+        "Gentle stretching, warm bath with Epsom salts (2 cups in bath), light massage, stay active with gentle movement, adequate sleep, stress management, stay hydrated (8-10 glasses water/day)",
+        "Ibuprofen 400mg every 6 hours OR Acetaminophen 500-1000mg every 6 hours. Topical: Icy Hot or Bengay cream for localized relief. Magnesium supplement 300-400mg daily may help muscle relaxation",
+        "If aches persist beyond 1 week, worsen, or accompanied by fever, rash, or other symptoms",
+        "Regular exercise, good sleep hygiene, stress management, proper posture, stay hydrated, balanced diet with adequate protein"
+    );
+    setNoBranch(q17, createDiagnosisNode(kb, body_aches));
+    
+    
+    TreeNode* q18 = createNode(kb, QUESTION_NODE, 
+        "Are you experiencing fatigue, weakness, or low energy?");
+    setNoBranch(q16, q18);
+    
+    
+    Diagnosis* fatigue = createDiagnosis(kb,
+        "GENERAL FATIGUE",
+        MILD,
+        "Persistent tiredness that doesn't improve with rest. Can be caused by stress, poor sleep, inadequate nutrition, or underlying conditions.",
+        "Prioritize 7-9 hours quality sleep, regular sleep schedule, limit caffeine after 2pm, exercise 30 min daily (even walking), eat balanced meals with protein, stay hydrated, reduce stress, limit screen time before bed, take short breaks throughout day",
+        "Address underlying causes first. Vitamin B-Complex supplement daily. Iron supplement if deficient (18mg daily for women, 8mg for men) - take with vitamin C for better absorption. Vitamin D3 2000 IU daily if deficient. Avoid energy drinks",
+        "If fatigue persists despite lifestyle changes, worsens, or accompanied by other symptoms (weight changes, depression, shortness of breath) - may need blood tests for anemia, thyroid, or vitamin deficiencies",
+        "Maintain consistent sleep schedule, balanced diet, regular exercise, stress management, limit alcohol, stay hydrated, take breaks from work"
+    );
+    setYesBranch(q18, createDiagnosisNode(kb, fatigue));
+    
+    
+    Diagnosis* general_wellness = createDiagnosis(kb,
+        "GENERAL WELLNESS CHECK",
+        MILD,
+        "You don't appear to have acute symptoms, but it's always good to maintain preventive health practices.",
+        "Maintain healthy lifestyle: balanced diet rich in fruits/vegetables, regular exercise (150 min/week), adequate sleep (7-9 hours), stress management, stay hydrated, practice good hygiene",
+        "Daily multivitamin can help fill nutritional gaps. Vitamin D3 2000 IU daily (especially if limited sun exposure). Omega-3 supplement for heart health",
+        "Annual physical exam, age-appropriate screening tests, dental checkups twice yearly, vision exam yearly, any concerns about preventive health",
+        "Healthy diet, regular exercise, adequate sleep, stress management, avoid smoking, limit alcohol, maintain social connections, regular health screenings"
+    );
+    setNoBranch(q18, createDiagnosisNode(kb, general_wellness));
+    
+    if (kb->nodes.failed || kb->payload.failed || kb->strings.failed) {
+        return NULL;
+    }
+    return root;
+}
+
+
+uint32_t hashCanonicalNode(const CanonicalNode* node) {
+    uint32_t words[7];
+    
+    if (node->diagnosis != NULL) {
+        memcpy(words, node->diagnosis, sizeof(words));
+    } else {
+        memset(words, 0, sizeof(words));
+        words[0] = node->text;
+        words[1] = node->child[0];
+        words[2] = node->child[1];
+    }
+    return hashString((const char*)words, sizeof(words));
+}
+
+
+uint32_t internCanonicalNode(CanonicalTable* table, CanonicalNode* node) {
+    if (table->count * 2 >= table->slot_count) {
+        uint32_t slot_count = table->slot_count > 0 ? table->slot_count * 2 : 1024;
+        uint32_t* slots = (uint32_t*)trackedMalloc(slot_count * sizeof(uint32_t));
+        if (slots == NULL) {
+            return FLAT_LEAF;
+        }
+        memset(slots, 0, slot_count * sizeof(uint32_t));
+        for (uint32_t i = 0; i < table->count; i++) {
+            uint32_t slot = table->nodes[i].hash & (slot_count - 1);
+            while (slots[slot] != 0) {
+                slot = (slot + 1) & (slot_count - 1);
+            }
+            slots[slot] = i + 1;
+        }
+        free(table->slots);
+        table->slots = slots;
+        table->slot_count = slot_count;
+    }
+    
+    node->hash = hashCanonicalNode(node);
+    uint32_t slot = node->hash & (table->slot_count - 1);
+    while (table->slots[slot] != 0) {
+        const CanonicalNode* other = &table->nodes[table->slots[slot] - 1];
+        if (other->hash == node->hash && other->text == node->text
+            && other->child[0] == node->child[0] && other->child[1] == node->child[1]
+            && (other->diagnosis == node->diagnosis
+                || (other->diagnosis != NULL && node->diagnosis != NULL
+                    && memcmp(other->diagnosis, node->diagnosis, sizeof(Diagnosis)) == 0))) {
+            return table->slots[slot] - 1;
+        }
+        slot = (slot + 1) & (table->slot_count - 1);
+    }
+    
+    if (table->count == table->capacity) {
+        uint32_t capacity = table->capacity > 0 ? table->capacity * 2 : 256;
+        CanonicalNode* nodes = (CanonicalNode*)realloc(table->nodes, capacity * sizeof(CanonicalNode));
+        if (nodes == NULL) {
+            return FLAT_LEAF;
+        }
+        table->nodes = nodes;
+        table->capacity = capacity;
+    }
+    table->nodes[table->count] = *node;
+    table->slots[slot] = table->count + 1;
+    return table->count++;
+}
+
+
+void releaseCanonicalTable(CanonicalTable* table) {
+    free(table->nodes);
+    free(table->slots);
+    memset(table, 0, sizeof(CanonicalTable));
+}
+
+
+uint32_t canonicalizeTree(TreeNode* root, CanonicalTable* table) {
+    size_t capacity = 256;
+    size_t sp = 0;
+    TreeNode** stack = (TreeNode**)trackedMalloc(capacity * sizeof(TreeNode*));
+    
+    if (root == NULL || stack == NULL) {
+        free(stack);
+        return FLAT_LEAF;
+    }
+    
+    stack[sp++] = root;
+    while (sp > 0) {
+        TreeNode* node = stack[sp - 1];
+        CanonicalNode key;
+        
+        if (node->canonical != FLAT_LEAF) {
+            sp--;
+            continue;
+        }
+        memset(&key, 0, sizeof(key));
+        if (node->type == DIAGNOSIS_NODE) {
+            if (node->diagnosis == NULL) {
+                break;
+            }
+            key.text = FLAT_LEAF;
+            key.child[0] = FLAT_LEAF;
+            key.child[1] = FLAT_LEAF;
+            key.diagnosis = node->diagnosis;
+        } else if (node->yes_branch == NULL || node->no_branch == NULL) {
+            break;
+        } else if (node->yes_branch->canonical == FLAT_LEAF || node->no_branch->canonical == FLAT_LEAF) {
+            if (sp + 2 > capacity) {
+                TreeNode** larger = (TreeNode**)realloc(stack, capacity * 2 * sizeof(TreeNode*));
+                if (larger == NULL) {
+                    break;
+                }
+                stack = larger;
+                capacity *= 2;
+            }
+            stack[sp++] = node->no_branch;
+            stack[sp++] = node->yes_branch;
+            continue;
+        } else {
+            key.text = node->text;
+            key.child[0] = node->no_branch->canonical;
+            key.child[1] = node->yes_branch->canonical;
+        }
+        
+        node->canonical = internCanonicalNode(table, &key);
+        if (node->canonical == FLAT_LEAF) {
+            break;
+        }
+        sp--;
+    }
+    
+    free(stack);
+    return root->canonical;
+}
+
+
+int compileKnowledgeBase(KnowledgeBase* kb) {
+    CanonicalTable table;
+    uint32_t total, slot_count, head, tail, sp, root;
+    uint32_t* order = NULL;
+    uint32_t* position = NULL;
+    uint32_t* keys = NULL;
+    uint32_t* values = NULL;
+    FlatNode* nodes;
+    Diagnosis* diagnoses;
+    uint32_t leaves = 0;
+    int compiled = 0;
+    
+    memset(&table, 0, sizeof(table));
+    root = canonicalizeTree(kb->root, &table);
+    if (root == FLAT_LEAF) {
+        releaseCanonicalTable(&table);
+        return 0;
+    }
+    
+    total = table.count;
+    slot_count = 16;
+    while (slot_count < (total + kb->question_order_count) * 2) {
+        slot_count *= 2;
+    }
+    for (uint32_t i = 0; i < total; i++) {
+        leaves += table.nodes[i].diagnosis != NULL;
+    }
+    
+    nodes = (FlatNode*)arenaAlloc(&kb->compiled, total * sizeof(FlatNode));
+    diagnoses = (Diagnosis*)arenaAlloc(&kb->compiled, (leaves > 0 ? leaves : 1) * sizeof(Diagnosis));
+    order = (uint32_t*)trackedMalloc((2 * (size_t)total + 1) * sizeof(uint32_t));
+    position = (uint32_t*)trackedMalloc(total * sizeof(uint32_t));
+    keys = (uint32_t*)trackedMalloc(slot_count * sizeof(uint32_t));
+    values = (uint32_t*)trackedMalloc(slot_count * sizeof(uint32_t));
+    if (nodes == NULL || diagnoses == NULL || order == NULL || position == NULL || keys == NULL || values == NULL) {
+        goto done;
+    }
+    memset(keys, 0, slot_count * sizeof(uint32_t));
+    memset(position, 0, total * sizeof(uint32_t));
+    
+    
+    kb->question_count = 0;
+    for (uint32_t i = 0; i < kb->question_order_count; i++) {
+        uint32_t slot = kb->question_order[i] & (slot_count - 1);
+        while (keys[slot] != 0 && keys[slot] != kb->question_order[i] + 1) {
+            slot = (slot + 1) & (slot_count - 1);
+        }
+        if (keys[slot] == 0) {
+            keys[slot] = kb->question_order[i] + 1;
+            values[slot] = kb->question_count++;
+        }
+    }
+    sp = 0;
+    order[sp++] = root;
+    while (sp > 0) {
+        uint32_t id = order[--sp];
+        const CanonicalNode* node = &table.nodes[id];
+        if (node->diagnosis != NULL || position[id] != 0) {
+            continue;
+        }
+        position[id] = 1;
+        
+        uint32_t slot = node->text & (slot_count - 1);
+        while (keys[slot] != 0 && keys[slot] != node->text + 1) {
+            slot = (slot + 1) & (slot_count - 1);
+        }
+        if (keys[slot] == 0) {
+            keys[slot] = node->text + 1;
+            values[slot] = kb->question_count++;
+        }
+        
+        order[sp++] = node->child[0];
+        order[sp++] = node->child[1];
+    }
+    
+    
+    memset(position, 0, total * sizeof(uint32_t));
+    for (uint32_t i = 0; i < total; i++) {
+        if (table.nodes[i].diagnosis == NULL) {
+            position[table.nodes[i].child[1]]++;
+            position[table.nodes[i].child[0]]++;
+        }
+    }
+    head = 0;
+    tail = 0;
+    order[tail++] = root;
+    while (head < tail) {
+        const CanonicalNode* node = &table.nodes[order[head++]];
+        for (int bit = 1; bit >= 0 && node->diagnosis == NULL; bit--) {
+            if (--position[node->child[bit]] == 0) {
+                order[tail++] = node->child[bit];
+            }
+        }
+    }
+    for (uint32_t i = 0; i < tail; i++) {
+        position[order[i]] = i;
+    }
+    
+    
+    kb->diagnosis_count = 0;
+    for (uint32_t i = 0; i < tail; i++) {
+        const CanonicalNode* node = &table.nodes[order[i]];
+        FlatNode* flat = &nodes[i];
+        
+        if (node->diagnosis != NULL) {
+            flat->child[0] = FLAT_LEAF;
+            flat->child[1] = FLAT_LEAF;
+            flat->payload = kb->diagnosis_count;
+            flat->question = FLAT_LEAF;
+            diagnoses[kb->diagnosis_count++] = *node->diagnosis;
+        } else {
+            uint32_t slot = node->text & (slot_count - 1);
+            while (keys[slot] != node->text + 1) {
+                slot = (slot + 1) & (slot_count - 1);
+            }
+            flat->payload = node->text;
+            flat->question = values[slot];
+            flat->child[0] = position[node->child[0]];
+            flat->child[1] = position[node->child[1]];
+        }
+    }
+    kb->node_count = tail;
+    kb->flat = nodes;
+    kb->diagnoses = diagnoses;
+    compiled = 1;
+    
+done:
+    free(order);
+    free(position);
+    free(keys);
+    free(values);
+    releaseCanonicalTable(&table);
+    return compiled;
+}
+
+
+void initKnowledgeBase(KnowledgeBase* kb) {
+    arenaInit(&kb->nodes);
+    arenaInit(&kb->payload);
+    arenaInit(&kb->compiled);
+    memset(&kb->strings, 0, sizeof(kb->strings));
+    kb->root = NULL;
+    kb->flat = NULL;
+    kb->diagnoses = NULL;
+    kb->node_count = 0;
+    kb->question_count = 0;
+    kb->diagnosis_count = 0;
+    kb->max_depth = 0;
+    kb->expected_depth = 0.0;
+    kb->version = 0;
+    kb->generated = 0;
+    kb->mapping = NULL;
+    kb->mapping_size = 0;
+    kb->lookup = NULL;
+    kb->lookup_bits = 0;
+    for (int format = 0; format < RENDER_FORMATS; format++) {
+        kb->rendered[format] = NULL;
+        kb->rendered_spans[format] = NULL;
+    }
+    kb->rendered_bytes = 0;
+    kb->metrics = NULL;
+    kb->metric_shards = 0;
+    memset(&kb->search, 0, sizeof(kb->search));
+    kb->question_order = NULL;
+    kb->question_order_count = 0;
+}
+
+
+KnowledgeBase* beginKnowledgeBase() {
+    KnowledgeBase* kb = (KnowledgeBase*)trackedMalloc(sizeof(KnowledgeBase));
+    if (kb == NULL) {
+        printf("\033[31mMemory allocation failed!\033[0m\n");
+        return NULL;
+    }
+    
+    initKnowledgeBase(kb);
+    if (!poolInit(&kb->strings)) {
+        printf("\033[31mMemory allocation failed!\033[0m\n");
+        releaseKnowledgeBase(kb);
+        return NULL;
+    }
+    return kb;
+}
+
+
+int finishKnowledgeBase(KnowledgeBase* kb) {
+    if (kb->root == NULL || !compileKnowledgeBase(kb) || !computeKnowledgeBaseMetadata(kb)) {
+        printf("\033[31mFailed to compile the symptom tree!\033[0m\n");
+        return 0;
+    }
+    
+    arenaRelease(&kb->nodes);
+    arenaRelease(&kb->payload);
+    kb->root = NULL;
+    kb->version = contentChecksum(kb);
+    kb->generated = matchesGeneratedCode(kb);
+    
+    return 1;
+}
+
+
+KnowledgeBase* interpretKnowledgeBase() {
+    KnowledgeBase* kb = beginKnowledgeBase();
+    if (kb == NULL) {
+        return NULL;
+    }
+    
+    kb->root = buildSymptomTree(kb);
+    if (kb->root == NULL) {
+        printf("\033[31mMemory allocation failed while building the symptom tree!\033[0m\n");
+        releaseKnowledgeBase(kb);
+        return NULL;
+    }
+    
+    if (!finishKnowledgeBase(kb)) {
+        releaseKnowledgeBase(kb);
+        return NULL;
+    }
+    
+    return kb;
+}
+
+
+#ifdef HEALTH_CHECKER_GENERATED
+KnowledgeBase* createKnowledgeBase() {
+    KnowledgeBase* kb = (KnowledgeBase*)trackedMalloc(sizeof(KnowledgeBase));
+    if (kb == NULL) {
+        printf("\033[31mMemory allocation failed!\033[0m\n");
+        return NULL;
+    }
+    
+    initKnowledgeBase(kb);
+    kb->flat = g_generated_flat;
+    kb->diagnoses = g_generated_diagnoses;
+    kb->strings.data = (char*)g_generated_strings;
+    kb->strings.used = GENERATED_STRING_BYTES;
+    kb->node_count = GENERATED_NODE_COUNT;
+    kb->question_count = GENERATED_QUESTION_COUNT;
+    kb->diagnosis_count = GENERATED_DIAGNOSIS_COUNT;
+    kb->max_depth = GENERATED_MAX_DEPTH;
+    kb->expected_depth = GENERATED_EXPECTED_DEPTH;
+    kb->version = GENERATED_VERSION;
+    kb->generated = 1;
+    
+    return kb;
+}
+#else
+KnowledgeBase* createKnowledgeBase() {
+    return interpretKnowledgeBase();
+}
+#endif
+
+
+void releaseKnowledgeBase(KnowledgeBase* kb) {
+    if (kb == NULL) {
+        return;
+    }
+    
+    arenaRelease(&kb->nodes);
+    arenaRelease(&kb->payload);
+    arenaRelease(&kb->compiled);
+    if (kb->mapping != NULL) {
+        unmapFile(kb->mapping, kb->mapping_size);
+    }
+    if (kb->strings.capacity == 0) {
+        kb->strings.data = NULL;
+    }
+    poolRelease(&kb->strings);
+    free(kb->lookup);
+    for (int format = 0; format < RENDER_FORMATS; format++) {
+        free(kb->rendered[format]);
+        free(kb->rendered_spans[format]);
+    }
+    releaseMetrics(kb);
+    releaseSearchIndex(kb);
+    free(kb);
+}
+
+
+void startSession(Session* session, const KnowledgeBase* kb) {
+    session->kb = kb;
+    session->node = 0;
+    session->questions_asked = 0;
+    session->started_ms = wallClockMs();
+}
+
+
+int sessionFinished(const Session* session) {
+    return session->kb->flat[session->node].question == FLAT_LEAF;
+}
+
+
+const char* sessionQuestion(const Session* session) {
+    const FlatNode* node = &session->kb->flat[session->node];
+    if (node->question == FLAT_LEAF) {
+        return "";
+    }
+    return kbText(session->kb, node->payload);
+}
+
+
+void sessionAnswer(Session* session, char response) {
+    if (sessionFinished(session)) {
+        return;
+    }
+    
+    if (session->questions_asked < TOKEN_MAX_ANSWERS) {
+        uint8_t mask = (uint8_t)(1u << (session->questions_asked & 7));
+        uint8_t* byte = &session->answers[session->questions_asked >> 3];
+        *byte = response == 'Y' ? (uint8_t)(*byte | mask) : (uint8_t)(*byte & ~mask);
+    }
+    session->questions_asked++;
+    session->node = session->kb->flat[session->node].child[response == 'Y'];
+}
+
+
+const Diagnosis* sessionDiagnosis(const Session* session) {
+    const FlatNode* node = &session->kb->flat[session->node];
+    if (node->question != FLAT_LEAF) {
+        return NULL;
+    }
+    return &session->kb->diagnoses[node->payload];
+}
+
+
+int enableMetrics(KnowledgeBase* kb, int shards) {
+    size_t per_shard = (size_t)kb->node_count * 4 + kb->diagnosis_count;
+    
+    kb->metrics = (MetricsShard*)trackedMalloc((size_t)shards * sizeof(MetricsShard));
+    if (kb->metrics == NULL) {
+        return 0;
+    }
+    memset(kb->metrics, 0, (size_t)shards * sizeof(MetricsShard));
+    kb->metric_shards = shards;
+    for (int i = 0; i < shards; i++) {
+        MetricsShard* shard = &kb->metrics[i];
+        shard->visits = (uint64_t*)trackedMalloc(per_shard * sizeof(uint64_t));
+        if (shard->visits == NULL) {
+            releaseMetrics(kb);
+            return 0;
+        }
+        memset(shard->visits, 0, per_shard * sizeof(uint64_t));
+        shard->answers[0] = shard->visits + kb->node_count;
+        shard->answers[1] = shard->answers[0] + kb->node_count;
+        shard->latency_ns = shard->answers[1] + kb->node_count;
+        shard->hits = shard->latency_ns + kb->node_count;
+    }
+    return 1;
+}
+
+
+void releaseMetrics(KnowledgeBase* kb) {
+    for (int i = 0; i < kb->metric_shards; i++) {
+        free(kb->metrics[i].visits);
+    }
+    free(kb->metrics);
+    kb->metrics = NULL;
+    kb->metric_shards = 0;
+}
+
+
+void recordVisit(const KnowledgeBase* kb, int shard, uint32_t node) {
+    if (kb->metrics == NULL) {
+        return;
+    }
+    MetricsShard* metrics = &kb->metrics[shard];
+    METRIC_ADD(metrics->visits[node], 1);
+    if (kb->flat[node].question == FLAT_LEAF) {
+        METRIC_ADD(metrics->hits[kb->flat[node].payload], 1);
+    }
+}
+
+
+void recordAnswer(const KnowledgeBase* kb, int shard, uint32_t node, char response, double latency_ms) {
+    if (kb->metrics == NULL) {
+        return;
+    }
+    MetricsShard* metrics = &kb->metrics[shard];
+    uint64_t latency_ns = latency_ms > 0.0 ? (uint64_t)(latency_ms * 1e6) : 0;
+    uint64_t bound = 1000;
+    
+    METRIC_ADD(metrics->answers[response == 'Y'][node], 1);
+    METRIC_ADD(metrics->latency_ns[node], latency_ns);
+    for (int bucket = 0; bucket < METRICS_LATENCY_BUCKETS; bucket++, bound *= 4) {
+        if (latency_ns <= bound) {
+            METRIC_ADD(metrics->latency_buckets[bucket], 1);
+            break;
+        }
+    }
+    METRIC_ADD(metrics->latency_count, 1);
+    METRIC_ADD(metrics->latency_sum_ns, latency_ns);
+}
+
+
+static int mergeMetrics(const KnowledgeBase* kb, MetricsShard* merged) {
+    size_t per_shard = (size_t)kb->node_count * 4 + kb->diagnosis_count;
+    
+    memset(merged, 0, sizeof(MetricsShard));
+    merged->visits = (uint64_t*)trackedMalloc(per_shard * sizeof(uint64_t));
+    if (merged->visits == NULL) {
+        return 0;
+    }
+    memset(merged->visits, 0, per_shard * sizeof(uint64_t));
+    merged->answers[0] = merged->visits + kb->node_count;
+    merged->answers[1] = merged->answers[0] + kb->node_count;
+    merged->latency_ns = merged->answers[1] + kb->node_count;
+    merged->hits = merged->latency_ns + kb->node_count;
+    
+    for (int i = 0; i < kb->metric_shards; i++) {
+        const MetricsShard* shard = &kb->metrics[i];
+        for (size_t j = 0; j < per_shard; j++) {
+            merged->visits[j] += METRIC_READ(shard->visits[j]);
+        }
+        for (int bucket = 0; bucket < METRICS_LATENCY_BUCKETS; bucket++) {
+            merged->latency_buckets[bucket] += METRIC_READ(shard->latency_buckets[bucket]);
+        }
+        merged->latency_count += METRIC_READ(shard->latency_count);
+        merged->latency_sum_ns += METRIC_READ(shard->latency_sum_ns);
+    }
+    return 1;
+}
+
+
+int inheritMetrics(KnowledgeBase* kb, const KnowledgeBase* previous) {
+    MetricsShard merged;
+    MetricsShard* shard = &kb->metrics[0];
+    size_t per_shard = (size_t)kb->node_count * 4 + kb->diagnosis_count;
+    
+    if (kb->metrics == NULL || previous->metrics == NULL || kb->version != previous->version
+        || kb->node_count != previous->node_count || !mergeMetrics(previous, &merged)) {
+        return 0;
+    }
+    for (size_t j = 0; j < per_shard; j++) {
+        METRIC_ADD(shard->visits[j], merged.visits[j]);
+    }
+    for (int bucket = 0; bucket < METRICS_LATENCY_BUCKETS; bucket++) {
+        METRIC_ADD(shard->latency_buckets[bucket], merged.latency_buckets[bucket]);
+    }
+    METRIC_ADD(shard->latency_count, merged.latency_count);
+    METRIC_ADD(shard->latency_sum_ns, merged.latency_sum_ns);
+    free(merged.visits);
+    return 1;
+}
+
+
+static void appendMetricLabel(TextBuffer* out, const char* name, const char* value) {
+    textAppendString(out, ",");
+    textAppendString(out, name);
+    textAppendString(out, "=\"");
+    for (const char* c = value; *c != '\0'; c++) {
+        if (*c == '\\' || *c == '"') {
+            textAppend(out, "\\", 1);
+            textAppend(out, c, 1);
+        } else if (*c == '\n') {
+            textAppendString(out, "\\n");
+        } else {
+            textAppend(out, c, 1);
+        }
+    }
+    textAppendString(out, "\"");
+}
+
+
+static void appendMetricFamily(TextBuffer* out, const char* name, const char* type, const char* help) {
+    textAppendString(out, "# HELP ");
+    textAppendString(out, name);
+    textAppendString(out, " ");
+    textAppendString(out, help);
+    textAppendString(out, "\n# TYPE ");
+    textAppendString(out, name);
+    textAppendString(out, " ");
+    textAppendString(out, type);
+    textAppendString(out, "\n");
+}
+
+
+static void appendMetricStart(TextBuffer* out, const char* name, const KnowledgeBase* kb) {
+    char text[64];
+    snprintf(text, sizeof(text), "%s{kb=\"%08x\"", name, kb->version);
+    textAppendString(out, text);
+}
+
+
+static void appendMetricValue(TextBuffer* out, double value) {
+    char text[64];
+    snprintf(text, sizeof(text), "} %.10g\n", value);
+    textAppendString(out, text);
+}
+
+
+static void appendNodeLabels(TextBuffer* out, const KnowledgeBase* kb, uint32_t node) {
+    char text[64];
+    snprintf(text, sizeof(text), ",node=\"%u\",question_id=\"%u\"", node, kb->flat[node].question);
+    textAppendString(out, text);
+    appendMetricLabel(out, "question", kbText(kb, kb->flat[node].payload));
+}
+
+
+void exportMetrics(const KnowledgeBase* const* kbs, int count, TextBuffer* out) {
+    MetricsShard merged[KB_MAX_VERSIONS];
+    char text[64];
+    
+    if (count > KB_MAX_VERSIONS) {
+        count = KB_MAX_VERSIONS;
+    }
+    for (int i = 0; i < count; i++) {
+        if (kbs[i]->metrics == NULL || !mergeMetrics(kbs[i], &merged[i])) {
+            merged[i].visits = NULL;
+        }
+    }
+    
+    appendMetricFamily(out, "health_checker_node_visits_total", "counter",
+                       "Sessions that reached a question node.");
+    for (int i = 0; i < count; i++) {
+        for (uint32_t node = 0; merged[i].visits != NULL && node < kbs[i]->node_count; node++) {
+            if (kbs[i]->flat[node].question != FLAT_LEAF && merged[i].visits[node] > 0) {
+                appendMetricStart(out, "health_checker_node_visits_total", kbs[i]);
+                appendNodeLabels(out, kbs[i], node);
+                appendMetricValue(out, (double)merged[i].visits[node]);
+            }
+        }
+    }
+    
+    appendMetricFamily(out, "health_checker_node_answers_total", "counter",
+                       "Answers given at a question node.");
+    for (int i = 0; i < count; i++) {
+        for (uint32_t node = 0; merged[i].visits != NULL && node < kbs[i]->node_count; node++) {
+            for (int bit = 1; bit >= 0; bit--) {
+                if (merged[i].answers[bit][node] > 0) {
+                    appendMetricStart(out, "health_checker_node_answers_total", kbs[i]);
+                    snprintf(text, sizeof(text), ",node=\"%u\",answer=\"%s\"", node, bit ? "yes" : "no");
+                    textAppendString(out, text);
+                    appendMetricValue(out, (double)merged[i].answers[bit][node]);
+                }
+            }
+        }
+    }
+    
+    appendMetricFamily(out, "health_checker_node_stops_total", "counter",
+                       "Sessions that reached a question node and never answered it.");
+    for (int i = 0; i < count; i++) {
+        for (uint32_t node = 0; merged[i].visits != NULL && node < kbs[i]->node_count; node++) {
+            uint64_t answered = merged[i].answers[0][node] + merged[i].answers[1][node];
+            if (kbs[i]->flat[node].question != FLAT_LEAF && merged[i].visits[node] > answered) {
+                appendMetricStart(out, "health_checker_node_stops_total", kbs[i]);
+                snprintf(text, sizeof(text), ",node=\"%u\"", node);
+                textAppendString(out, text);
+                appendMetricValue(out, (double)(merged[i].visits[node] - answered));
+            }
+        }
+    }
+    
+    appendMetricFamily(out, "health_checker_node_answer_seconds_total", "counter",
+                       "Time spent answering a question node (divide by answers for the mean).");
+    for (int i = 0; i < count; i++) {
+        for (uint32_t node = 0; merged[i].visits != NULL && node < kbs[i]->node_count; node++) {
+            if (merged[i].answers[0][node] + merged[i].answers[1][node] > 0) {
+                appendMetricStart(out, "health_checker_node_answer_seconds_total", kbs[i]);
+                snprintf(text, sizeof(text), ",node=\"%u\"", node);
+                textAppendString(out, text);
+                appendMetricValue(out, merged[i].latency_ns[node] / 1e9);
+            }
+        }
+    }
+    
+    appendMetricFamily(out, "health_checker_diagnosis_hits_total", "counter",
+                       "Sessions that ended in a diagnosis.");
+    for (int i = 0; i < count; i++) {
+        for (uint32_t diag = 0; merged[i].visits != NULL && diag < kbs[i]->diagnosis_count; diag++) {
+            if (merged[i].hits[diag] > 0) {
+                appendMetricStart(out, "health_checker_diagnosis_hits_total", kbs[i]);
+                snprintf(text, sizeof(text), ",diagnosis=\"%u\"", diag);
+                textAppendString(out, text);
+                appendMetricLabel(out, "severity", severityName(kbs[i]->diagnoses[diag].severity));
+                appendMetricLabel(out, "condition", kbText(kbs[i], kbs[i]->diagnoses[diag].condition));
+                appendMetricValue(out, (double)merged[i].hits[diag]);
+            }
+        }
+    }
+    
+    appendMetricFamily(out, "health_checker_severity_total", "counter",
+                       "Sessions that ended in a diagnosis, by severity.");
+    for (int i = 0; i < count; i++) {
+        uint64_t severities[MILD + 1] = { 0 };
+        for (uint32_t diag = 0; merged[i].visits != NULL && diag < kbs[i]->diagnosis_count; diag++) {
+            severities[kbs[i]->diagnoses[diag].severity] += merged[i].hits[diag];
+        }
+        for (int severity = EMERGENCY; merged[i].visits != NULL && severity <= MILD; severity++) {
+            appendMetricStart(out, "health_checker_severity_total", kbs[i]);
+            appendMetricLabel(out, "severity", severityName((Severity)severity));
+            appendMetricValue(out, (double)severities[severity]);
+        }
+    }
+    
+    appendMetricFamily(out, "health_checker_answer_latency_seconds", "histogram",
+                       "Time from showing a question to applying its answer.");
+    for (int i = 0; i < count; i++) {
+        uint64_t cumulative = 0;
+        uint64_t bound = 1000;
+        for (int bucket = 0; merged[i].visits != NULL && bucket < METRICS_LATENCY_BUCKETS; bucket++, bound *= 4) {
+            cumulative += merged[i].latency_buckets[bucket];
+            appendMetricStart(out, "health_checker_answer_latency_seconds_bucket", kbs[i]);
+            snprintf(text, sizeof(text), ",le=\"%.10g\"", bound / 1e9);
+            textAppendString(out, text);
+            appendMetricValue(out, (double)cumulative);
+        }
+        if (merged[i].visits != NULL) {
+            appendMetricStart(out, "health_checker_answer_latency_seconds_bucket", kbs[i]);
+            textAppendString(out, ",le=\"+Inf\"");
+            appendMetricValue(out, (double)merged[i].latency_count);
+            appendMetricStart(out, "health_checker_answer_latency_seconds_sum", kbs[i]);
+            appendMetricValue(out, merged[i].latency_sum_ns / 1e9);
+            appendMetricStart(out, "health_checker_answer_latency_seconds_count", kbs[i]);
+            appendMetricValue(out, (double)merged[i].latency_count);
+        }
+    }
+    
+    for (int i = 0; i < count; i++) {
+        free(merged[i].visits);
+    }
+}
+
+
+int writeMetricsFile(const KnowledgeBase* kb, const char* path) {
+    TextBuffer out = { NULL, 0, 0, 0 };
+    char temporary[1024];
+    FILE* file;
+    int ok;
+    
+    exportMetrics(&kb, 1, &out);
+    snprintf(temporary, sizeof(temporary), "%s.tmp", path);
+    file = fopen(temporary, "wb");
+    if (file == NULL || out.failed) {
+        if (file != NULL) {
+            fclose(file);
+        }
+        free(out.data);
+        return 0;
+    }
+    ok = fwrite(out.data, 1, out.used, file) == out.used;
+    ok = fclose(file) == 0 && ok;
+    free(out.data);
+    if (ok) {
+#ifdef _WIN32
+        remove(path);
+#endif
+        ok = rename(temporary, path) == 0;
+    }
+    return ok;
+}
+
+#define SIP_ROTATE(x, b) (((x) << (b)) | ((x) >> (64 - (b))))
+#define SIP_ROUND(v0, v1, v2, v3) do { \
+    v0 += v1; v1 = SIP_ROTATE(v1, 13); v1 ^= v0; v0 = SIP_ROTATE(v0, 32); \
+    v2 += v3; v3 = SIP_ROTATE(v3, 16); v3 ^= v2; \
+    v0 += v3; v3 = SIP_ROTATE(v3, 21); v3 ^= v0; \
+    v2 += v1; v1 = SIP_ROTATE(v1, 17); v1 ^= v2; v2 = SIP_ROTATE(v2, 32); \
+} while (0)
+
+
+uint64_t sipHash24(const uint8_t key[16], const uint8_t* data, size_t length) {
+    uint64_t k0, k1, word;
+    uint64_t tail = (uint64_t)length << 56;
+    size_t whole = length & ~(size_t)7;
+    
+    memcpy(&k0, key, 8);
+    memcpy(&k1, key + 8, 8);
+    uint64_t v0 = k0 ^ 0x736f6d6570736575ull;
+    uint64_t v1 = k1 ^ 0x646f72616e646f6dull;
+    uint64_t v2 = k0 ^ 0x6c7967656e657261ull;
+    uint64_t v3 = k1 ^ 0x7465646279746573ull;
+    
+    for (size_t i = 0; i < whole; i += 8) {
+        memcpy(&word, data + i, 8);
+        v3 ^= word;
+        SIP_ROUND(v0, v1, v2, v3);
+        SIP_ROUND(v0, v1, v2, v3);
+        v0 ^= word;
+    }
+    for (size_t i = whole; i < length; i++) {
+        tail |= (uint64_t)data[i] << (8 * (i - whole));
+    }
+    v3 ^= tail;
+    SIP_ROUND(v0, v1, v2, v3);
+    SIP_ROUND(v0, v1, v2, v3);
+    v0 ^= tail;
+    
+    v2 ^= 0xff;
+    for (int i = 0; i < 4; i++) {
+        SIP_ROUND(v0, v1, v2, v3);
+    }
+    return v0 ^ v1 ^ v2 ^ v3;
+}
+
+
+int constantTimeEqual(const void* a, const void* b, size_t length) {
+    const uint8_t* left = (const uint8_t*)a;
+    const uint8_t* right = (const uint8_t*)b;
+    uint8_t difference = 0;
+    
+    for (size_t i = 0; i < length; i++) {
+        difference |= left[i] ^ right[i];
+    }
+    return difference == 0;
+}
+
+int loadTokenKey() {
+    const char* hex = getenv("HEALTH_CHECKER_TOKEN_KEY");
+    
+    if (hex != NULL && strlen(hex) == 32) {
+        int valid = 1;
+        for (int i = 0; i < 16 && valid; i++) {
+            char pair[3] = { hex[i * 2], hex[i * 2 + 1], '\0' };
+            valid = isxdigit((unsigned char)pair[0]) && isxdigit((unsigned char)pair[1]);
+            g_token_key[i] = (uint8_t)strtoul(pair, NULL, 16);
+        }
+        if (valid) {
+            return 1;
+        }
+    }
+    
+    FILE* random_source = fopen("/dev/urandom", "rb");
+    int ok = random_source != NULL && fread(g_token_key, 1, sizeof(g_token_key), random_source) == sizeof(g_token_key);
+    if (random_source != NULL) {
+        fclose(random_source);
+    }
+    if (!ok) {
+        memset(g_token_key, 0, sizeof(g_token_key));
+        return -1;
+    }
+    return 0;
+}
+
+
+size_t encodeSessionToken(const Session* session, char* out) {
+    static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+    uint8_t raw[TOKEN_MAX_BYTES];
+    uint32_t version = session->kb->version;
+    uint16_t asked = (uint16_t)session->questions_asked;
+    size_t answer_bytes = (session->questions_asked + 7) / 8;
+    size_t length = 18 + answer_bytes;
+    size_t written = 0;
+    
+    if (session->questions_asked > TOKEN_MAX_ANSWERS) {
+        return 0;
+    }
+    memcpy(raw, &version, 4);
+    memcpy(raw + 4, &session->node, 4);
+    memcpy(raw + 8, &asked, 2);
+    memcpy(raw + 10, &session->started_ms, 8);
+    memcpy(raw + 18, session->answers, answer_bytes);
+    if (session->questions_asked & 7) {
+        raw[length - 1] &= (uint8_t)((1u << (session->questions_asked & 7)) - 1);
+    }
+    uint64_t mac = sipHash24(g_token_key, raw, length);
+    memcpy(raw + length, &mac, 8);
+    length += 8;
+    
+    for (size_t i = 0; i < length; i += 3) {
+        uint32_t group = (uint32_t)raw[i] << 16;
+        int chars = 2;
+        if (i + 1 < length) {
+            group |= (uint32_t)raw[i + 1] << 8;
+            chars = 3;
+        }
+        if (i + 2 < length) {
+            group |= raw[i + 2];
+            chars = 4;
+        }
+        for (int c = 0; c < chars; c++) {
+            out[written++] = alphabet[(group >> (18 - 6 * c)) & 63];
+        }
+    }
+    out[written] = '\0';
+    return written;
+}
+
+
+TokenStatus decodeSessionToken(const KnowledgeBase* kb, const char* text, size_t length, Session* session) {
+    uint8_t raw[TOKEN_MAX_BYTES];
+    size_t raw_length = 0;
+    uint32_t group = 0;
+    int bits = 0;
+    
+    if (length > TOKEN_MAX_TEXT) {
+        return TOKEN_MALFORMED;
+    }
+    for (size_t i = 0; i < length; i++) {
+        char c = text[i];
+        int value;
+        if (c >= 'A' && c <= 'Z') value = c - 'A';
+        else if (c >= 'a' && c <= 'z') value = c - 'a' + 26;
+        else if (c >= '0' && c <= '9') value = c - '0' + 52;
+        else if (c == '-') value = 62;
+        else if (c == '_') value = 63;
+        else return TOKEN_MALFORMED;
+        
+        group = (group << 6) | (uint32_t)value;
+        bits += 6;
+        if (bits >= 8) {
+            bits -= 8;
+            if (raw_length == sizeof(raw)) {
+                return TOKEN_MALFORMED;
+            }
+            raw[raw_length++] = (uint8_t)(group >> bits);
+        }
+    }
+    
+    uint32_t version, node;
+    uint16_t asked;
+    uint64_t started, mac;
+    if (bits >= 6 || (group & ((1u << bits) - 1)) != 0 || raw_length < 26) {
+        return TOKEN_MALFORMED;
+    }
+    memcpy(&version, raw, 4);
+    memcpy(&node, raw + 4, 4);
+    memcpy(&asked, raw + 8, 2);
+    memcpy(&started, raw + 10, 8);
+    if (asked > TOKEN_MAX_ANSWERS || raw_length != 26 + (size_t)(asked + 7) / 8) {
+        return TOKEN_MALFORMED;
+    }
+    mac = sipHash24(g_token_key, raw, raw_length - 8);
+    if (!constantTimeEqual(&mac, raw + raw_length - 8, 8)) {
+        return TOKEN_FORGED;
+    }
+    if (version != kb->version) {
+        return TOKEN_STALE;
+    }
+    
+    startSession(session, kb);
+    for (int i = 0; i < asked; i++) {
+        if (sessionFinished(session)) {
+            return TOKEN_MALFORMED;
+        }
+        sessionAnswer(session, (raw[18 + i / 8] >> (i & 7)) & 1 ? 'Y' : 'N');
+    }
+    session->started_ms = started;
+    return session->node == node ? TOKEN_VALID : TOKEN_MALFORMED;
+}
+
+
+const char* tokenStatusMessage(TokenStatus status) {
+    switch (status) {
+        case TOKEN_VALID:     return "valid";
+        case TOKEN_MALFORMED: return "malformed session token";
+        case TOKEN_FORGED:    return "session token failed verification";
+        case TOKEN_STALE:     return "session token belongs to another knowledge base version";
+        default:              return "invalid session token";
+    }
+}
+
+
+int parseJournalFileName(const char* name, uint32_t* sequence) {
+    unsigned long value = 0;
+    
+    if (strncmp(name, "journal-", 8) != 0 || strlen(name) != 18 || strcmp(name + 14, ".hcj") != 0) {
+        return 0;
+    }
+    for (int i = 8; i < 14; i++) {
+        if (!isdigit((unsigned char)name[i])) {
+            return 0;
+        }
+        value = value * 10 + (unsigned long)(name[i] - '0');
+    }
+    *sequence = (uint32_t)value;
+    return 1;
+}
+
+
+size_t encodeJournalRecord(const Session* session, JournalSource source, unsigned char* out) {
+    const Diagnosis* diag = sessionDiagnosis(session);
+    JournalRecord record;
+    int stored = session->questions_asked < TOKEN_MAX_ANSWERS ? session->questions_asked : TOKEN_MAX_ANSWERS;
+    size_t answer_bytes = (size_t)(stored + 7) / 8;
+    
+    if (diag == NULL) {
+        return 0;
+    }
+    record.length = (uint32_t)(sizeof(record) + answer_bytes);
+    record.checksum = 0;
+    record.started_ms = session->started_ms;
+    record.finished_ms = wallClockMs();
+    record.kb_version = session->kb->version;
+    record.node = session->node;
+    record.diagnosis = session->kb->flat[session->node].payload;
+    record.questions = (uint16_t)(session->questions_asked < 0xFFFF ? session->questions_asked : 0xFFFF);
+    record.severity = (uint8_t)diag->severity;
+    record.source = (uint8_t)source;
+    memcpy(out, &record, sizeof(record));
+    memcpy(out + sizeof(record), session->answers, answer_bytes);
+    if (stored & 7) {
+        out[record.length - 1] &= (uint8_t)((1u << (stored & 7)) - 1);
+    }
+    record.checksum = crc32Update(0, out + 8, record.length - 8);
+    memcpy(out + 4, &record.checksum, 4);
+    return record.length;
+}
+
+
+int traverseTree(Session* session) {
+    double started = monotonicMs();
+    double first_question = 0.0;
+    double answered = started;
+    
+    recordVisit(session->kb, 0, session->node);
+    while (!sessionFinished(session)) {
+        printf("\n");
+        printSeparator('-', 70);
+        printf("\n\033[1m\033[36m  QUESTION:\033[0m %s\n", sessionQuestion(session));
+        printSeparator('-', 70);
+        printf("\n\033[33m  Answer (Y)es or (N)o: \033[0m");
+        fflush(stdout);
+        double shown = monotonicMs();
+        if (first_question == 0.0) {
+            first_question = shown;
+        }
+        
+        char response = getUserResponse();
+        if (response == 0) {
+            return 0;
+        }
+        answered = monotonicMs();
+        recordAnswer(session->kb, 0, session->node, response, answered - shown);
+        sessionAnswer(session, response);
+        recordVisit(session->kb, 0, session->node);
+    }
+    
+    if (sessionDiagnosis(session) == NULL) {
+        return 1;
+    }
+    
+    displayProgress("Analyzing your symptoms");
+    clearScreen();
+    displayDiagnosis(session->kb, sessionDiagnosis(session));
+    fflush(stdout);
+    
+    if (g_report_timing) {
+        fprintf(stderr, "timing: first_question_ms=%.3f diagnosis_ms=%.3f questions=%d\n",
+                first_question - started, monotonicMs() - answered, session->questions_asked);
+    }
+    return 1;
+}
+
+
+double expandedNodeCount(const KnowledgeBase* kb) {
+    double* sizes = (double*)trackedMalloc((size_t)kb->node_count * sizeof(double));
+    double total;
+    
+    if (sizes == NULL) {
+        return 0.0;
+    }
+    for (uint32_t i = kb->node_count; i-- > 0;) {
+        const FlatNode* node = &kb->flat[i];
+        sizes[i] = node->question == FLAT_LEAF ? 1.0 : 1.0 + sizes[node->child[0]] + sizes[node->child[1]];
+    }
+    total = sizes[0];
+    free(sizes);
+    return total;
+}
+
+
+void reportKnowledgeBaseMemory(const KnowledgeBase* kb) {
+    size_t compiled_bytes = arenaUsedBytes(&kb->compiled);
+    size_t string_bytes = kb->strings.used;
+    size_t index_bytes = kb->strings.slot_count * sizeof(uint32_t);
+    size_t table_bytes = (size_t)kb->node_count * sizeof(FlatNode) + (size_t)kb->diagnosis_count * sizeof(Diagnosis);
+    size_t span_bytes = 0;
+    size_t lookup_bytes = kb->lookup != NULL ? ((size_t)1 << kb->lookup_bits) * sizeof(uint16_t) : 0;
+    size_t metrics_bytes = (size_t)kb->metric_shards * (sizeof(MetricsShard)
+                         + ((size_t)kb->node_count * 4 + kb->diagnosis_count) * sizeof(uint64_t));
+    size_t build_bytes = sizeof(KnowledgeBase) + kb->nodes.total_bytes + kb->payload.total_bytes
+                       + kb->compiled.total_bytes + kb->strings.capacity + index_bytes;
+    size_t fixed_layout = (size_t)kb->node_count * (sizeof(NodeType) + MAX_TEXT + 3 * sizeof(void*))
+                        + (size_t)kb->diagnosis_count * (6 * MAX_TEXT + sizeof(Severity));
+    
+    for (int format = 0; format < RENDER_FORMATS; format++) {
+        if (kb->rendered_spans[format] != NULL) {
+            span_bytes += ((size_t)kb->diagnosis_count * 2 + 1) * sizeof(uint32_t);
+        }
+    }
+    size_t resident = build_bytes + kb->rendered_bytes + span_bytes + kb->search.bytes + lookup_bytes + metrics_bytes;
+    
+    printf("Knowledge base: %u nodes, %u questions, %u diagnoses, version %08x\n",
+           kb->node_count, kb->question_count, kb->diagnosis_count, kb->version);
+    printf("  Depth:                %u max, %.3f expected questions\n", kb->max_depth, kb->expected_depth);
+    printf("  Shared subtrees:      %u nodes for a %.0f-node expanded tree\n", kb->node_count, expandedNodeCount(kb));
+    if (kb->rendered_bytes > 0) {
+        printf("  Rendered output:      %zu bytes (ANSI, plain, JSON) + %zu bytes of spans\n",
+               kb->rendered_bytes, span_bytes);
+    }
+    if (kb->search.dictionary != NULL) {
+        printf("  Search index:         %u terms, %u postings, %zu bytes\n",
+               kb->search.term_count, kb->search.posting_count, kb->search.bytes);
+    }
+    if (lookup_bytes > 0) {
+        printf("  Lookup table:         %zu bytes (%u questions)\n", lookup_bytes, kb->lookup_bits);
+    }
+    if (metrics_bytes > 0) {
+        printf("  Metrics shards:       %zu bytes (%d shards)\n", metrics_bytes, kb->metric_shards);
+    }
+    if (kb->mapping != NULL) {
+        printf("  Mapped file:          %zu bytes (tree and strings read in place)\n", kb->mapping_size);
+        printf("  Resident total:       %zu bytes heap + %zu bytes mapped\n", resident, kb->mapping_size);
+        return;
+    }
+    if (kb->strings.capacity == 0) {
+        printf("  Static tables:        %zu bytes of nodes and diagnoses, %u bytes of strings (in the binary)\n",
+               table_bytes, kb->strings.used);
+        printf("  Resident total:       %zu bytes heap + %zu bytes static\n", resident, table_bytes + string_bytes);
+        return;
+    }
+    printf("  FlatNode size:        %zu bytes (TreeNode %zu)\n", sizeof(FlatNode), sizeof(TreeNode));
+    printf("  Diagnosis size:       %zu bytes\n", sizeof(Diagnosis));
+    printf("  Build arenas:         %zu reserved\n", kb->nodes.total_bytes + kb->payload.total_bytes);
+    printf("  Compiled arena:       %zu used / %zu reserved\n", compiled_bytes, kb->compiled.total_bytes);
+    printf("  String pool:          %u bytes in %u strings (%zu bytes requested)\n",
+           kb->strings.used, kb->strings.string_count, kb->strings.requested_bytes);
+    printf("  String index:         %zu bytes\n", index_bytes);
+    printf("  Resident total:       %zu bytes\n", resident);
+    printf("  Live data:            %zu bytes\n", compiled_bytes + string_bytes);
+    printf("  Fixed-array layout:   %zu bytes (MAX_TEXT = %d)\n", fixed_layout, MAX_TEXT);
+}
+
+
+uint32_t crc32Update(uint32_t crc, const void* data, size_t length) {
+    static const uint32_t table[256] = {
+        0x00000000u, 0x77073096u, 0xee0e612cu, 0x990951bau, 0x076dc419u, 0x706af48fu,
+        0xe963a535u, 0x9e6495a3u, 0x0edb8832u, 0x79dcb8a4u, 0xe0d5e91eu, 0x97d2d988u,
+        0x09b64c2bu, 0x7eb17cbdu, 0xe7b82d07u, 0x90bf1d91u, 0x1db71064u, 0x6ab020f2u,
+        0xf3b97148u, 0x84be41deu, 0x1adad47du, 0x6ddde4ebu, 0xf4d4b551u, 0x83d385c7u,
+        0x136c9856u, 0x646ba8c0u, 0xfd62f97au, 0x8a65c9ecu, 0x14015c4fu, 0x63066cd9u,
+        0xfa0f3d63u, 0x8d080df5u, 0x3b6e20c8u, 0x4c69105eu, 0xd56041e4u, 0xa2677172u,
+        0x3c03e4d1u, 0x4b04d447u, 0xd20d85fdu, 0xa50ab56bu, 0x35b5a8fau, 0x42b2986cu,
+        0xdbbbc9d6u, 0xacbcf940u, 0x32d86ce3u, 0x45df5c75u, 0xdcd60dcfu, 0xabd13d59u,
+        0x26d930acu, 0x51de003au, 0xc8d75180u, 0xbfd06116u, 0x21b4f4b5u, 0x56b3c423u,
+        0xcfba9599u, 0xb8bda50fu, 0x2802b89eu, 0x5f058808u, 0xc60cd9b2u, 0xb10be924u,
+        0x2f6f7c87u, 0x58684c11u, 0xc1611dabu, 0xb6662d3du, 0x76dc4190u, 0x01db7106u,
+        0x98d220bcu, 0xefd5102au, 0x71b18589u, 0x06b6b51fu, 0x9fbfe4a5u, 0xe8b8d433u,
+        0x7807c9a2u, 0x0f00f934u, 0x9609a88eu, 0xe10e9818u, 0x7f6a0dbbu, 0x086d3d2du,
+        0x91646c97u, 0xe6635c01u, 0x6b6b51f4u, 0x1c6c6162u, 0x856530d8u, 0xf262004eu,
+        0x6c0695edu, 0x1b01a57bu, 0x8208f4c1u, 0xf50fc457u, 0x65b0d9c6u, 0x12b7e950u,
+        0x8bbeb8eau, 0xfcb9887cu, 0x62dd1ddfu, 0x15da2d49u, 0x8cd37cf3u, 0xfbd44c65u,
+        0x4db26158u, 0x3ab551ceu, 0xa3bc0074u, 0xd4bb30e2u, 0x4adfa541u, 0x3dd895d7u,
+        0xa4d1c46du, 0xd3d6f4fbu, 0x4369e96au, 0x346ed9fcu, 0xad678846u, 0xda60b8d0u,
+        0x44042d73u, 0x33031de5u, 0xaa0a4c5fu, 0xdd0d7cc9u, 0x5005713cu, 0x270241aau,
+        0xbe0b1010u, 0xc90c2086u, 0x5768b525u, 0x206f85b3u, 0xb966d409u, 0xce61e49fu,
+        0x5edef90eu, 0x29d9c998u, 0xb0d09822u, 0xc7d7a8b4u, 0x59b33d17u, 0x2eb40d81u,
+        0xb7bd5c3bu, 0xc0ba6cadu, 0xedb88320u, 0x9abfb3b6u, 0x03b6e20cu, 0x74b1d29au,
+        0xead54739u, 0x9dd277afu, 0x04db2615u, 0x73dc1683u, 0xe3630b12u, 0x94643b84u,
+        0x0d6d6a3eu, 0x7a6a5aa8u, 0xe40ecf0bu, 0x9309ff9du, 0x0a00ae27u, 0x7d079eb1u,
+        0xf00f9344u, 0x8708a3d2u, 0x1e01f268u, 0x6906c2feu, 0xf762575du, 0x806567cbu,
+        0x196c3671u, 0x6e6b06e7u, 0xfed41b76u, 0x89d32be0u, 0x10da7a5au, 0x67dd4accu,
+        0xf9b9df6fu, 0x8ebeeff9u, 0x17b7be43u, 0x60b08ed5u, 0xd6d6a3e8u, 0xa1d1937eu,
+        0x38d8c2c4u, 0x4fdff252u, 0xd1bb67f1u, 0xa6bc5767u, 0x3fb506ddu, 0x48b2364bu,
+        0xd80d2bdau, 0xaf0a1b4cu, 0x36034af6u, 0x41047a60u, 0xdf60efc3u, 0xa867df55u,
+        0x316e8eefu, 0x4669be79u, 0xcb61b38cu, 0xbc66831au, 0x256fd2a0u, 0x5268e236u,
+        0xcc0c7795u, 0xbb0b4703u, 0x220216b9u, 0x5505262fu, 0xc5ba3bbeu, 0xb2bd0b28u,
+        0x2bb45a92u, 0x5cb36a04u, 0xc2d7ffa7u, 0xb5d0cf31u, 0x2cd99e8bu, 0x5bdeae1du,
+        0x9b64c2b0u, 0xec63f226u, 0x756aa39cu, 0x026d930au, 0x9c0906a9u, 0xeb0e363fu,
+        0x72076785u, 0x05005713u, 0x95bf4a82u, 0xe2b87a14u, 0x7bb12baeu, 0x0cb61b38u,
+        0x92d28e9bu, 0xe5d5be0du, 0x7cdcefb7u, 0x0bdbdf21u, 0x86d3d2d4u, 0xf1d4e242u,
+        0x68ddb3f8u, 0x1fda836eu, 0x81be16cdu, 0xf6b9265bu, 0x6fb077e1u, 0x18b74777u,
+        0x88085ae6u, 0xff0f6a70u, 0x66063bcau, 0x11010b5cu, 0x8f659effu, 0xf862ae69u,
+        0x616bffd3u, 0x166ccf45u, 0xa00ae278u, 0xd70dd2eeu, 0x4e048354u, 0x3903b3c2u,
+        0xa7672661u, 0xd06016f7u, 0x4969474du, 0x3e6e77dbu, 0xaed16a4au, 0xd9d65adcu,
+        0x40df0b66u, 0x37d83bf0u, 0xa9bcae53u, 0xdebb9ec5u, 0x47b2cf7fu, 0x30b5ffe9u,
+        0xbdbdf21cu, 0xcabac28au, 0x53b39330u, 0x24b4a3a6u, 0xbad03605u, 0xcdd70693u,
+        0x54de5729u, 0x23d967bfu, 0xb3667a2eu, 0xc4614ab8u, 0x5d681b02u, 0x2a6f2b94u,
+        0xb40bbe37u, 0xc30c8ea1u, 0x5a05df1bu, 0x2d02ef8du
+    };
+    const unsigned char* bytes = (const unsigned char*)data;
+    
+    crc = ~crc;
+    for (size_t i = 0; i < length; i++) {
+        crc = table[(crc ^ bytes[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+
+uint32_t contentChecksum(const KnowledgeBase* kb) {
+    uint32_t crc = 0;
+    
+    for (uint32_t i = 0; i < kb->node_count; i++) {
+        const FlatNode* node = &kb->flat[i];
+        int leaf = node->question == FLAT_LEAF;
+        uint32_t fields[4] = { leaf ? 0 : node->child[0], leaf ? 0 : node->child[1], node->question,
+                               leaf ? node->payload : 0 };
+        const char* text = leaf ? "" : kbText(kb, node->payload);
+        crc = crc32Update(crc, fields, sizeof(fields));
+        crc = crc32Update(crc, text, strlen(text) + 1);
+    }
+    for (uint32_t d = 0; d < kb->diagnosis_count; d++) {
+        const Diagnosis* diag = &kb->diagnoses[d];
+        uint32_t severity = (uint32_t)diag->severity;
+        uint32_t sections[] = { diag->condition, diag->description, diag->remedies, diag->medications,
+                                diag->when_to_see_doctor, diag->prevention };
+        crc = crc32Update(crc, &severity, sizeof(severity));
+        for (int f = 0; f < 6; f++) {
+            const char* text = kbText(kb, sections[f]);
+            crc = crc32Update(crc, text, strlen(text) + 1);
+        }
+    }
+    return crc;
+}
+
+
+int computeKnowledgeBaseMetadata(KnowledgeBase* kb) {
+    double* reach = (double*)trackedMalloc((size_t)kb->node_count * sizeof(double));
+    uint32_t* depth = (uint32_t*)trackedMalloc((size_t)kb->node_count * sizeof(uint32_t));
+    
+    if (reach == NULL || depth == NULL) {
+        free(reach);
+        free(depth);
+        return 0;
+    }
+    
+    for (uint32_t i = 0; i < kb->node_count; i++) {
+        reach[i] = 0.0;
+        depth[i] = 0;
+    }
+    reach[0] = 1.0;
+    kb->max_depth = 0;
+    kb->expected_depth = 0.0;
+    
+    for (uint32_t i = 0; i < kb->node_count; i++) {
+        const FlatNode* node = &kb->flat[i];
+        if (node->question == FLAT_LEAF) {
+            kb->max_depth = depth[i] > kb->max_depth ? depth[i] : kb->max_depth;
+            continue;
+        }
+        kb->expected_depth += reach[i];
+        for (int bit = 0; bit < 2; bit++) {
+            uint32_t child = node->child[bit];
+            reach[child] += reach[i] / 2.0;
+            if (depth[i] + 1 > depth[child]) {
+                depth[child] = depth[i] + 1;
+            }
+        }
+    }
+    
+    free(reach);
+    free(depth);
+    return 1;
+}
+
+
+int replaceWithFile(FILE* file, const char* temporary, const char* path, int ok) {
+    ok = ok && fflush(file) == 0;
+#ifdef _WIN32
+    ok = ok && _commit(_fileno(file)) == 0;
+#else
+    ok = ok && fsync(fileno(file)) == 0;
+#endif
+    ok = fclose(file) == 0 && ok;
+    if (ok) {
+#ifdef _WIN32
+        remove(path);
+#endif
+        ok = rename(temporary, path) == 0;
+    }
+    if (!ok) {
+        remove(temporary);
+    }
+    return ok;
+}
+
+
+int exportKnowledgeBase(const KnowledgeBase* kb, const char* path) {
+    KbFileHeader header;
+    static const char padding[16] = {0};
+    uint32_t nodes_bytes = kb->node_count * (uint32_t)sizeof(FlatNode);
+    uint32_t diagnoses_bytes = kb->diagnosis_count * (uint32_t)sizeof(Diagnosis);
+    char temporary[1024];
+    FILE* out;
+    
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, KB_FILE_MAGIC, 4);
+    header.format_version = KB_FORMAT_VERSION;
+    header.header_size = sizeof(KbFileHeader);
+    header.content_version = kb->version;
+    header.node_count = kb->node_count;
+    header.question_count = kb->question_count;
+    header.diagnosis_count = kb->diagnosis_count;
+    header.string_bytes = kb->strings.used;
+    header.max_depth = kb->max_depth;
+    header.expected_depth_milli = (uint32_t)(kb->expected_depth * 1000.0 + 0.5);
+    header.nodes_offset = sizeof(KbFileHeader);
+    header.diagnoses_offset = header.nodes_offset + nodes_bytes;
+    header.strings_offset = (header.diagnoses_offset + diagnoses_bytes + 15) & ~15u;
+    header.file_size = header.strings_offset + header.string_bytes;
+    
+    header.checksum = crc32Update(0, kb->flat, nodes_bytes);
+    header.checksum = crc32Update(header.checksum, kb->diagnoses, diagnoses_bytes);
+    header.checksum = crc32Update(header.checksum, padding,
+                                  header.strings_offset - header.diagnoses_offset - diagnoses_bytes);
+    header.checksum = crc32Update(header.checksum, kb->strings.data, kb->strings.used);
+    
+    snprintf(temporary, sizeof(temporary), "%s.tmp", path);
+    out = fopen(temporary, "wb");
+    if (out == NULL) {
+        fprintf(stderr, "Cannot create %s\n", temporary);
+        return 0;
+    }
+    
+    uint32_t padding_bytes = header.strings_offset - header.diagnoses_offset - diagnoses_bytes;
+    int ok = fwrite(&header, 1, sizeof(header), out) == sizeof(header)
+          && fwrite(kb->flat, 1, nodes_bytes, out) == nodes_bytes
+          && fwrite(kb->diagnoses, 1, diagnoses_bytes, out) == diagnoses_bytes
+          && fwrite(padding, 1, padding_bytes, out) == padding_bytes
+          && fwrite(kb->strings.data, 1, kb->strings.used, out) == kb->strings.used;
+    
+    if (!replaceWithFile(out, temporary, path, ok)) {
+        fprintf(stderr, "Failed to write %s\n", path);
+        return 0;
+    }
+    return 1;
+}
+
+
+static void writeNodeName(FILE* out, const KnowledgeBase* kb, uint32_t index) {
+    if (kb->flat[index].question == FLAT_LEAF) {
+        fprintf(out, "d%u", kb->flat[index].payload);
+    } else {
+        fprintf(out, "q%u", index);
+    }
+}
+
+
+int exportKnowledgeBaseSource(const KnowledgeBase* kb, const char* path) {
+    FILE* out = fopen(path, "w");
+    if (out == NULL) {
+        fprintf(stderr, "Cannot create %s\n", path);
+        return 0;
+    }
+    
+    fprintf(out, "# Health Checker knowledge base source (version %08x)\n", kb->version);
+    fprintf(out, "# Compile with: kb_compiler %s OUTPUT.kb\n\n", path);
+    fprintf(out, "root ");
+    writeNodeName(out, kb, 0);
+    fprintf(out, "\n");
+    
+    for (uint32_t i = 0; i < kb->node_count; i++) {
+        const FlatNode* node = &kb->flat[i];
+        if (node->question == FLAT_LEAF) {
+            continue;
+        }
+        fprintf(out, "\nquestion q%u\n", i);
+        fprintf(out, "    text: %s\n", kbText(kb, node->payload));
+        fprintf(out, "    yes: ");
+        writeNodeName(out, kb, node->child[1]);
+        fprintf(out, "\n    no: ");
+        writeNodeName(out, kb, node->child[0]);
+        fprintf(out, "\n");
+    }
+    
+    for (uint32_t d = 0; d < kb->diagnosis_count; d++) {
+        const Diagnosis* diag = &kb->diagnoses[d];
+        fprintf(out, "\ndiagnosis d%u\n", d);
+        fprintf(out, "    severity: %s\n", severityName(diag->severity));
+        fprintf(out, "    condition: %s\n", kbText(kb, diag->condition));
+        fprintf(out, "    description: %s\n", kbText(kb, diag->description));
+        fprintf(out, "    remedies: %s\n", kbText(kb, diag->remedies));
+        fprintf(out, "    medications: %s\n", kbText(kb, diag->medications));
+        fprintf(out, "    when_to_see_doctor: %s\n", kbText(kb, diag->when_to_see_doctor));
+        fprintf(out, "    prevention: %s\n", kbText(kb, diag->prevention));
+    }
+    
+    if (fclose(out) != 0) {
+        fprintf(stderr, "Failed to write %s\n", path);
+        return 0;
+    }
+    return 1;
+}
+
+
+const void* mapFile(const char* path, size_t* size) {
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL, NULL);
+    LARGE_INTEGER file_size;
+    HANDLE mapping;
+    const void* view;
+    
+    if (file == INVALID_HANDLE_VALUE) {
+        return NULL;
+    }
+    if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0) {
+        CloseHandle(file);
+        return NULL;
+    }
+    mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(file);
+    if (mapping == NULL) {
+        return NULL;
+    }
+    view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);
+    *size = (size_t)file_size.QuadPart;
+    return view;
+#else
+    struct stat info;
+    void* view;
+    int fd = open(path, O_RDONLY);
+    
+    if (fd < 0) {
+        return NULL;
+    }
+    if (fstat(fd, &info) != 0 || info.st_size == 0) {
+        close(fd);
+        return NULL;
+    }
+    view = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (view == MAP_FAILED) {
+        return NULL;
+    }
+    *size = (size_t)info.st_size;
+    return view;
+#endif
+}
+
+
+void unmapFile(const void* view, size_t size) {
+#ifdef _WIN32
+    (void)size;
+    UnmapViewOfFile(view);
+#else
+    munmap((void*)view, size);
+#endif
+}
+
+
+const char* validateKnowledgeBaseImage(const unsigned char* image, size_t size) {
+    const KbFileHeader* header = (const KbFileHeader*)image;
+    const FlatNode* nodes;
+    const Diagnosis* diagnoses;
+    const char* strings;
+    
+    if (size < sizeof(KbFileHeader) || memcmp(header->magic, KB_FILE_MAGIC, 4) != 0) {
+        return "not a knowledge-base file";
+    }
+    if (header->format_version != KB_FORMAT_VERSION || header->header_size != sizeof(KbFileHeader)) {
+        return "unsupported format version";
+    }
+    if (header->file_size != size) {
+        return "file size does not match header";
+    }
+    if (header->node_count == 0 || header->string_bytes == 0
+        || header->nodes_offset % 4 != 0 || header->diagnoses_offset % 4 != 0
+        || (uint64_t)header->nodes_offset + (uint64_t)header->node_count * sizeof(FlatNode) > size
+        || (uint64_t)header->diagnoses_offset + (uint64_t)header->diagnosis_count * sizeof(Diagnosis) > size
+        || (uint64_t)header->strings_offset + header->string_bytes > size
+        || header->nodes_offset < sizeof(KbFileHeader)
+        || header->diagnoses_offset < sizeof(KbFileHeader)
+        || header->strings_offset < sizeof(KbFileHeader)) {
+        return "section offsets out of range";
+    }
+    if (crc32Update(0, image + sizeof(KbFileHeader), size - sizeof(KbFileHeader)) != header->checksum) {
+        return "checksum mismatch";
+    }
+    
+    nodes = (const FlatNode*)(image + header->nodes_offset);
+    diagnoses = (const Diagnosis*)(image + header->diagnoses_offset);
+    strings = (const char*)(image + header->strings_offset);
+    if (strings[0] != '\0' || strings[header->string_bytes - 1] != '\0') {
+        return "string pool is not terminated";
+    }
+    
+    for (uint32_t i = 0; i < header->node_count; i++) {
+        const FlatNode* node = &nodes[i];
+        if (node->question == FLAT_LEAF) {
+            if (node->payload >= header->diagnosis_count) {
+                return "leaf references a missing diagnosis";
+            }
+            continue;
+        }
+        if (node->question >= header->question_count || node->payload >= header->string_bytes) {
+            return "question node out of range";
+        }
+        if (node->child[0] <= i || node->child[1] <= i
+            || node->child[0] >= header->node_count || node->child[1] >= header->node_count) {
+            return "child index out of order or out of range";
+        }
+    }
+    
+    for (uint32_t i = 0; i < header->diagnosis_count; i++) {
+        const Diagnosis* diag = &diagnoses[i];
+        if ((int)diag->severity < EMERGENCY || (int)diag->severity > MILD
+            || diag->condition >= header->string_bytes || diag->description >= header->string_bytes
+            || diag->remedies >= header->string_bytes || diag->medications >= header->string_bytes
+            || diag->when_to_see_doctor >= header->string_bytes || diag->prevention >= header->string_bytes) {
+            return "diagnosis out of range";
+        }
+    }
+    
+    return NULL;
+}
+
+
+KnowledgeBase* loadKnowledgeBaseFile(const char* path) {
+    KnowledgeBase* kb;
+    const unsigned char* image;
+    const KbFileHeader* header;
+    const char* error;
+    size_t size = 0;
+    
+    image = (const unsigned char*)mapFile(path, &size);
+    if (image == NULL) {
+        printf("\033[31mCannot open knowledge base %s\033[0m\n", path);
+        return NULL;
+    }
+    
+    error = validateKnowledgeBaseImage(image, size);
+    if (error != NULL) {
+        printf("\033[31mInvalid knowledge base %s: %s\033[0m\n", path, error);
+        unmapFile(image, size);
+        return NULL;
+    }
+    
+    kb = (KnowledgeBase*)trackedMalloc(sizeof(KnowledgeBase));
+    if (kb == NULL) {
+        printf("\033[31mMemory allocation failed!\033[0m\n");
+        unmapFile(image, size);
+        return NULL;
+    }
+    initKnowledgeBase(kb);
+    
+    header = (const KbFileHeader*)image;
+    kb->mapping = image;
+    kb->mapping_size = size;
+    kb->flat = (const FlatNode*)(image + header->nodes_offset);
+    kb->diagnoses = (const Diagnosis*)(image + header->diagnoses_offset);
+    kb->strings.data = (char*)(image + header->strings_offset);
+    kb->strings.used = header->string_bytes;
+    kb->node_count = header->node_count;
+    kb->question_count = header->question_count;
+    kb->diagnosis_count = header->diagnosis_count;
+    kb->max_depth = header->max_depth;
+    kb->expected_depth = header->expected_depth_milli / 1000.0;
+    kb->version = header->content_version;
+    kb->generated = matchesGeneratedCode(kb);
+    
+    return kb;
+}
+
+
+KnowledgeBase* openKnowledgeBase(const char* path, int features) {
+    KnowledgeBase* kb = path != NULL ? loadKnowledgeBaseFile(path) : createKnowledgeBase();
+    
+    if (kb != NULL && (features & KB_OPEN_RENDER) && !renderDiagnoses(kb)) {
+        printf("\033[31mMemory allocation failed while rendering diagnoses!\033[0m\n");
+        releaseKnowledgeBase(kb);
+        return NULL;
+    }
+    if (kb != NULL && (features & KB_OPEN_SEARCH) && !buildSearchIndex(kb)) {
+        printf("\033[31mMemory allocation failed while building the search index!\033[0m\n");
+        releaseKnowledgeBase(kb);
+        return NULL;
+    }
+    return kb;
+}
+
+
+char scriptedResponse(unsigned int* seed) {
+    *seed = *seed * 1103515245u + 12345u;
+    return ((*seed >> 16) & 1) ? 'Y' : 'N';
+}
+
+
+void benchmarkSessions(int sessions, Journal* journal) {
+    Session session;
+    unsigned int seed;
+    size_t allocs_before, bytes_before;
+    size_t allocs_after, bytes_after;
+    double secs_before, secs_after;
+    double start;
+    
+    if (sessions <= 0) {
+        sessions = 10000;
+    }
+    
+    
+    seed = 1;
+    g_alloc_count = 0;
+    g_alloc_bytes = 0;
+    start = monotonicMs();
+    for (int i = 0; i < sessions; i++) {
+        KnowledgeBase* kb = createKnowledgeBase();
+        if (kb == NULL) {
+            return;
+        }
+        startSession(&session, kb);
+        while (!sessionFinished(&session)) {
+            sessionAnswer(&session, scriptedResponse(&seed));
+        }
+        releaseKnowledgeBase(kb);
+    }
+    secs_before = (monotonicMs() - start) / 1000.0;
+    allocs_before = g_alloc_count;
+    bytes_before = g_alloc_bytes;
+    
+    
+    seed = 1;
+    g_alloc_count = 0;
+    g_alloc_bytes = 0;
+    KnowledgeBase* shared = createKnowledgeBase();
+    if (shared == NULL) {
+        return;
+    }
+    size_t build_allocs = g_alloc_count;
+    size_t build_bytes = g_alloc_bytes;
+    start = monotonicMs();
+    for (int i = 0; i < sessions; i++) {
+        startSession(&session, shared);
+        while (!sessionFinished(&session)) {
+            sessionAnswer(&session, scriptedResponse(&seed));
+        }
+    }
+    secs_after = (monotonicMs() - start) / 1000.0;
+    allocs_after = g_alloc_count - build_allocs;
+    bytes_after = g_alloc_bytes - build_bytes;
+    
+    double journal_before = monotonicMs();
+    if (journal != NULL) {
+        seed = 1;
+        for (int i = 0; i < sessions; i++) {
+            startSession(&session, shared);
+            while (!sessionFinished(&session)) {
+                sessionAnswer(&session, scriptedResponse(&seed));
+            }
+            appendJournal(journal, &session, JOURNAL_CLI);
+        }
+    }
+    double journal_ms = monotonicMs() - journal_before;
+    releaseKnowledgeBase(shared);
+    
+    printf("Sessions: %d\n", sessions);
+    printf("%-28s %14s %14s %14s\n", "", "allocs/session", "bytes/session", "us/session");
+    printf("%-28s %14.1f %14.1f %14.3f\n", "rebuild tree per session",
+           (double)allocs_before / sessions, (double)bytes_before / sessions,
+           secs_before * 1e6 / sessions);
+    printf("%-28s %14.1f %14.1f %14.3f\n", "shared knowledge base",
+           (double)allocs_after / sessions, (double)bytes_after / sessions,
+           secs_after * 1e6 / sessions);
+    if (journal != NULL) {
+        printf("%-28s %14s %14s %14.3f\n", "shared + journal", "-", "-", journal_ms * 1e3 / sessions);
+    }
+    printf("One-time build: %zu allocs, %zu bytes\n", build_allocs, build_bytes);
+}
+
+
+const char* severityName(Severity severity) {
+    switch (severity) {
+        case EMERGENCY: return "EMERGENCY";
+        case URGENT:    return "URGENT";
+        case MODERATE:  return "MODERATE";
+        case MILD:      return "MILD";
+        default:        return "UNKNOWN";
+    }
+}
+
+
+int answerBit(char c) {
+    if (c == 'Y' || c == 'y' || c == '1') {
+        return 1;
+    }
+    if (c == 'N' || c == 'n' || c == '0') {
+        return 0;
+    }
+    return -1;
+}
+
+
+uint32_t evaluateAnswers(const KnowledgeBase* kb, const char* answers, size_t length) {
+    const FlatNode* flat = kb->flat;
+    uint32_t node = 0;
+    
+    while (flat[node].question != FLAT_LEAF) {
+        uint32_t question = flat[node].question;
+        if (question >= length) {
+            return FLAT_LEAF;
+        }
+        int bit = answerBit(answers[question]);
+        if (bit < 0) {
+            return FLAT_LEAF;
+        }
+        node = flat[node].child[bit];
+    }
+    
+    return flat[node].payload;
+}
+
+
+size_t formatBatchResult(const KnowledgeBase* kb, uint32_t diagnosis, char* out) {
+    char digits[10];
+    size_t length = 0;
+    int count = 0;
+    
+    if (diagnosis == FLAT_LEAF || diagnosis >= kb->diagnosis_count) {
+        memcpy(out, "-1 INVALID\n", 11);
+        return 11;
+    }
+    
+    uint32_t value = diagnosis;
+    do {
+        digits[count++] = (char)('0' + value % 10);
+        value /= 10;
+    } while (value > 0);
+    while (count > 0) {
+        out[length++] = digits[--count];
+    }
+    out[length++] = ' ';
+    
+    const char* name = severityName(kb->diagnoses[diagnosis].severity);
+    size_t name_length = strlen(name);
+    memcpy(out + length, name, name_length);
+    length += name_length;
+    out[length++] = '\n';
+    
+    return length;
+}
+
+
+void parseAnswerBits(const char* text, uint32_t length, uint64_t* yes_bits, uint64_t* valid_bits) {
+    uint32_t i = 0;
+    
+#if defined(__SSE2__)
+    const __m128i lower = _mm_set1_epi8(0x20);
+    const __m128i letter_y = _mm_set1_epi8('y');
+    const __m128i letter_n = _mm_set1_epi8('n');
+    const __m128i one = _mm_set1_epi8('1');
+    const __m128i zero = _mm_set1_epi8('0');
+    
+    while (i < length) {
+        char tail[16];
+        const char* source = text + i;
+        uint32_t width = length - i < 16 ? length - i : 16;
+        
+        if (width < 16) {
+            memset(tail, 0, sizeof(tail));
+            memcpy(tail, source, width);
+            source = tail;
+        }
+        
+        __m128i chars = _mm_loadu_si128((const __m128i*)source);
+        __m128i folded = _mm_or_si128(chars, lower);
+        __m128i yes = _mm_or_si128(_mm_cmpeq_epi8(folded, letter_y), _mm_cmpeq_epi8(chars, one));
+        __m128i no = _mm_or_si128(_mm_cmpeq_epi8(folded, letter_n), _mm_cmpeq_epi8(chars, zero));
+        uint64_t yes_mask = (uint64_t)_mm_movemask_epi8(yes);
+        uint64_t valid_mask = yes_mask | (uint64_t)_mm_movemask_epi8(no);
+        
+        yes_bits[i / 64] |= yes_mask << (i % 64);
+        valid_bits[i / 64] |= valid_mask << (i % 64);
+        i += width;
+    }
+#else
+    for (; i < length; i++) {
+        int bit = answerBit(text[i]);
+        if (bit >= 0) {
+            yes_bits[i / 64] |= (uint64_t)bit << (i % 64);
+            valid_bits[i / 64] |= 1ull << (i % 64);
+        }
+    }
+#endif
+}
+
+
+void evaluateBlockScalar(const KnowledgeBase* kb, const AnswerRecord* records, int count, uint32_t* results) {
+    for (int i = 0; i < count; i++) {
+        results[i] = evaluateAnswers(kb, records[i].text, records[i].length);
+    }
+}
+
+
+static void visitLookupPath(const KnowledgeBase* kb, const char* answers, uint32_t depth,
+                            uint32_t leaf, void* context) {
+    uint32_t asked = 0;
+    uint32_t value = 0;
+    uint32_t node = 0;
+    (void)depth;
+    (void)context;
+    
+    while (kb->flat[node].question != FLAT_LEAF) {
+        uint32_t question = kb->flat[node].question;
+        int bit = answers[question] == 'Y';
+        asked |= 1u << question;
+        value |= (uint32_t)bit << question;
+        node = kb->flat[node].child[bit];
+    }
+    
+    uint32_t free_bits = ~asked & ((1u << kb->lookup_bits) - 1);
+    uint32_t dont_care = 0;
+    do {
+        kb->lookup[value | dont_care] = (uint16_t)kb->flat[leaf].payload;
+        dont_care = (dont_care - free_bits) & free_bits;
+    } while (dont_care != 0);
+}
+
+
+int buildLookupTable(KnowledgeBase* kb) {
+    size_t entries;
+    char answers[LOOKUP_MAX_QUESTIONS];
+    
+    if (kb->lookup != NULL) {
+        return 1;
+    }
+    if (kb->question_count > LOOKUP_MAX_QUESTIONS) {
+        fprintf(stderr, "Lookup table needs at most %d questions (this knowledge base has %u)\n",
+                LOOKUP_MAX_QUESTIONS, kb->question_count);
+        return 0;
+    }
+    if (kb->diagnosis_count >= 0xFFFF) {
+        fprintf(stderr, "Lookup table needs fewer than %u diagnoses (this knowledge base has %u)\n",
+                0xFFFFu, kb->diagnosis_count);
+        return 0;
+    }
+    
+    entries = (size_t)1 << kb->question_count;
+    kb->lookup = (uint16_t*)trackedMalloc(entries * sizeof(uint16_t));
+    if (kb->lookup == NULL) {
+        fprintf(stderr, "Memory allocation failed!\n");
+        return 0;
+    }
+    kb->lookup_bits = kb->question_count;
+    memset(kb->lookup, 0xFF, entries * sizeof(uint16_t));
+    
+    if (enumeratePaths(kb, visitLookupPath, NULL) < 0) {
+        free(kb->lookup);
+        kb->lookup = NULL;
+        return 0;
+    }
+    
+    for (size_t key = 0; key < entries; key++) {
+        for (uint32_t q = 0; q < kb->question_count; q++) {
+            answers[q] = (key >> q) & 1 ? 'Y' : 'N';
+        }
+        if (kb->lookup[key] != evaluateAnswers(kb, answers, kb->question_count)) {
+            fprintf(stderr, "Lookup table disagrees with the tree for answer mask %zx\n", key);
+            free(kb->lookup);
+            kb->lookup = NULL;
+            return 0;
+        }
+    }
+    
+    return 1;
+}
+
+
+void evaluateBlockLookup(const KnowledgeBase* kb, const AnswerRecord* records, int count, uint32_t* results) {
+    uint64_t full = ((uint64_t)1 << kb->lookup_bits) - 1;
+    
+    for (int i = 0; i < count; i++) {
+        uint64_t yes = 0;
+        uint64_t valid = 0;
+        uint32_t length = records[i].length < kb->lookup_bits ? records[i].length : kb->lookup_bits;
+        
+        parseAnswerBits(records[i].text, length, &yes, &valid);
+        if (valid == full) {
+            results[i] = kb->lookup[yes];
+        } else {
+            results[i] = evaluateAnswers(kb, records[i].text, records[i].length);
+        }
+    }
+}
+
+
+void evaluateBlockGenerated(const KnowledgeBase* kb, const AnswerRecord* records, int count, uint32_t* results) {
+#ifdef HEALTH_CHECKER_GENERATED
+    if (kb->generated) {
+        for (int i = 0; i < count; i++) {
+            results[i] = generatedEvaluate(records[i].text, records[i].length);
+        }
+        return;
+    }
+#endif
+    evaluateBlockScalar(kb, records, count, results);
+}
+
+
+void evaluateBlock(const KnowledgeBase* kb, Evaluator evaluator, const AnswerRecord* records, int count,
+                   uint32_t* results) {
+    if (evaluator == EVAL_LOOKUP && kb->lookup != NULL) {
+        evaluateBlockLookup(kb, records, count, results);
+    } else if (evaluator == EVAL_GENERATED) {
+        evaluateBlockGenerated(kb, records, count, results);
+    } else {
+        evaluateBlockScalar(kb, records, count, results);
+    }
+}
+
+
+int parseEvaluator(const char* name, Evaluator* evaluator) {
+    if (strcmp(name, "scalar") == 0) {
+        *evaluator = EVAL_SCALAR;
+    } else if (strcmp(name, "lookup") == 0) {
+        *evaluator = EVAL_LOOKUP;
+    } else if (strcmp(name, "generated") == 0) {
+        *evaluator = EVAL_GENERATED;
+    } else {
+        return 0;
+    }
+    return 1;
+}
+
+
+void emitBatchResults(const KnowledgeBase* kb, const uint32_t* results, int count, BatchOutput* output) {
+    for (int i = 0; i < count; i++) {
+        if (BATCH_OUTPUT_BUFFER - output->used < BATCH_RESULT_MAX) {
+            fwrite(output->data, 1, output->used, stdout);
+            output->used = 0;
+        }
+        if (results[i] == FLAT_LEAF) {
+            output->invalid++;
+        }
+        output->used += formatBatchResult(kb, results[i], output->data + output->used);
+    }
+    output->records += (unsigned long long)count;
+}
+
+
+int runBatch(const KnowledgeBase* kb, const char* path, Evaluator evaluator) {
+    FILE* in = stdin;
+    char* buffer;
+    BatchOutput output;
+    AnswerRecord block[EVAL_BLOCK_RECORDS];
+    uint32_t results[EVAL_BLOCK_RECORDS];
+    int pending = 0;
+    size_t filled = 0;
+    int eof = 0;
+    int status = 0;
+    double start;
+    
+    if (path != NULL && strcmp(path, "-") != 0) {
+        in = fopen(path, "rb");
+        if (in == NULL) {
+            fprintf(stderr, "Cannot open %s\n", path);
+            return 1;
+        }
+    }
+    
+    buffer = (char*)trackedMalloc(BATCH_READ_BUFFER);
+    output.data = (char*)trackedMalloc(BATCH_OUTPUT_BUFFER);
+    output.used = 0;
+    output.records = 0;
+    output.invalid = 0;
+    if (buffer == NULL || output.data == NULL) {
+        fprintf(stderr, "Memory allocation failed!\n");
+        free(buffer);
+        free(output.data);
+        if (in != stdin) {
+            fclose(in);
+        }
+        return 1;
+    }
+    
+    start = monotonicMs();
+    while (!eof) {
+        size_t got = fread(buffer + filled, 1, BATCH_READ_BUFFER - filled, in);
+        size_t pos = 0;
+        filled += got;
+        eof = got == 0;
+        
+        while (pos < filled) {
+            char* line = buffer + pos;
+            char* newline = (char*)memchr(line, '\n', filled - pos);
+            size_t length;
+            
+            if (newline == NULL && !eof) {
+                break;
+            }
+            length = newline != NULL ? (size_t)(newline - line) : filled - pos;
+            pos += length + (newline != NULL ? 1 : 0);
+            if (length > 0 && line[length - 1] == '\r') {
+                length--;
+            }
+            if (length == 0 || line[0] == '#') {
+                continue;
+            }
+            
+            block[pending].text = line;
+            block[pending].length = (uint32_t)length;
+            if (++pending == EVAL_BLOCK_RECORDS) {
+                evaluateBlock(kb, evaluator, block, pending, results);
+                emitBatchResults(kb, results, pending, &output);
+                pending = 0;
+            }
+        }
+        
+        if (pending > 0) {
+            evaluateBlock(kb, evaluator, block, pending, results);
+            emitBatchResults(kb, results, pending, &output);
+            pending = 0;
+        }
+        if (pos == 0 && filled == BATCH_READ_BUFFER) {
+            fprintf(stderr, "Answer record longer than %d bytes\n", BATCH_READ_BUFFER);
+            status = 1;
+            break;
+        }
+        memmove(buffer, buffer + pos, filled - pos);
+        filled -= pos;
+    }
+    fwrite(output.data, 1, output.used, stdout);
+    fflush(stdout);
+    
+    double seconds = (monotonicMs() - start) / 1000.0;
+    fprintf(stderr, "Processed %llu records (%llu invalid) in %.3f s: %.0f records/s\n",
+            output.records, output.invalid, seconds, seconds > 0 ? output.records / seconds : 0.0);
+    
+    free(buffer);
+    free(output.data);
+    if (in != stdin) {
+        fclose(in);
+    }
+    return status;
+}
+
+
+int enumeratePaths(const KnowledgeBase* kb, PathVisitor visit, void* context) {
+    uint32_t* nodes = (uint32_t*)trackedMalloc((size_t)kb->node_count * sizeof(uint32_t));
+    unsigned char* states = (unsigned char*)trackedMalloc(kb->node_count);
+    char* answers = (char*)trackedMalloc((size_t)kb->question_count + 1);
+    uint32_t top = 0;
+    int paths = 0;
+    
+    if (nodes == NULL || states == NULL || answers == NULL) {
+        free(nodes);
+        free(states);
+        free(answers);
+        return -1;
+    }
+    
+    memset(answers, 'N', kb->question_count);
+    answers[kb->question_count] = '\0';
+    nodes[top] = 0;
+    states[top] = 0;
+    top++;
+    
+    while (top > 0) {
+        const FlatNode* node = &kb->flat[nodes[top - 1]];
+        
+        if (node->question == FLAT_LEAF) {
+            visit(kb, answers, top - 1, nodes[top - 1], context);
+            paths++;
+            top--;
+            continue;
+        }
+        
+        if (states[top - 1] == 2) {
+            top--;
+            continue;
+        }
+        
+        int bit = states[top - 1] == 0;
+        answers[node->question] = bit ? 'Y' : 'N';
+        states[top - 1]++;
+        nodes[top] = node->child[bit];
+        states[top] = 0;
+        top++;
+    }
+    
+    free(nodes);
+    free(states);
+    free(answers);
+    return paths;
+}
+
+
+static void checkEvaluators(const KnowledgeBase* kb, SelfTest* test, const uint32_t* expected) {
+    uint32_t scalar[EVAL_BLOCK_RECORDS];
+    uint32_t table[EVAL_BLOCK_RECORDS];
+    uint32_t generated[EVAL_BLOCK_RECORDS];
+    
+    evaluateBlockScalar(kb, test->block, test->pending, scalar);
+    evaluateBlockGenerated(kb, test->block, test->pending, generated);
+    if (kb->lookup != NULL) {
+        evaluateBlockLookup(kb, test->block, test->pending, table);
+    } else {
+        memcpy(table, scalar, sizeof(table));
+    }
+    
+    for (int i = 0; i < test->pending; i++) {
+        uint32_t want = expected != NULL ? expected[i] : scalar[i];
+        if (scalar[i] != want || table[i] != want || generated[i] != want) {
+            if (test->failures < 5) {
+                printf("  mismatch on %.*s: expected %d, scalar %d, lookup %d, generated %d\n",
+                       (int)test->block[i].length, test->block[i].text,
+                       (int)want, (int)scalar[i], (int)table[i], (int)generated[i]);
+            }
+            test->failures++;
+        }
+        test->checked++;
+    }
+    test->pending = 0;
+}
+
+
+static void visitSelfTestPath(const KnowledgeBase* kb, const char* answers, uint32_t depth,
+                              uint32_t leaf, void* context) {
+    SelfTest* test = (SelfTest*)context;
+    char* slot = test->storage + (size_t)test->pending * (kb->question_count + 1);
+    
+    memcpy(slot, answers, kb->question_count);
+    test->block[test->pending].text = slot;
+    test->block[test->pending].length = kb->question_count;
+    test->expected[test->pending] = kb->flat[leaf].payload;
+    test->max_depth = depth > test->max_depth ? depth : test->max_depth;
+    
+    if (++test->pending == EVAL_BLOCK_RECORDS) {
+        checkEvaluators(kb, test, test->expected);
+    }
+}
+
+
+int matchesGeneratedCode(const KnowledgeBase* kb) {
+#ifdef HEALTH_CHECKER_GENERATED
+    return kb->version == GENERATED_VERSION && kb->node_count == GENERATED_NODE_COUNT
+           && kb->question_count == GENERATED_QUESTION_COUNT
+           && kb->diagnosis_count == GENERATED_DIAGNOSIS_COUNT
+           && kb->strings.used == GENERATED_STRING_BYTES
+           && memcmp(kb->flat, g_generated_flat, sizeof(g_generated_flat)) == 0
+           && memcmp(kb->diagnoses, g_generated_diagnoses, sizeof(g_generated_diagnoses)) == 0
+           && memcmp(kb->strings.data, g_generated_strings, GENERATED_STRING_BYTES) == 0;
+#else
+    (void)kb;
+    return 0;
+#endif
+}
+
+
+int checkGeneratedCode(const KnowledgeBase* kb) {
+#ifdef HEALTH_CHECKER_GENERATED
+    KnowledgeBase* interpreted = NULL;
+    const KnowledgeBase* reference = kb;
+    
+    if (kb->version != GENERATED_VERSION) {
+        printf("Generated code:      built for %08x, not checked against %08x\n", GENERATED_VERSION, kb->version);
+        return 0;
+    }
+    if (kb->flat == g_generated_flat) {
+        interpreted = interpretKnowledgeBase();
+        if (interpreted == NULL) {
+            return 1;
+        }
+        reference = interpreted;
+    }
+    
+    int same = reference->generated;
+    uint32_t version = reference->version;
+    releaseKnowledgeBase(interpreted);
+    if (!same && version == GENERATED_VERSION) {
+        printf("\033[31mGenerated code and the %s tree both claim %08x but their tables differ\033[0m\n",
+               interpreted != NULL ? "interpreted" : "loaded", version);
+        return 1;
+    }
+    if (!same) {
+        printf("\033[31mGenerated code is for %08x but the %s tree is %08x; regenerate kb_generated.h\033[0m\n",
+               GENERATED_VERSION, interpreted != NULL ? "interpreted" : "loaded", version);
+        return 1;
+    }
+    printf("Generated code:      version %08x, tables match the %s tree\n", GENERATED_VERSION,
+           interpreted != NULL ? "interpreted" : "loaded");
+#else
+    (void)kb;
+#endif
+    return 0;
+}
+
+
+int runSelfTest(const KnowledgeBase* kb, long random_records) {
+    SelfTest test;
+    unsigned int seed = 12345;
+    uint32_t stride = kb->question_count + 1;
+    int paths;
+    
+    test.storage = (char*)trackedMalloc((size_t)EVAL_BLOCK_RECORDS * stride);
+    test.pending = 0;
+    test.checked = 0;
+    test.failures = 0;
+    test.max_depth = 0;
+    if (test.storage == NULL) {
+        printf("\033[31mMemory allocation failed!\033[0m\n");
+        return 1;
+    }
+    
+    paths = enumeratePaths(kb, visitSelfTestPath, &test);
+    if (test.pending > 0) {
+        checkEvaluators(kb, &test, test.expected);
+    }
+    printf("Root-to-leaf paths:  %d (max depth %u), %ld mismatches\n", paths, test.max_depth, test.failures);
+    
+    long path_failures = test.failures;
+    for (long r = 0; r < random_records; r++) {
+        char* slot = test.storage + (size_t)test.pending * stride;
+        uint32_t length = (uint32_t)(scriptedResponse(&seed) == 'Y' ? kb->question_count
+                                     : (seed >> 8) % (kb->question_count + 1));
+        
+        for (uint32_t q = 0; q < length; q++) {
+            slot[q] = scriptedResponse(&seed);
+        }
+        if (length > 0 && (seed & 0xFF) == 0) {
+            slot[(seed >> 8) % length] = '?';
+        }
+        test.block[test.pending].text = slot;
+        test.block[test.pending].length = length;
+        if (++test.pending == EVAL_BLOCK_RECORDS) {
+            checkEvaluators(kb, &test, NULL);
+        }
+    }
+    if (test.pending > 0) {
+        checkEvaluators(kb, &test, NULL);
+    }
+    printf("Random records:      %ld, %ld mismatches\n", random_records, test.failures - path_failures);
+    
+    free(test.storage);
+    
+    if (test.failures != 0 || paths < 0) {
+        printf("\033[31mSELF-TEST FAILED\033[0m\n");
+        return 1;
+    }
+    printf("\033[32mSELF-TEST PASSED\033[0m (%ld evaluations)\n", test.checked);
+    return 0;
+}
+
+
+void generateRecords(const KnowledgeBase* kb, long count, unsigned int seed) {
+    char* line = (char*)trackedMalloc(kb->question_count + 2);
+    if (line == NULL) {
+        fprintf(stderr, "Memory allocation failed!\n");
+        return;
+    }
+    
+    for (long i = 0; i < count; i++) {
+        for (uint32_t q = 0; q < kb->question_count; q++) {
+            line[q] = scriptedResponse(&seed);
+        }
+        line[kb->question_count] = '\n';
+        fwrite(line, 1, kb->question_count + 1, stdout);
+    }
+    
+    free(line);
+}
+
+
+void listKnowledgeBase(const KnowledgeBase* kb) {
+    const char** questions = (const char**)trackedMalloc((kb->question_count + 1) * sizeof(char*));
+    if (questions == NULL) {
+        fprintf(stderr, "Memory allocation failed!\n");
+        return;
+    }
+    
+    for (uint32_t i = 0; i < kb->node_count; i++) {
+        if (kb->flat[i].question != FLAT_LEAF) {
+            questions[kb->flat[i].question] = kbText(kb, kb->flat[i].payload);
+        }
+    }
+    
+    printf("Questions (answer record position):\n");
+    for (uint32_t q = 0; q < kb->question_count; q++) {
+        printf("  %3u  %s\n", q, questions[q]);
+    }
+    printf("Diagnoses (batch result id):\n");
+    for (uint32_t d = 0; d < kb->diagnosis_count; d++) {
+        printf("  %3u  %-9s %s\n", d, severityName(kb->diagnoses[d].severity),
+               kbText(kb, kb->diagnoses[d].condition));
+    }
+    
+    free(questions);
+}
+
+
+#ifdef __linux__
+static atomic_int g_server_stopping;
+
+
+static atomic_int g_reload_requested;
+
+
+static void stopServer(int signal_number) {
+    if (signal_number == SIGHUP) {
+        atomic_store(&g_reload_requested, 1);
+        return;
+    }
+    atomic_store(&g_server_stopping, 1);
+}
+
+
+static int openJournalFile(Journal* journal) {
+    char path[1024];
+    JournalFileHeader header;
+    
+    snprintf(path, sizeof(path), "%s/journal-%06u.hcj", journal->directory, journal->sequence + 1);
+    int fd = open(path, O_WRONLY | O_CREAT | O_EXCL | O_APPEND | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return 0;
+    }
+    memcpy(header.magic, JOURNAL_MAGIC, 4);
+    header.format_version = JOURNAL_FORMAT_VERSION;
+    header.header_size = sizeof(header);
+    header.sequence = journal->sequence + 1;
+    header.created_ms = wallClockMs();
+    if (!writeAll(fd, (const char*)&header, sizeof(header)) || fdatasync(fd) != 0) {
+        close(fd);
+        unlink(path);
+        return 0;
+    }
+    
+    int dir = open(journal->directory, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dir >= 0) {
+        fsync(dir);
+        close(dir);
+    }
+    if (journal->fd >= 0) {
+        close(journal->fd);
+    }
+    journal->fd = fd;
+    journal->sequence++;
+    journal->file_bytes = sizeof(header);
+    journal->files++;
+    return 1;
+}
+
+
+static int commitJournal(Journal* journal, const char* data, size_t length) {
+    if (journal->file_bytes + length > journal->rotate_bytes && journal->file_bytes > sizeof(JournalFileHeader)) {
+        openJournalFile(journal);
+    }
+    if (!writeAll(journal->fd, data, length) || fdatasync(journal->fd) != 0) {
+        return 0;
+    }
+    journal->file_bytes += length;
+    journal->commits++;
+    return 1;
+}
+
+
+void* journalWriterMain(void* arg) {
+    Journal* journal = (Journal*)arg;
+    
+    pthread_mutex_lock(&journal->lock);
+    for (;;) {
+        while (journal->used == 0 && !journal->stopping) {
+            pthread_cond_wait(&journal->wake, &journal->lock);
+        }
+        if (journal->used == 0) {
+            break;
+        }
+        if (!journal->stopping && journal->used < JOURNAL_BUFFER_BYTES / 2) {
+            struct timespec deadline;
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_nsec += JOURNAL_FLUSH_MS * 1000000L;
+            if (deadline.tv_nsec >= 1000000000L) {
+                deadline.tv_sec++;
+                deadline.tv_nsec -= 1000000000L;
+            }
+            pthread_cond_timedwait(&journal->wake, &journal->lock, &deadline);
+        }
+        
+        const char* pending = journal->buffers[journal->active];
+        size_t length = journal->used;
+        unsigned long records = journal->pending;
+        journal->active ^= 1;
+        journal->used = 0;
+        journal->pending = 0;
+        pthread_cond_broadcast(&journal->drained);
+        pthread_mutex_unlock(&journal->lock);
+        
+        int ok = commitJournal(journal, pending, length);
+        pthread_mutex_lock(&journal->lock);
+        if (ok) {
+            journal->records += records;
+        } else {
+            journal->lost += records;
+        }
+    }
+    pthread_mutex_unlock(&journal->lock);
+    return NULL;
+}
+
+
+Journal* openJournal(const char* directory, uint64_t rotate_bytes) {
+    Journal* journal = (Journal*)trackedMalloc(sizeof(Journal));
+    DIR* dir;
+    struct dirent* entry;
+    
+    if (journal == NULL) {
+        return NULL;
+    }
+    memset(journal, 0, sizeof(Journal));
+    journal->directory = directory;
+    journal->rotate_bytes = rotate_bytes > 0 ? rotate_bytes : JOURNAL_ROTATE_BYTES;
+    journal->fd = -1;
+    if (mkdir(directory, 0755) != 0 && errno != EEXIST) {
+        fprintf(stderr, "\033[31mCannot create journal directory %s: %s\033[0m\n", directory, strerror(errno));
+        free(journal);
+        return NULL;
+    }
+    dir = opendir(directory);
+    while (dir != NULL && (entry = readdir(dir)) != NULL) {
+        uint32_t sequence;
+        if (parseJournalFileName(entry->d_name, &sequence) && sequence > journal->sequence) {
+            journal->sequence = sequence;
+        }
+    }
+    if (dir != NULL) {
+        closedir(dir);
+    }
+    
+    journal->buffers[0] = (char*)trackedMalloc(JOURNAL_BUFFER_BYTES);
+    journal->buffers[1] = (char*)trackedMalloc(JOURNAL_BUFFER_BYTES);
+    if (journal->buffers[0] == NULL || journal->buffers[1] == NULL || !openJournalFile(journal)) {
+        fprintf(stderr, "\033[31mCannot open a journal file in %s: %s\033[0m\n", directory, strerror(errno));
+        free(journal->buffers[0]);
+        free(journal->buffers[1]);
+        free(journal);
+        return NULL;
+    }
+    
+    pthread_mutex_init(&journal->lock, NULL);
+    pthread_cond_init(&journal->wake, NULL);
+    pthread_cond_init(&journal->drained, NULL);
+    if (pthread_create(&journal->thread, NULL, journalWriterMain, journal) != 0) {
+        fprintf(stderr, "\033[31mCannot start the journal writer\033[0m\n");
+        close(journal->fd);
+        pthread_mutex_destroy(&journal->lock);
+        pthread_cond_destroy(&journal->wake);
+        pthread_cond_destroy(&journal->drained);
+        free(journal->buffers[0]);
+        free(journal->buffers[1]);
+        free(journal);
+        return NULL;
+    }
+    return journal;
+}
+
+
+void appendJournal(Journal* journal, const Session* session, JournalSource source) {
+    unsigned char record[sizeof(JournalRecord) + TOKEN_MAX_ANSWERS / 8];
+    size_t length;
+    
+    if (journal == NULL || (length = encodeJournalRecord(session, source, record)) == 0) {
+        return;
+    }
+    pthread_mutex_lock(&journal->lock);
+    while (journal->used + length > JOURNAL_BUFFER_BYTES) {
+        pthread_cond_signal(&journal->wake);
+        pthread_cond_wait(&journal->drained, &journal->lock);
+    }
+    memcpy(journal->buffers[journal->active] + journal->used, record, length);
+    journal->used += length;
+    journal->pending++;
+    if (journal->used == length || journal->used >= JOURNAL_BUFFER_BYTES / 2) {
+        pthread_cond_signal(&journal->wake);
+    }
+    pthread_mutex_unlock(&journal->lock);
+}
+
+
+void closeJournal(Journal* journal) {
+    if (journal == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&journal->lock);
+    journal->stopping = 1;
+    pthread_cond_signal(&journal->wake);
+    pthread_mutex_unlock(&journal->lock);
+    pthread_join(journal->thread, NULL);
+    
+    if (journal->lost > 0) {
+        fprintf(stderr, "\033[31mJournal: %lu session records could not be written to %s\033[0m\n",
+                journal->lost, journal->directory);
+    }
+    close(journal->fd);
+    pthread_mutex_destroy(&journal->lock);
+    pthread_cond_destroy(&journal->wake);
+    pthread_cond_destroy(&journal->drained);
+    free(journal->buffers[0]);
+    free(journal->buffers[1]);
+    free(journal);
+}
+
+
+int registryInit(KbRegistry* registry, KnowledgeBase* kb, int readers) {
+    KbSnapshot* snapshot = (KbSnapshot*)trackedMalloc(sizeof(KbSnapshot));
+    registry->readers = (ReaderSlot*)trackedMalloc(readers * sizeof(ReaderSlot));
+    if (snapshot == NULL || registry->readers == NULL) {
+        free(snapshot);
+        free(registry->readers);
+        return 0;
+    }
+    
+    for (int i = 0; i < readers; i++) {
+        atomic_init(&registry->readers[i].epoch, 0);
+    }
+    memset(snapshot, 0, sizeof(KbSnapshot));
+    snapshot->kbs[0] = kb;
+    snapshot->count = 1;
+    atomic_init(&registry->current, snapshot);
+    atomic_init(&registry->epoch, 1);
+    registry->reader_count = readers;
+    registry->retired = NULL;
+    registry->reloads = 0;
+    return 1;
+}
+
+
+const KbSnapshot* registryPin(KbRegistry* registry, int reader) {
+    atomic_store(&registry->readers[reader].epoch, atomic_load(&registry->epoch));
+    return atomic_load(&registry->current);
+}
+
+
+void registryUnpin(KbRegistry* registry, int reader) {
+    atomic_store_explicit(&registry->readers[reader].epoch, 0, memory_order_release);
+}
+
+
+static void retireVersion(KbRegistry* registry, RetiredVersion* retired, KbSnapshot* snapshot, KnowledgeBase* kb) {
+    retired->snapshot = snapshot;
+    retired->kb = kb;
+    retired->epoch = atomic_fetch_add(&registry->epoch, 1) + 1;
+    retired->next = registry->retired;
+    registry->retired = retired;
+}
+
+
+int registryPublish(KbRegistry* registry, KnowledgeBase* kb, double now) {
+    KbSnapshot* old = atomic_load(&registry->current);
+    KnowledgeBase* dropped[KB_MAX_VERSIONS + 1];
+    RetiredVersion* nodes[KB_MAX_VERSIONS + 2];
+    int dropped_count = 0;
+    KbSnapshot next;
+    
+    memset(&next, 0, sizeof(next));
+    if (kb != NULL) {
+        next.kbs[0] = kb;
+        next.count = 1;
+    }
+    for (int i = 0; i < old->count; i++) {
+        double superseded = i == 0 ? now : old->superseded[i];
+        int expired = (i > 0 || kb != NULL) && now - superseded > KB_RETAIN_MS;
+        int replaced = kb != NULL && old->kbs[i]->version == kb->version;
+        if (next.count == KB_MAX_VERSIONS || expired || replaced) {
+            dropped[dropped_count++] = old->kbs[i];
+            continue;
+        }
+        next.kbs[next.count] = old->kbs[i];
+        next.superseded[next.count] = kb != NULL || i > 0 ? superseded : 0.0;
+        next.count++;
+    }
+    if (kb == NULL && dropped_count == 0) {
+        return 1;
+    }
+    
+    KbSnapshot* snapshot = (KbSnapshot*)trackedMalloc(sizeof(KbSnapshot));
+    int reserved = 0;
+    while (snapshot != NULL && reserved <= dropped_count
+           && (nodes[reserved] = (RetiredVersion*)trackedMalloc(sizeof(RetiredVersion))) != NULL) {
+        reserved++;
+    }
+    if (snapshot == NULL || reserved <= dropped_count) {
+        while (reserved > 0) {
+            free(nodes[--reserved]);
+        }
+        free(snapshot);
+        return 0;
+    }
+    *snapshot = next;
+    atomic_store(&registry->current, snapshot);
+    
+    retireVersion(registry, nodes[0], old, NULL);
+    for (int i = 0; i < dropped_count; i++) {
+        retireVersion(registry, nodes[i + 1], NULL, dropped[i]);
+    }
+    if (kb != NULL) {
+        registry->reloads++;
+    }
+    return 1;
+}
+
+
+int registryReclaim(KbRegistry* registry) {
+    uint64_t oldest = UINT64_MAX;
+    int freed = 0;
+    
+    for (int i = 0; i < registry->reader_count; i++) {
+        uint64_t epoch = atomic_load(&registry->readers[i].epoch);
+        if (epoch != 0 && epoch < oldest) {
+            oldest = epoch;
+        }
+    }
+    
+    RetiredVersion** link = &registry->retired;
+    while (*link != NULL) {
+        RetiredVersion* retired = *link;
+        if (retired->epoch > oldest) {
+            link = &retired->next;
+            continue;
+        }
+        *link = retired->next;
+        free(retired->snapshot);
+        if (retired->kb != NULL) {
+            releaseKnowledgeBase(retired->kb);
+            freed++;
+        }
+        free(retired);
+    }
+    return freed;
+}
+
+
+void registryRelease(KbRegistry* registry) {
+    KbSnapshot* snapshot = atomic_load(&registry->current);
+    
+    for (int i = 0; i < registry->reader_count; i++) {
+        atomic_store(&registry->readers[i].epoch, 0);
+    }
+    registryReclaim(registry);
+    for (int i = 0; i < snapshot->count; i++) {
+        releaseKnowledgeBase(snapshot->kbs[i]);
+    }
+    free(snapshot);
+    free(registry->readers);
+}
+
+
+void reloadKnowledgeBase(HttpServer* server) {
+    double start = monotonicMs();
+    KnowledgeBase* kb = openKnowledgeBase(server->kb_path, KB_OPEN_RENDER | KB_OPEN_SEARCH);
+    
+    if (kb == NULL) {
+        fprintf(stderr, "\033[31mReload failed; still serving the previous knowledge base\033[0m\n");
+        return;
+    }
+    if (!enableMetrics(kb, server->registry.reader_count)) {
+        fprintf(stderr, "\033[31mReload failed: out of memory\033[0m\n");
+        releaseKnowledgeBase(kb);
+        return;
+    }
+    const KbSnapshot* current = atomic_load(&server->registry.current);
+    for (int i = 0; i < current->count; i++) {
+        inheritMetrics(kb, current->kbs[i]);
+    }
+    if (!registryPublish(&server->registry, kb, monotonicMs())) {
+        fprintf(stderr, "\033[31mReload failed: out of memory\033[0m\n");
+        releaseKnowledgeBase(kb);
+        return;
+    }
+    printf("Reloaded knowledge base %08x in %.2f ms (%d versions live)\n", kb->version,
+           monotonicMs() - start, atomic_load(&server->registry.current)->count);
+    fflush(stdout);
+}
+
+
+const char* contentType(const char* name) {
+    const char* dot = strrchr(name, '.');
+    if (dot == NULL) {
+        return "application/octet-stream";
+    }
+    if (strcmp(dot, ".html") == 0) return "text/html; charset=utf-8";
+    if (strcmp(dot, ".js") == 0) return "text/javascript; charset=utf-8";
+    if (strcmp(dot, ".css") == 0) return "text/css; charset=utf-8";
+    if (strcmp(dot, ".json") == 0) return "application/json";
+    if (strcmp(dot, ".svg") == 0) return "image/svg+xml";
+    if (strcmp(dot, ".png") == 0) return "image/png";
+    if (strcmp(dot, ".ico") == 0) return "image/x-icon";
+    return "application/octet-stream";
+}
+
+
+int loadStaticFiles(HttpServer* server, const char* root) {
+    DIR* dir = opendir(root);
+    struct dirent* entry;
+    int capacity = 16;
+    
+    server->files = (StaticFile*)trackedMalloc(capacity * sizeof(StaticFile));
+    server->file_count = 0;
+    if (dir == NULL || server->files == NULL) {
+        if (dir != NULL) {
+            closedir(dir);
+        }
+        return 0;
+    }
+    
+    while ((entry = readdir(dir)) != NULL) {
+        char full_path[1024];
+        struct stat info;
+        if (entry->d_name[0] == '.' || strlen(entry->d_name) >= sizeof(server->files[0].path) - 1) {
+            continue;
+        }
+        snprintf(full_path, sizeof(full_path), "%s/%s", root, entry->d_name);
+        if (stat(full_path, &info) != 0 || !S_ISREG(info.st_mode)) {
+            continue;
+        }
+    
+        if (server->file_count == capacity) {
+            StaticFile* grown = (StaticFile*)realloc(server->files, capacity * 2 * sizeof(StaticFile));
+            if (grown == NULL) {
+                break;
+            }
+            server->files = grown;
+            capacity *= 2;
+        }
+    
+        FILE* input = fopen(full_path, "rb");
+        StaticFile* file = &server->files[server->file_count];
+        file->data = (char*)trackedMalloc(info.st_size > 0 ? (size_t)info.st_size : 1);
+        if (input == NULL || file->data == NULL
+            || fread(file->data, 1, (size_t)info.st_size, input) != (size_t)info.st_size) {
+            if (input != NULL) {
+                fclose(input);
+            }
+            free(file->data);
+            continue;
+        }
+        fclose(input);
+        snprintf(file->path, sizeof(file->path), "/%s", entry->d_name);
+        file->content_type = contentType(entry->d_name);
+        file->length = (size_t)info.st_size;
+        server->file_count++;
+    }
+    
+    closedir(dir);
+    return 1;
+}
+
+
+void releaseStaticFiles(HttpServer* server) {
+    for (int i = 0; i < server->file_count; i++) {
+        free(server->files[i].data);
+    }
+    free(server->files);
+    server->files = NULL;
+    server->file_count = 0;
+}
+
+
+int httpListen(int port) {
+    struct sockaddr_in address;
+    int enable = 1;
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons((uint16_t)port);
+    if (bind(fd, (struct sockaddr*)&address, sizeof(address)) != 0 || listen(fd, SOMAXCONN) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+
+void httpRespond(HttpConnection* conn, int status, const char* content_type, const char* body, size_t length) {
+    const char* reason;
+    switch (status) {
+        case 200: reason = "OK"; break;
+        case 201: reason = "Created"; break;
+        case 202: reason = "Accepted"; break;
+        case 400: reason = "Bad Request"; break;
+        case 404: reason = "Not Found"; break;
+        case 405: reason = "Method Not Allowed"; break;
+        case 409: reason = "Conflict"; break;
+        case 413: reason = "Payload Too Large"; break;
+        case 503: reason = "Service Unavailable"; break;
+        default:  reason = "Internal Server Error"; break;
+    }
+    
+    int head_length = snprintf(conn->head, sizeof(conn->head),
+                               "HTTP/1.1 %d %s\r\nContent-Type: %s\r\nContent-Length: %zu\r\n"
+                               "Cache-Control: no-store\r\nConnection: %s\r\n\r\n",
+                               status, reason, content_type, length,
+                               conn->keep_alive ? "keep-alive" : "close");
+    conn->out[0].iov_base = conn->head;
+    conn->out[0].iov_len = (size_t)head_length;
+    conn->out[1].iov_base = (void*)body;
+    conn->out[1].iov_len = length;
+    conn->out_count = length > 0 ? 2 : 1;
+}
+
+
+void httpRespondJson(HttpConnection* conn, int status) {
+    if (conn->body.failed) {
+        conn->body.failed = 0;
+        conn->body.used = 0;
+        conn->keep_alive = 0;
+        httpRespond(conn, 500, "application/json", "{\"error\":\"out of memory\"}\n", 26);
+        return;
+    }
+    httpRespond(conn, status, "application/json", conn->body.data, conn->body.used);
+}
+
+
+void httpError(HttpConnection* conn, int status, const char* message) {
+    conn->body.used = 0;
+    textAppendString(&conn->body, "{\"error\":");
+    textAppendJson(&conn->body, message);
+    textAppendString(&conn->body, "}\n");
+    httpRespondJson(conn, status);
+}
+
+
+void appendSessionState(TextBuffer* out, const Session* state) {
+    const KnowledgeBase* kb = state->kb;
+    char text[TOKEN_MAX_TEXT + 96];
+    char token[TOKEN_MAX_TEXT + 1];
+    
+    encodeSessionToken(state, token);
+    snprintf(text, sizeof(text), "{\"session\":\"%s\",\"asked\":%d,", token, state->questions_asked);
+    textAppendString(out, text);
+    if (!sessionFinished(state)) {
+        snprintf(text, sizeof(text), "\"finished\":false,\"question_id\":%u,\"question\":",
+                 kb->flat[state->node].question);
+        textAppendString(out, text);
+        textAppendJson(out, sessionQuestion(state));
+    } else {
+        const Diagnosis* diag = sessionDiagnosis(state);
+        snprintf(text, sizeof(text), "\"finished\":true,\"diagnosis\":%u,\"severity\":\"%s\",\"condition\":",
+                 kb->flat[state->node].payload, severityName(diag->severity));
+        textAppendString(out, text);
+        textAppendJson(out, kbText(kb, diag->condition));
+    }
+    textAppendString(out, "}\n");
+}
+
+
+int appendKbChunk(TextBuffer* out, const KnowledgeBase* kb, uint32_t root) {
+    uint32_t stack[KB_CHUNK_MAX_NODES];
+    uint8_t depth[KB_CHUNK_MAX_NODES];
+    uint32_t emitted[KB_CHUNK_MAX_NODES];
+    uint32_t diagnoses[KB_CHUNK_MAX_NODES];
+    int top = 0, emitted_count = 0, diagnosis_count = 0;
+    char text[128];
+    
+    if (root >= kb->node_count) {
+        return 0;
+    }
+    snprintf(text, sizeof(text), "{\"version\":\"%08x\",\"max_depth\":%u,\"root\":%u,\"nodes\":{",
+             kb->version, kb->max_depth, root);
+    textAppendString(out, text);
+    stack[top] = root;
+    depth[top++] = 0;
+    while (top > 0) {
+        uint32_t node = stack[--top];
+        int level = depth[top];
+        const FlatNode* flat = &kb->flat[node];
+        int seen = 0;
+        for (int i = 0; i < emitted_count && !seen; i++) {
+            seen = emitted[i] == node;
+        }
+        if (seen || (flat->question != FLAT_LEAF && level == KB_CHUNK_DEPTH)) {
+            continue;
+        }
+        snprintf(text, sizeof(text), "%s\"%u\":", emitted_count > 0 ? "," : "", node);
+        textAppendString(out, text);
+        emitted[emitted_count++] = node;
+        if (flat->question == FLAT_LEAF) {
+            snprintf(text, sizeof(text), "%u", flat->payload);
+            textAppendString(out, text);
+            seen = 0;
+            for (int i = 0; i < diagnosis_count && !seen; i++) {
+                seen = diagnoses[i] == flat->payload;
+            }
+            if (!seen) {
+                diagnoses[diagnosis_count++] = flat->payload;
+            }
+            continue;
+        }
+        textAppendString(out, "[");
+        textAppendJson(out, kbText(kb, flat->payload));
+        snprintf(text, sizeof(text), ",%u,%u]", flat->child[1], flat->child[0]);
+        textAppendString(out, text);
+        for (int bit = 0; bit < 2; bit++) {
+            stack[top] = flat->child[bit];
+            depth[top++] = (uint8_t)(level + 1);
+        }
+    }
+    
+    textAppendString(out, "},\"diagnoses\":{");
+    for (int i = 0; i < diagnosis_count; i++) {
+        snprintf(text, sizeof(text), "%s\"%u\":", i > 0 ? "," : "", diagnoses[i]);
+        textAppendString(out, text);
+        renderDiagnosis(kb, &kb->diagnoses[diagnoses[i]], RENDER_JSON, out);
+        if (!out->failed && out->data[out->used - 1] == '\n') {
+            out->used--;
+        }
+    }
+    textAppendString(out, "}}\n");
+    return 1;
+}
+
+
+char answerValue(const char* value, size_t length) {
+    static const char* const yes[] = { "yes", "y", "true", "1" };
+    static const char* const no[] = { "no", "n", "false", "0" };
+    
+    while (length > 0 && isspace((unsigned char)value[length - 1])) {
+        length--;
+    }
+    for (int i = 0; i < 4; i++) {
+        if (length == strlen(yes[i]) && strncasecmp(value, yes[i], length) == 0) {
+            return 'Y';
+        }
+        if (length == strlen(no[i]) && strncasecmp(value, no[i], length) == 0) {
+            return 'N';
+        }
+    }
+    return 0;
+}
+
+
+char parseAnswer(const char* body, size_t length) {
+    const char* end = body + length;
+    const char* cursor = body;
+    
+    while (cursor < end && isspace((unsigned char)*cursor)) {
+        cursor++;
+    }
+    if (cursor < end && *cursor == '{') {
+        for (const char* key = cursor; key + 8 <= end; key++) {
+            if (memcmp(key, "\"answer\"", 8) != 0) {
+                continue;
+            }
+            const char* value = key + 8;
+            while (value < end && isspace((unsigned char)*value)) {
+                value++;
+            }
+            if (value == end || *value != ':') {
+                continue;
+            }
+            value++;
+            while (value < end && isspace((unsigned char)*value)) {
+                value++;
+            }
+            if (value < end && *value == '"') {
+                const char* close = (const char*)memchr(value + 1, '"', (size_t)(end - value - 1));
+                return close != NULL ? answerValue(value + 1, (size_t)(close - value - 1)) : 0;
+            }
+            const char* stop = value;
+            while (stop < end && isalnum((unsigned char)*stop)) {
+                stop++;
+            }
+            return answerValue(value, (size_t)(stop - value));
+        }
+        return 0;
+    }
+    
+    while (cursor < end) {
+        const char* pair_end = (const char*)memchr(cursor, '&', (size_t)(end - cursor));
+        if (pair_end == NULL) {
+            pair_end = end;
+        }
+        if (pair_end - cursor >= 7 && memcmp(cursor, "answer=", 7) == 0) {
+            return answerValue(cursor + 7, (size_t)(pair_end - cursor - 7));
+        }
+        cursor = pair_end < end ? pair_end + 1 : end;
+    }
+    return 0;
+}
+
+
+int queryParameter(const char* query, const char* name, char* out, size_t size) {
+    size_t name_length = strlen(name);
+    
+    while (*query != '\0') {
+        const char* end = strchr(query, '&');
+        if (end == NULL) {
+            end = query + strlen(query);
+        }
+        if ((size_t)(end - query) > name_length && strncmp(query, name, name_length) == 0 && query[name_length] == '=') {
+            size_t length = 0;
+            for (const char* p = query + name_length + 1; p < end; p++) {
+                char c = *p;
+                if (c == '+') {
+                    c = ' ';
+                } else if (c == '%' && end - p > 2 && isxdigit((unsigned char)p[1]) && isxdigit((unsigned char)p[2])) {
+                    char hex[3] = { p[1], p[2], '\0' };
+                    c = (char)strtol(hex, NULL, 16);
+                    p += 2;
+                }
+                if (length + 1 < size) {
+                    out[length++] = c;
+                }
+            }
+            out[length] = '\0';
+            return 1;
+        }
+        query = *end == '&' ? end + 1 : end;
+    }
+    return 0;
+}
+
+
+void handleSearch(const KnowledgeBase* kb, HttpConnection* conn, HttpRequest* request) {
+    char query[512];
+    char text[128];
+    SearchResult result;
+    long limit = SEARCH_DEFAULT_LIMIT;
+    
+    if (!queryParameter(request->query, "q", query, sizeof(query))) {
+        httpError(conn, 400, "expected a q parameter");
+        return;
+    }
+    if (queryParameter(request->query, "limit", text, sizeof(text))) {
+        limit = strtol(text, NULL, 10);
+        if (limit <= 0) {
+            httpError(conn, 400, "limit must be a positive number");
+            return;
+        }
+    }
+    if (!searchKnowledgeBase(kb, query, &result)) {
+        httpError(conn, 500, "out of memory");
+        return;
+    }
+    if (result.terms == 0) {
+        httpError(conn, 400, "query has no searchable terms");
+        return;
+    }
+    
+    snprintf(text, sizeof(text), "{\"version\":\"%08x\",\"query\":", kb->version);
+    textAppendString(&conn->body, text);
+    textAppendJson(&conn->body, query);
+    snprintf(text, sizeof(text), ",\"count\":%u,\"results\":[", result.count);
+    textAppendString(&conn->body, text);
+    for (uint32_t i = 0; i < result.count && i < (unsigned long)limit; i++) {
+        const Diagnosis* diag = &kb->diagnoses[result.diagnoses[i]];
+        snprintf(text, sizeof(text), "%s{\"diagnosis\":%u,\"condition\":", i > 0 ? "," : "", result.diagnoses[i]);
+        textAppendString(&conn->body, text);
+        textAppendJson(&conn->body, kbText(kb, diag->condition));
+        snprintf(text, sizeof(text), ",\"severity\":\"%s\",\"fields\":[", severityName(diag->severity));
+        textAppendString(&conn->body, text);
+        const char* separator = "";
+        for (int f = 0; f < SEARCH_FIELDS; f++) {
+            if (result.fields[i] & (1u << f)) {
+                textAppendString(&conn->body, separator);
+                textAppendJson(&conn->body, searchFieldName(f));
+                separator = ",";
+            }
+        }
+        textAppendString(&conn->body, "]}");
+    }
+    textAppendString(&conn->body, "]}\n");
+    releaseSearchResult(&result);
+    httpRespondJson(conn, 200);
+}
+
+
+void handleFacilities(const FacilityIndex* index, HttpConnection* conn, HttpRequest* request) {
+    FacilityMatch matches[FACILITY_MAX_RESULTS];
+    char lat_text[64], lon_text[64];
+    char text[128];
+    double radius_km = 0;
+    long limit = FACILITY_DEFAULT_RESULTS;
+    char* end;
+    
+    if (strcmp(request->method, "GET") != 0) {
+        httpError(conn, 405, "use GET");
+        return;
+    }
+    if (index == NULL) {
+        httpError(conn, 404, "no facility index loaded (start the server with --facilities FILE)");
+        return;
+    }
+    if (!queryParameter(request->query, "lat", lat_text, sizeof(lat_text))
+        || !queryParameter(request->query, "lon", lon_text, sizeof(lon_text))) {
+        httpError(conn, 400, "expected lat and lon parameters");
+        return;
+    }
+    double lat = strtod(lat_text, &end);
+    int valid = *end == '\0' && lat >= -90.0 && lat <= 90.0;
+    double lon = strtod(lon_text, &end);
+    valid = valid && *end == '\0' && lon >= -180.0 && lon <= 180.0;
+    if (!valid) {
+        httpError(conn, 400, "lat and lon must be decimal degrees");
+        return;
+    }
+    if (queryParameter(request->query, "limit", text, sizeof(text))) {
+        limit = strtol(text, NULL, 10);
+        if (limit <= 0) {
+            httpError(conn, 400, "limit must be a positive number");
+            return;
+        }
+    }
+    if (queryParameter(request->query, "radius", text, sizeof(text))) {
+        radius_km = strtod(text, NULL);
+        if (!(radius_km > 0)) {
+            httpError(conn, 400, "radius must be a positive number of kilometres");
+            return;
+        }
+    }
+    
+    conn->body.used = 0;
+    int count = findFacilities(index, lat, lon, radius_km, limit < FACILITY_MAX_RESULTS ? (int)limit
+                                                                                       : FACILITY_MAX_RESULTS, matches);
+    snprintf(text, sizeof(text), "{\"count\":%d,\"facilities\":[", count);
+    textAppendString(&conn->body, text);
+    for (int i = 0; i < count; i++) {
+        const Facility* facility = &index->facilities[matches[i].facility];
+        const uint32_t optional[2] = { facility->phone, facility->website };
+        static const char* const optional_names[2] = { "phone", "website" };
+        textAppendString(&conn->body, i > 0 ? ",{\"name\":" : "{\"name\":");
+        textAppendJson(&conn->body, facilityText(index, facility->name));
+        textAppendString(&conn->body, ",\"amenity\":");
+        textAppendJson(&conn->body, facilityText(index, facility->amenity));
+        textAppendString(&conn->body, ",\"address\":");
+        textAppendJson(&conn->body, facilityText(index, facility->address));
+        snprintf(text, sizeof(text), ",\"lat\":%.7g,\"lon\":%.7g,\"distance_km\":%.4f", facility->lat,
+                 facility->lon, matches[i].distance_km);
+        textAppendString(&conn->body, text);
+        for (int f = 0; f < 2; f++) {
+            snprintf(text, sizeof(text), ",\"%s\":", optional_names[f]);
+            textAppendString(&conn->body, text);
+            if (optional[f] == 0) {
+                textAppendString(&conn->body, "null");
+            } else {
+                textAppendJson(&conn->body, facilityText(index, optional[f]));
+            }
+        }
+        textAppendString(&conn->body, "}");
+    }
+    textAppendString(&conn->body, "]}\n");
+    httpRespondJson(conn, 200);
+}
+
+
+void handleApi(const KbSnapshot* snapshot, HttpConnection* conn, HttpRequest* request, int shard, Journal* journal) {
+    const KnowledgeBase* kb = snapshot->kbs[0];
+    const char* path = request->path + 4;
+    int is_get = strcmp(request->method, "GET") == 0;
+    int is_post = strcmp(request->method, "POST") == 0;
+    Session state;
+    
+    conn->body.used = 0;
+    if (strcmp(path, "/kb") == 0) {
+        char text[256];
+        if (!is_get) {
+            httpError(conn, 405, "use GET");
+            return;
+        }
+        snprintf(text, sizeof(text),
+                 "{\"version\":\"%08x\",\"nodes\":%u,\"questions\":%u,\"diagnoses\":%u,"
+                 "\"max_depth\":%u,\"expected_depth\":%.3f,\"live_versions\":[",
+                 kb->version, kb->node_count, kb->question_count, kb->diagnosis_count,
+                 kb->max_depth, kb->expected_depth);
+        textAppendString(&conn->body, text);
+        for (int i = 0; i < snapshot->count; i++) {
+            snprintf(text, sizeof(text), "%s\"%08x\"", i > 0 ? "," : "", snapshot->kbs[i]->version);
+            textAppendString(&conn->body, text);
+        }
+        textAppendString(&conn->body, "]}\n");
+        httpRespondJson(conn, 200);
+        return;
+    }
+    
+    if (strncmp(path, "/kb/chunks/", 11) == 0) {
+        char version[16];
+        char* end;
+        unsigned long root = strtoul(path + 11, &end, 10);
+        if (!is_get) {
+            httpError(conn, 405, "use GET");
+            return;
+        }
+        if (queryParameter(request->query, "version", version, sizeof(version))) {
+            uint32_t wanted = (uint32_t)strtoul(version, NULL, 16);
+            kb = NULL;
+            for (int i = 0; i < snapshot->count && kb == NULL; i++) {
+                kb = snapshot->kbs[i]->version == wanted ? snapshot->kbs[i] : NULL;
+            }
+            if (kb == NULL) {
+                httpError(conn, 409, "knowledge base version is no longer live");
+                return;
+            }
+        }
+        if (end == path + 11 || *end != '\0' || root >= kb->node_count) {
+            httpError(conn, 404, "no such node");
+            return;
+        }
+        appendKbChunk(&conn->body, kb, (uint32_t)root);
+        httpRespondJson(conn, 200);
+        return;
+    }
+    
+    if (strcmp(path, "/search") == 0) {
+        if (!is_get) {
+            httpError(conn, 405, "use GET");
+            return;
+        }
+        handleSearch(kb, conn, request);
+        return;
+    }
+    
+    if (strcmp(path, "/reload") == 0) {
+        if (!is_post) {
+            httpError(conn, 405, "use POST");
+            return;
+        }
+        atomic_store(&g_reload_requested, 1);
+        textAppendString(&conn->body, "{\"reload\":\"scheduled\"}\n");
+        httpRespondJson(conn, 202);
+        return;
+    }
+    
+    if (strcmp(path, "/sessions") == 0) {
+        if (!is_post) {
+            httpError(conn, 405, "use POST");
+            return;
+        }
+        startSession(&state, kb);
+        recordVisit(kb, shard, state.node);
+        appendSessionState(&conn->body, &state);
+        httpRespondJson(conn, 201);
+        return;
+    }
+    
+    if (strncmp(path, "/sessions/", 10) != 0) {
+        httpError(conn, 404, "unknown endpoint");
+        return;
+    }
+    const char* token = path + 10;
+    const char* tail = strchr(token, '/');
+    if (tail == NULL) {
+        tail = token + strlen(token);
+    }
+    
+    char response = 0;
+    if (strcmp(tail, "/answer") == 0) {
+        if (!is_post) {
+            httpError(conn, 405, "use POST");
+            return;
+        }
+        response = parseAnswer(request->body, request->body_length);
+        if (response == 0) {
+            httpError(conn, 400, "expected an answer field of yes or no");
+            return;
+        }
+    } else if ((*tail != '\0' && strcmp(tail, "/diagnosis") != 0) || !is_get) {
+        httpError(conn, *tail == '\0' || strcmp(tail, "/diagnosis") == 0 ? 405 : 404, "unknown endpoint");
+        return;
+    }
+    
+    double started = monotonicMs();
+    TokenStatus status = TOKEN_STALE;
+    for (int i = 0; i < snapshot->count && status == TOKEN_STALE; i++) {
+        kb = snapshot->kbs[i];
+        status = decodeSessionToken(kb, token, (size_t)(tail - token), &state);
+    }
+    if (status != TOKEN_VALID) {
+        httpError(conn, status == TOKEN_STALE ? 409 : 400, tokenStatusMessage(status));
+        return;
+    }
+    
+    if (strcmp(tail, "/diagnosis") == 0) {
+        size_t length;
+        const char* output = sessionFinished(&state)
+            ? diagnosisOutput(kb, kb->flat[state.node].payload, RENDER_JSON, &length) : NULL;
+        if (output == NULL) {
+            httpError(conn, 409, "session has not reached a diagnosis");
+            return;
+        }
+        httpRespond(conn, 200, "application/json", output, length);
+        conn->borrowed = 1;
+        return;
+    }
+    
+    if (response != 0 && !sessionFinished(&state)) {
+        if (state.questions_asked >= TOKEN_MAX_ANSWERS) {
+            httpError(conn, 400, "session is too deep for a token");
+            return;
+        }
+        uint32_t node = state.node;
+        sessionAnswer(&state, response);
+        recordAnswer(kb, shard, node, response, monotonicMs() - started);
+        recordVisit(kb, shard, state.node);
+        if (sessionFinished(&state)) {
+            appendJournal(journal, &state, JOURNAL_API);
+        }
+    }
+    appendSessionState(&conn->body, &state);
+    httpRespondJson(conn, 200);
+}
+
+
+void handleRequest(HttpServer* server, const KbSnapshot* snapshot, HttpConnection* conn, HttpRequest* request,
+                   int shard) {
+    if (strcmp(request->path, "/api/facilities") == 0) {
+        handleFacilities(server->facilities, conn, request);
+        return;
+    }
+    if (strncmp(request->path, "/api/", 5) == 0) {
+        handleApi(snapshot, conn, request, shard, server->journal);
+        return;
+    }
+    if (strcmp(request->path, "/metrics") == 0 && strcmp(request->method, "GET") == 0) {
+        conn->body.used = 0;
+        exportMetrics((const KnowledgeBase* const*)snapshot->kbs, snapshot->count, &conn->body);
+        if (conn->body.failed) {
+            httpRespondJson(conn, 500);
+            return;
+        }
+        httpRespond(conn, 200, "text/plain; version=0.0.4", conn->body.data, conn->body.used);
+        return;
+    }
+    
+    if (strcmp(request->method, "GET") != 0) {
+        httpError(conn, 405, "use GET");
+        return;
+    }
+    
+    const char* path = strcmp(request->path, "/") == 0 ? "/index.html" : request->path;
+    for (int i = 0; i < server->file_count; i++) {
+        if (strcmp(server->files[i].path, path) == 0) {
+            httpRespond(conn, 200, server->files[i].content_type, server->files[i].data, server->files[i].length);
+            return;
+        }
+    }
+    httpError(conn, 404, "not found");
+}
+
+
+int parseRequest(HttpConnection* conn, HttpRequest* request, size_t* consumed) {
+    char* in = conn->in;
+    char* end = NULL;
+    size_t content_length = 0;
+    int keep_alive;
+    
+    for (size_t i = 3; i < conn->in_used; i++) {
+        if (in[i] == '\n' && in[i - 1] == '\r' && in[i - 2] == '\n' && in[i - 3] == '\r') {
+            end = in + i + 1;
+            break;
+        }
+    }
+    if (end == NULL) {
+        return conn->in_used == HTTP_REQUEST_MAX ? -2 : 0;
+    }
+    
+    char* line_end = memchr(in, '\r', end - in);
+    char* method_end = memchr(in, ' ', line_end - in);
+    char* path_end = method_end != NULL ? memchr(method_end + 1, ' ', line_end - method_end - 1) : NULL;
+    if (method_end == NULL || path_end == NULL || method_end[1] != '/') {
+        return -1;
+    }
+    keep_alive = line_end - path_end - 1 == 8 && memcmp(path_end + 1, "HTTP/1.1", 8) == 0;
+    
+    for (char* line = line_end + 2; line < end - 2; ) {
+        char* next = memchr(line, '\r', end - line);
+        size_t length = next - line;
+        if (length > 15 && strncasecmp(line, "Content-Length:", 15) == 0) {
+            content_length = strtoul(line + 15, NULL, 10);
+        } else if (length > 11 && strncasecmp(line, "Connection:", 11) == 0) {
+            char* value = line + 11;
+            while (*value == ' ') {
+                value++;
+            }
+            if (strncasecmp(value, "close", 5) == 0) {
+                keep_alive = 0;
+            } else if (strncasecmp(value, "keep-alive", 10) == 0) {
+                keep_alive = 1;
+            }
+        }
+        line = next + 2;
+    }
+    
+    if ((size_t)(end - in) + content_length > HTTP_REQUEST_MAX) {
+        return -2;
+    }
+    if ((size_t)(end - in) + content_length > conn->in_used) {
+        return 0;
+    }
+    
+    *method_end = '\0';
+    *path_end = '\0';
+    char* query = strchr(method_end + 1, '?');
+    if (query != NULL) {
+        *query++ = '\0';
+    }
+    request->method = in;
+    request->path = method_end + 1;
+    request->query = query != NULL ? query : "";
+    request->body = end;
+    request->body_length = content_length;
+    conn->keep_alive = keep_alive;
+    *consumed = (size_t)(end - in) + content_length;
+    return 1;
+}
+
+
+int flushConnection(HttpConnection* conn) {
+    while (conn->out_count > 0) {
+        struct iovec* out = conn->out[0].iov_len > 0 ? conn->out : conn->out + 1;
+        int count = out == conn->out ? conn->out_count : 1;
+        ssize_t written = writev(conn->fd, out, count);
+        if (written < 0) {
+            return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+        }
+    
+        for (int i = 0; i < count && written >= 0; i++) {
+            size_t step = (size_t)written < out[i].iov_len ? (size_t)written : out[i].iov_len;
+            out[i].iov_base = (char*)out[i].iov_base + step;
+            out[i].iov_len -= step;
+            written -= (ssize_t)step;
+        }
+        if (conn->out[0].iov_len == 0 && (conn->out_count == 1 || conn->out[1].iov_len == 0)) {
+            conn->out_count = 0;
+        }
+    }
+    return 1;
+}
+
+
+void closeConnection(HttpWorker* worker, HttpConnection* conn) {
+    epoll_ctl(worker->epoll_fd, EPOLL_CTL_DEL, conn->fd, NULL);
+    close(conn->fd);
+    if (conn->prev != NULL) {
+        conn->prev->next = conn->next;
+    } else {
+        worker->connections = conn->next;
+    }
+    if (conn->next != NULL) {
+        conn->next->prev = conn->prev;
+    }
+    free(conn->body.data);
+    free(conn);
+}
+
+
+void acceptConnections(HttpWorker* worker) {
+    while (1) {
+        int fd = accept(worker->server->listen_fd, NULL, NULL);
+        if (fd < 0) {
+            return;
+        }
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+    
+        int enable = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+        HttpConnection* conn = (HttpConnection*)trackedMalloc(sizeof(HttpConnection));
+        if (conn == NULL) {
+            close(fd);
+            continue;
+        }
+    
+        memset(conn, 0, offsetof(HttpConnection, in));
+        conn->fd = fd;
+        struct epoll_event event = { EPOLLIN | EPOLLRDHUP, { .ptr = conn } };
+        if (epoll_ctl(worker->epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0) {
+            close(fd);
+            free(conn);
+            continue;
+        }
+        conn->next = worker->connections;
+        if (conn->next != NULL) {
+            conn->next->prev = conn;
+        }
+        worker->connections = conn;
+    }
+}
+
+
+void serviceConnection(HttpWorker* worker, HttpConnection* conn, uint32_t events) {
+    if (events & EPOLLERR) {
+        closeConnection(worker, conn);
+        return;
+    }
+    
+    if (events & EPOLLIN) {
+        ssize_t received = read(conn->fd, conn->in + conn->in_used, HTTP_REQUEST_MAX - conn->in_used);
+        if (received == 0 || (received < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+            closeConnection(worker, conn);
+            return;
+        }
+        if (received > 0) {
+            conn->in_used += (size_t)received;
+        }
+    }
+    
+    while (1) {
+        if (conn->out_count > 0) {
+            int flushed = flushConnection(conn);
+            if (flushed < 0 || (flushed > 0 && !conn->keep_alive)) {
+                closeConnection(worker, conn);
+                return;
+            }
+            if (flushed == 0) {
+                if (!conn->want_write) {
+                    struct epoll_event event = { EPOLLOUT | EPOLLRDHUP, { .ptr = conn } };
+                    epoll_ctl(worker->epoll_fd, EPOLL_CTL_MOD, conn->fd, &event);
+                    conn->want_write = 1;
+                }
+                return;
+            }
+        }
+    
+        HttpRequest request;
+        size_t consumed = 0;
+        int parsed = parseRequest(conn, &request, &consumed);
+        if (parsed == 0) {
+            break;
+        }
+        if (parsed < 0) {
+            conn->keep_alive = 0;
+            conn->in_used = 0;
+            httpError(conn, parsed == -1 ? 400 : 413, parsed == -1 ? "malformed request" : "request too large");
+            continue;
+        }
+    
+        const KbSnapshot* snapshot = registryPin(&worker->server->registry, worker->reader);
+        handleRequest(worker->server, snapshot, conn, &request, worker->reader);
+        int flushed = 1;
+        if (conn->borrowed) {
+            flushed = flushConnection(conn);
+            if (flushed == 0) {
+                conn->body.used = 0;
+                textAppend(&conn->body, conn->out[1].iov_base, conn->out[1].iov_len);
+                conn->out[1].iov_base = conn->body.data;
+                flushed = conn->body.failed ? -1 : 1;
+            }
+            conn->borrowed = 0;
+        }
+        registryUnpin(&worker->server->registry, worker->reader);
+        if (flushed < 0) {
+            closeConnection(worker, conn);
+            return;
+        }
+        memmove(conn->in, conn->in + consumed, conn->in_used - consumed);
+        conn->in_used -= consumed;
+    }
+    
+    if (conn->want_write) {
+        struct epoll_event event = { EPOLLIN | EPOLLRDHUP, { .ptr = conn } };
+        epoll_ctl(worker->epoll_fd, EPOLL_CTL_MOD, conn->fd, &event);
+        conn->want_write = 0;
+    }
+    if ((events & (EPOLLHUP | EPOLLRDHUP)) && conn->out_count == 0) {
+        closeConnection(worker, conn);
+    }
+}
+
+
+void* httpWorkerMain(void* arg) {
+    HttpWorker* worker = (HttpWorker*)arg;
+    struct epoll_event events[HTTP_MAX_EVENTS];
+    
+    while (!atomic_load(&g_server_stopping)) {
+        int count = epoll_wait(worker->epoll_fd, events, HTTP_MAX_EVENTS, 250);
+        for (int i = 0; i < count; i++) {
+            if (events[i].data.ptr == NULL) {
+                acceptConnections(worker);
+            } else {
+                serviceConnection(worker, (HttpConnection*)events[i].data.ptr, events[i].events);
+            }
+        }
+    }
+    
+    while (worker->connections != NULL) {
+        closeConnection(worker, worker->connections);
+    }
+    return NULL;
+}
+
+
+int runServer(KnowledgeBase* kb, const char* kb_path, int port, int threads, const char* root, Journal* journal,
+              const FacilityIndex* facilities) {
+    HttpServer server;
+    HttpWorker* workers;
+    struct sigaction action;
+    int started = 0;
+    
+    memset(&server, 0, sizeof(server));
+    server.kb_path = kb_path;
+    server.journal = journal;
+    server.facilities = facilities;
+    if (!enableMetrics(kb, threads) || !registryInit(&server.registry, kb, threads)) {
+        fprintf(stderr, "Memory allocation failed!\n");
+        releaseKnowledgeBase(kb);
+        return 1;
+    }
+    if (!loadStaticFiles(&server, root)) {
+        fprintf(stderr, "Cannot read static files from %s\n", root);
+        releaseStaticFiles(&server);
+        registryRelease(&server.registry);
+        return 1;
+    }
+    int key = loadTokenKey();
+    if (key < 0) {
+        fprintf(stderr, "Cannot read /dev/urandom for a session token key; set HEALTH_CHECKER_TOKEN_KEY "
+                        "(32 hex digits)\n");
+        releaseStaticFiles(&server);
+        registryRelease(&server.registry);
+        return 1;
+    }
+    if (key == 0) {
+        fprintf(stderr, "HEALTH_CHECKER_TOKEN_KEY is not set (32 hex digits); "
+                        "session tokens will only be valid in this process\n");
+    }
+    server.listen_fd = httpListen(port);
+    workers = (HttpWorker*)trackedMalloc(threads * sizeof(HttpWorker));
+    if (server.listen_fd < 0 || workers == NULL) {
+        fprintf(stderr, "Cannot listen on 127.0.0.1:%d\n", port);
+        if (server.listen_fd >= 0) {
+            close(server.listen_fd);
+        }
+        free(workers);
+        releaseStaticFiles(&server);
+        registryRelease(&server.registry);
+        return 1;
+    }
+    
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = stopServer;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    sigaction(SIGHUP, &action, NULL);
+    signal(SIGPIPE, SIG_IGN);
+    atomic_store(&g_server_stopping, 0);
+    atomic_store(&g_reload_requested, 0);
+    
+    for (; started < threads; started++) {
+        HttpWorker* worker = &workers[started];
+        struct epoll_event event = { EPOLLIN | EPOLLEXCLUSIVE, { .ptr = NULL } };
+        worker->server = &server;
+        worker->reader = started;
+        worker->connections = NULL;
+        worker->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        if (worker->epoll_fd < 0 || epoll_ctl(worker->epoll_fd, EPOLL_CTL_ADD, server.listen_fd, &event) != 0
+            || pthread_create(&worker->thread, NULL, httpWorkerMain, worker) != 0) {
+            if (worker->epoll_fd >= 0) {
+                close(worker->epoll_fd);
+            }
+            atomic_store(&g_server_stopping, 1);
+            break;
+        }
+    }
+    
+    if (!atomic_load(&g_server_stopping)) {
+        printf("Serving %s and the session API on http://127.0.0.1:%d/ with %d workers (%d files, kb %08x)\n",
+               root, port, threads, server.file_count, kb->version);
+        fflush(stdout);
+    }
+    while (!atomic_load(&g_server_stopping)) {
+        struct timespec delay = { 0, 50 * 1000000L };
+        if (atomic_exchange(&g_reload_requested, 0)) {
+            reloadKnowledgeBase(&server);
+        }
+        registryPublish(&server.registry, NULL, monotonicMs());
+        registryReclaim(&server.registry);
+        nanosleep(&delay, NULL);
+    }
+    for (int i = 0; i < started; i++) {
+        pthread_join(workers[i].thread, NULL);
+        close(workers[i].epoll_fd);
+    }
+    
+    close(server.listen_fd);
+    free(workers);
+    releaseStaticFiles(&server);
+    registryRelease(&server.registry);
+    return started == threads ? 0 : 1;
+}
+
+
+static int clientConnect(int port) {
+    struct sockaddr_in address;
+    int enable = 1;
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons((uint16_t)port);
+    if (connect(fd, (struct sockaddr*)&address, sizeof(address)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+
+static int clientRequest(int fd, const char* method, const char* path, const char* body,
+                         char* response, size_t capacity) {
+    char request[768];
+    size_t body_length = body != NULL ? strlen(body) : 0;
+    int length = snprintf(request, sizeof(request),
+                          "%s %s HTTP/1.1\r\nHost: 127.0.0.1\r\nContent-Type: application/json\r\n"
+                          "Content-Length: %zu\r\n\r\n%s",
+                          method, path, body_length, body != NULL ? body : "");
+    if (!writeAll(fd, request, (size_t)length)) {
+        return -1;
+    }
+
+    size_t used = 0;
+    char* head_end = NULL;
+    while (head_end == NULL) {
+        ssize_t received = read(fd, response + used, capacity - 1 - used);
+        if (received <= 0) {
+            return -1;
+        }
+        used += (size_t)received;
+        response[used] = '\0';
+        head_end = strstr(response, "\r\n\r\n");
+        if (head_end == NULL && used == capacity - 1) {
+            return -1;
+        }
+    }
+
+    const char* length_header = strstr(response, "Content-Length: ");
+    size_t content_length = length_header != NULL ? strtoul(length_header + 16, NULL, 10) : 0;
+    size_t total = (size_t)(head_end + 4 - response) + content_length;
+    if (total >= capacity) {
+        return -1;
+    }
+    while (used < total) {
+        ssize_t received = read(fd, response + used, total - used);
+        if (received <= 0) {
+            return -1;
+        }
+        used += (size_t)received;
+    }
+    response[used] = '\0';
+    int status = used > 12 ? atoi(response + 9) : -1;
+    memmove(response, head_end + 4, content_length + 1);
+    return status;
+}
+
+
+static int copySessionToken(const char* response, char* token) {
+    const char* start = strstr(response, "\"session\":\"");
+    const char* end = start != NULL ? strchr(start + 11, '"') : NULL;
+    if (end == NULL || end - start - 11 > TOKEN_MAX_TEXT) {
+        return 0;
+    }
+    memcpy(token, start + 11, end - start - 11);
+    token[end - start - 11] = '\0';
+    return 1;
+}
+
+
+void* clientWorkerMain(void* arg) {
+    ClientWorker* worker = (ClientWorker*)arg;
+    const KnowledgeBase* kb = worker->kb;
+    size_t stride = kb->question_count > 0 ? kb->question_count : 1;
+    char path[TOKEN_MAX_TEXT + 64];
+    char response[16384];
+    int fd = clientConnect(worker->port);
+    char* tokens = (char*)trackedMalloc(worker->sessions * (TOKEN_MAX_TEXT + 1));
+    char* answers = (char*)trackedMalloc(worker->sessions * stride);
+    uint32_t* questions = (uint32_t*)trackedMalloc(worker->sessions * sizeof(uint32_t));
+    int open = 0;
+    
+    if (fd < 0 || tokens == NULL || answers == NULL || questions == NULL) {
+        worker->failures = worker->sessions;
+        goto done;
+    }
+    
+    for (int i = 0; i < worker->sessions; i++) {
+        char* token = tokens + i * (TOKEN_MAX_TEXT + 1);
+        int status = clientRequest(fd, "POST", "/api/sessions", NULL, response, sizeof(response));
+        const char* question = strstr(response, "\"question_id\":");
+        worker->requests++;
+        token[0] = '\0';
+        if (status != 201 || question == NULL || !copySessionToken(response, token)) {
+            worker->failures++;
+            token[0] = '\0';
+            continue;
+        }
+        questions[i] = (uint32_t)strtoul(question + 14, NULL, 10);
+        memset(answers + i * stride, 'N', stride);
+        open++;
+    }
+    
+    while (open > 0) {
+        for (int i = 0; i < worker->sessions; i++) {
+            char* token = tokens + i * (TOKEN_MAX_TEXT + 1);
+            if (token[0] == '\0') {
+                continue;
+            }
+            char answer = scriptedResponse(&worker->seed);
+            char* recorded = answers + i * stride;
+            snprintf(path, sizeof(path), "/api/sessions/%s/answer", token);
+            int status = clientRequest(fd, "POST", path, answer == 'Y' ? "{\"answer\":\"yes\"}" : "{\"answer\":\"no\"}",
+                                       response, sizeof(response));
+            worker->requests++;
+            if (status != 200 || questions[i] >= stride || !copySessionToken(response, token)) {
+                worker->failures++;
+                token[0] = '\0';
+                open--;
+                continue;
+            }
+            recorded[questions[i]] = answer;
+            const char* question = strstr(response, "\"question_id\":");
+            if (question != NULL) {
+                questions[i] = (uint32_t)strtoul(question + 14, NULL, 10);
+                continue;
+            }
+            
+            snprintf(path, sizeof(path), "/api/sessions/%s/diagnosis", token);
+            status = clientRequest(fd, "GET", path, NULL, response, sizeof(response));
+            uint32_t expected = evaluateAnswers(kb, recorded, stride);
+            size_t length;
+            const char* rendered = diagnosisOutput(kb, expected, RENDER_JSON, &length);
+            if (status != 200 || rendered == NULL || strncmp(response, rendered, length) != 0) {
+                worker->mismatches++;
+            }
+            worker->requests++;
+            worker->completed++;
+            token[0] = '\0';
+            open--;
+        }
+    }
+    
+done:
+    if (fd >= 0) {
+        close(fd);
+    }
+    free(tokens);
+    free(answers);
+    free(questions);
+    return NULL;
+}
+
+
+int runClient(const KnowledgeBase* kb, int port, int sessions, int threads) {
+    ClientWorker* workers = (ClientWorker*)trackedMalloc(threads * sizeof(ClientWorker));
+    long requests = 0, completed = 0, mismatches = 0, failures = 0;
+    int started = 0;
+    double start = monotonicMs();
+    
+    if (workers == NULL) {
+        fprintf(stderr, "Memory allocation failed!\n");
+        return 1;
+    }
+    signal(SIGPIPE, SIG_IGN);
+    
+    char response[512];
+    char version[16];
+    int fd = clientConnect(port);
+    int status = fd >= 0 ? clientRequest(fd, "GET", "/api/kb", NULL, response, sizeof(response)) : -1;
+    if (fd >= 0) {
+        close(fd);
+    }
+    snprintf(version, sizeof(version), "\"%08x\"", kb->version);
+    if (status != 200 || strstr(response, version) == NULL) {
+        fprintf(stderr, "Server on port %d is unreachable or serves a different knowledge base than %08x\n",
+                port, kb->version);
+        free(workers);
+        return 1;
+    }
+    
+    for (; started < threads; started++) {
+        ClientWorker* worker = &workers[started];
+        memset(worker, 0, sizeof(ClientWorker));
+        worker->kb = kb;
+        worker->port = port;
+        worker->sessions = sessions / threads + (started < sessions % threads ? 1 : 0);
+        worker->seed = 12345u + (unsigned int)started * 7919u;
+        if (pthread_create(&worker->thread, NULL, clientWorkerMain, worker) != 0) {
+            break;
+        }
+    }
+    for (int i = 0; i < started; i++) {
+        pthread_join(workers[i].thread, NULL);
+        requests += workers[i].requests;
+        completed += workers[i].completed;
+        mismatches += workers[i].mismatches;
+        failures += workers[i].failures;
+    }
+    
+    double seconds = (monotonicMs() - start) / 1000.0;
+    printf("Client: %ld/%d sessions over %d connections (all opened before answering)\n",
+           completed, sessions, started);
+    printf("  %ld requests in %.3f s: %.0f requests/s, %.0f sessions/s\n",
+           requests, seconds, requests / seconds, completed / seconds);
+    printf("  %ld diagnosis mismatches against the local engine, %ld failed requests\n", mismatches, failures);
+    
+    free(workers);
+    return mismatches == 0 && failures == 0 && completed == sessions ? 0 : 1;
+}
+
+
+char* loadBatchInput(const char* path, size_t* length, int* mapped) {
+    FILE* in = stdin;
+    char* text = NULL;
+    size_t capacity = 0;
+    size_t used = 0;
     
-    TreeNode* q17 = createNode(QUESTION_NODE, 
-        "Is the pain related to a recent injury or overuse?");
-    q16->yes_branch = q17;
+    if (path != NULL && strcmp(path, "-") != 0) {
+        text = (char*)mapFile(path, length);
+        if (text != NULL) {
+            *mapped = 1;
+            return text;
+        }
+        in = fopen(path, "rb");
+        if (in == NULL) {
+            fprintf(stderr, "Cannot open %s\n", path);
+            return NULL;
+        }
+    }
     
+    *mapped = 0;
+    for (;;) {
+        if (capacity - used < BATCH_READ_BUFFER) {
+            char* grown = (char*)realloc(text, capacity + BATCH_READ_BUFFER * 4);
+            if (grown == NULL) {
+                fprintf(stderr, "Memory allocation failed!\n");
+                free(text);
+                text = NULL;
+                break;
+            }
+            text = grown;
+            capacity += BATCH_READ_BUFFER * 4;
+        }
+        size_t got = fread(text + used, 1, capacity - used, in);
+        used += got;
+        if (got == 0) {
+            break;
+        }
+    }
+    if (in != stdin) {
+        fclose(in);
+    }
+    *length = used;
+    return text;
+}
+
+
+int splitBatchChunks(ParallelBatch* batch, const char* text, size_t length, int threads) {
+    size_t target = length / ((size_t)threads * BATCH_CHUNKS_PER_THREAD);
+    size_t pos = 0;
+    uint32_t count = 0;
     
-    Diagnosis* strain = createDiagnosis(
-        "MUSCLE STRAIN OR SPRAIN",
-        MILD,
-        "Overstretched or torn muscles/ligaments from injury or overuse. Usually heals within 1-2 weeks with proper care.",
-        "RICE protocol: Rest (avoid painful activity), Ice (20 min every 2-3 hours for first 48-72 hours), Compression (elastic bandage), Elevation (above heart level). Gentle stretching after 48 hours",
-        "Pain: Ibuprofen 400-600mg every 6 hours (better than acetaminophen for inflammation) OR Naproxen 500mg twice daily with food. Topical: Voltaren Gel (diclofenac) apply to affected area 4 times daily. Ice packs first 48 hours, then heat therapy",
-        "If severe pain, inability to bear weight, significant swelling, numbness/tingling, or no improvement after 1 week",
-        "Proper warm-up before exercise, gradual increase in activity, proper technique, adequate rest between workouts, maintain flexibility and strength"
-    );
-    q17->yes_branch = createDiagnosisNode(strain);
+    if (target > BATCH_CHUNK_BYTES) {
+        target = BATCH_CHUNK_BYTES;
+    }
+    if (target < BATCH_MIN_CHUNK_BYTES) {
+        target = BATCH_MIN_CHUNK_BYTES;
+    }
+    batch->chunks = (BatchChunk*)trackedMalloc((length / target + 1) * sizeof(BatchChunk));
+    if (batch->chunks == NULL) {
+        return 0;
+    }
     
+    while (pos < length) {
+        size_t end = pos + target < length ? pos + target : length;
+        const char* newline = (const char*)memchr(text + end - 1, '\n', length - end + 1);
+        end = newline != NULL ? (size_t)(newline - text) + 1 : length;
+        
+        memset(&batch->chunks[count], 0, sizeof(BatchChunk));
+        batch->chunks[count].text = text + pos;
+        batch->chunks[count].length = end - pos;
+        count++;
+        pos = end;
+    }
+    batch->chunk_count = count;
+    return 1;
+}
+
+
+int64_t chunkDequePop(ChunkDeque* deque) {
+    uint64_t range = atomic_load(&deque->range);
     
-    Diagnosis* body_aches = createDiagnosis(
-        "GENERAL BODY ACHES (MYALGIA)",
-        MILD,
-        "Widespread muscle aches without specific injury, often from stress, tension, or minor viral infections.",
-        "Gentle stretching, warm bath with Epsom salts (2 cups in bath), light massage, stay active with gentle movement, adequate sleep, stress management, stay hydrated (8-10 glasses water/day)",
-        "Ibuprofen 400mg every 6 hours OR Acetaminophen 500-1000mg every 6 hours. Topical: Icy Hot or Bengay cream for localized relief. Magnesium supplement 300-400mg daily may help muscle relaxation",
-        "If aches persist beyond 1 week, worsen, or accompanied by fever, rash, or other symptoms",
-        "Regular exercise, good sleep hygiene, stress management, proper posture, stay hydrated, balanced diet with adequate protein"
-    );
-    q17->no_branch = createDiagnosisNode(body_aches);
+    for (;;) {
+        uint32_t head = (uint32_t)range;
+        uint32_t tail = (uint32_t)(range >> 32);
+        if (head >= tail) {
+            return -1;
+        }
+        if (atomic_compare_exchange_weak(&deque->range, &range, ((uint64_t)tail << 32) | (head + 1))) {
+            return head;
+        }
+    }
+}
+
+
+int chunkDequeSteal(ChunkDeque* deque, uint32_t* first, uint32_t* last) {
+    uint64_t range = atomic_load(&deque->range);
     
+    for (;;) {
+        uint32_t head = (uint32_t)range;
+        uint32_t tail = (uint32_t)(range >> 32);
+        if (head >= tail) {
+            return 0;
+        }
+        uint32_t split = tail - (tail - head + 1) / 2;
+        if (atomic_compare_exchange_weak(&deque->range, &range, ((uint64_t)split << 32) | head)) {
+            *first = split;
+            *last = tail;
+            return 1;
+        }
+    }
+}
+
+
+static void emitChunkResults(BatchWorker* worker, BatchChunk* chunk, const AnswerRecord* block, int count) {
+    const ParallelBatch* batch = worker->batch;
+    uint32_t results[EVAL_BLOCK_RECORDS];
+    char line[BATCH_RESULT_MAX];
     
-    TreeNode* q18 = createNode(QUESTION_NODE, 
-        "Are you experiencing fatigue, weakness, or low energy?");
-    q16->no_branch = q18;
+    evaluateBlock(batch->kb, batch->evaluator, block, count, results);
+    for (int i = 0; i < count; i++) {
+        if (results[i] == FLAT_LEAF) {
+            chunk->invalid++;
+        }
+        textAppend(&worker->output, line, formatBatchResult(batch->kb, results[i], line));
+    }
+    chunk->records += (unsigned long long)count;
+}
+
+
+void scoreBatchChunk(BatchWorker* worker, BatchChunk* chunk) {
+    AnswerRecord block[EVAL_BLOCK_RECORDS];
+    const char* text = chunk->text;
+    const char* end = text + chunk->length;
+    int pending = 0;
     
+    chunk->worker = worker->index;
+    chunk->output_offset = worker->output.used;
+    while (text < end) {
+        const char* line = text;
+        const char* newline = (const char*)memchr(line, '\n', (size_t)(end - line));
+        size_t length = newline != NULL ? (size_t)(newline - line) : (size_t)(end - line);
+        
+        text += length + (newline != NULL ? 1 : 0);
+        if (length > 0 && line[length - 1] == '\r') {
+            length--;
+        }
+        if (length == 0 || line[0] == '#') {
+            continue;
+        }
+        block[pending].text = line;
+        block[pending].length = (uint32_t)length;
+        if (++pending == EVAL_BLOCK_RECORDS) {
+            emitChunkResults(worker, chunk, block, pending);
+            pending = 0;
+        }
+    }
+    if (pending > 0) {
+        emitChunkResults(worker, chunk, block, pending);
+    }
+    chunk->output_length = worker->output.used - chunk->output_offset;
+    worker->chunks++;
+}
+
+
+void* batchWorkerMain(void* arg) {
+    BatchWorker* worker = (BatchWorker*)arg;
+    ParallelBatch* batch = worker->batch;
+    ChunkDeque* own = &batch->deques[worker->index];
+    int64_t chunk;
     
-    Diagnosis* fatigue = createDiagnosis(
-        "GENERAL FATIGUE",
-        MILD,
-        "Persistent tiredness that doesn't improve with rest. Can be caused by stress, poor sleep, inadequate nutrition, or underlying conditions.",
-        "Prioritize 7-9 hours quality sleep, regular sleep schedule, limit caffeine after 2pm, exercise 30 min daily (even walking), eat balanced meals with protein, stay hydrated, reduce stress, limit screen time before bed, take short breaks throughout day",
-        "Address underlying causes first. Vitamin B-Complex supplement daily. Iron supplement if deficient (18mg daily for women, 8mg for men) - take with vitamin C for better absorption. Vitamin D3 2000 IU daily if deficient. Avoid energy drinks",
-        "If fatigue persists despite lifestyle changes, worsens, or accompanied by other symptoms (weight changes, depression, shortness of breath) - may need blood tests for anemia, thyroid, or vitamin deficiencies",
-        "Maintain consistent sleep schedule, balanced diet, regular exercise, stress management, limit alcohol, stay hydrated, take breaks from work"
-    );
-    q18->yes_branch = createDiagnosisNode(fatigue);
+    for (;;) {
+        while ((chunk = chunkDequePop(own)) >= 0) {
+            scoreBatchChunk(worker, &batch->chunks[chunk]);
+        }
+        
+        uint32_t first = 0, last = 0;
+        int stolen = 0;
+        for (int i = 1; i < batch->worker_count && !stolen; i++) {
+            stolen = chunkDequeSteal(&batch->deques[(worker->index + i) % batch->worker_count], &first, &last);
+        }
+        if (!stolen) {
+            break;
+        }
+        worker->steals++;
+        atomic_store(&own->range, ((uint64_t)last << 32) | first);
+    }
+    return NULL;
+}
+
+
+int runBatchPool(ParallelBatch* batch, int threads) {
+    int started = 0;
+    int failed = 0;
     
+    batch->worker_count = threads;
+    batch->workers = (BatchWorker*)trackedMalloc((size_t)threads * sizeof(BatchWorker));
+    batch->deques = (ChunkDeque*)trackedMalloc((size_t)threads * sizeof(ChunkDeque));
+    if (batch->workers == NULL || batch->deques == NULL) {
+        return 0;
+    }
     
-    Diagnosis* general_wellness = createDiagnosis(
-        "GENERAL WELLNESS CHECK",
-        MILD,
-        "You don't appear to have acute symptoms, but it's always good to maintain preventive health practices.",
-        "Maintain healthy lifestyle: balanced diet rich in fruits/vegetables, regular exercise (150 min/week), adequate sleep (7-9 hours), stress management, stay hydrated, practice good hygiene",
-        "Daily multivitamin can help fill nutritional gaps. Vitamin D3 2000 IU daily (especially if limited sun exposure). Omega-3 supplement for heart health",
-        "Annual physical exam, age-appropriate screening tests, dental checkups twice yearly, vision exam yearly, any concerns about preventive health",
-        "Healthy diet, regular exercise, adequate sleep, stress management, avoid smoking, limit alcohol, maintain social connections, regular health screenings"
-    );
-    q18->no_branch = createDiagnosisNode(general_wellness);
+    for (int i = 0; i < threads; i++) {
+        uint32_t first = (uint32_t)((uint64_t)batch->chunk_count * i / threads);
+        uint32_t last = (uint32_t)((uint64_t)batch->chunk_count * (i + 1) / threads);
+        memset(&batch->workers[i], 0, sizeof(BatchWorker));
+        batch->workers[i].batch = batch;
+        batch->workers[i].index = i;
+        atomic_init(&batch->deques[i].range, ((uint64_t)last << 32) | first);
+    }
     
-    return root;
+    for (; started < threads && !failed; started++) {
+        if (pthread_create(&batch->workers[started].thread, NULL, batchWorkerMain, &batch->workers[started]) != 0) {
+            break;
+        }
+    }
+    if (started == 0 && !failed) {
+        batchWorkerMain(&batch->workers[0]);
+    }
+    for (int i = 0; i < started; i++) {
+        pthread_join(batch->workers[i].thread, NULL);
+    }
+    for (int i = 0; i < threads; i++) {
+        failed |= batch->workers[i].output.failed;
+    }
+    return !failed;
 }
 
 
-void traverseTree(TreeNode* root) {
-    if (root == NULL) {
-        return;
+void releaseBatchPool(ParallelBatch* batch) {
+    for (int i = 0; batch->workers != NULL && i < batch->worker_count; i++) {
+        free(batch->workers[i].output.data);
+    }
+    free(batch->workers);
+    free(batch->deques);
+    batch->workers = NULL;
+    batch->deques = NULL;
+    batch->worker_count = 0;
+}
+
+
+static int writeParts(int fd, struct iovec* parts, int count) {
+    while (count > 0) {
+        ssize_t written = writev(fd, parts, count);
+        if (written <= 0) {
+            return 0;
+        }
+        while (count > 0 && (size_t)written >= parts->iov_len) {
+            written -= (ssize_t)parts->iov_len;
+            parts++;
+            count--;
+        }
+        if (count > 0) {
+            parts->iov_base = (char*)parts->iov_base + written;
+            parts->iov_len -= (size_t)written;
+        }
     }
+    return 1;
+}
+
+
+int writeParallelBatch(const ParallelBatch* batch, int fd) {
+    struct iovec parts[64];
+    int count = 0;
     
-    if (root->type == DIAGNOSIS_NODE) {
-        
-        displayProgress("Analyzing your symptoms");
-        system("cls");
-        displayDiagnosis(root->diagnosis);
-        return;
+    for (uint32_t i = 0; i < batch->chunk_count; i++) {
+        const BatchChunk* chunk = &batch->chunks[i];
+        if (chunk->output_length == 0) {
+            continue;
+        }
+        parts[count].iov_base = batch->workers[chunk->worker].output.data + chunk->output_offset;
+        parts[count].iov_len = chunk->output_length;
+        if (++count == 64) {
+            if (!writeParts(fd, parts, count)) {
+                return 0;
+            }
+            count = 0;
+        }
     }
+    return writeParts(fd, parts, count);
+}
+
+
+uint64_t parallelBatchChecksum(const ParallelBatch* batch) {
+    uint64_t hash = 0xcbf29ce484222325ull;
     
+    for (uint32_t i = 0; i < batch->chunk_count; i++) {
+        const BatchChunk* chunk = &batch->chunks[i];
+        const unsigned char* data = (const unsigned char*)batch->workers[chunk->worker].output.data + chunk->output_offset;
+        for (size_t j = 0; j < chunk->output_length; j++) {
+            hash = (hash ^ data[j]) * 0x100000001b3ull;
+        }
+    }
+    return hash;
+}
+
+
+static int countBatch(const ParallelBatch* batch, unsigned long long* records, unsigned long long* invalid,
+                      unsigned long* steals) {
+    *records = 0;
+    *invalid = 0;
+    *steals = 0;
+    for (uint32_t i = 0; i < batch->chunk_count; i++) {
+        *records += batch->chunks[i].records;
+        *invalid += batch->chunks[i].invalid;
+    }
+    for (int i = 0; i < batch->worker_count; i++) {
+        *steals += batch->workers[i].steals;
+    }
+    return batch->worker_count;
+}
+
+
+int runParallelBatch(const KnowledgeBase* kb, const char* path, Evaluator evaluator, int threads) {
+    ParallelBatch batch;
+    size_t length = 0;
+    int mapped = 0;
+    int status = 1;
+    unsigned long long records, invalid;
+    unsigned long steals;
+    char* text = loadBatchInput(path, &length, &mapped);
     
-    printf("\n");
-    printSeparator('-', 70);
-    printf("\n\033[1m\033[36m  QUESTION:\033[0m %s\n", root->text);
-    printSeparator('-', 70);
-    printf("\n\033[33m  Answer (Y)es or (N)o: \033[0m");
+    if (text == NULL) {
+        return 1;
+    }
+    memset(&batch, 0, sizeof(batch));
+    batch.kb = kb;
+    batch.evaluator = evaluator;
     
-    char response = getUserResponse();
+    double start = monotonicMs();
+    if (!splitBatchChunks(&batch, text, length, threads) || !runBatchPool(&batch, threads)) {
+        fprintf(stderr, "Memory allocation failed!\n");
+    } else if (!writeParallelBatch(&batch, 1)) {
+        fprintf(stderr, "Cannot write batch results\n");
+    } else {
+        double seconds = (monotonicMs() - start) / 1000.0;
+        countBatch(&batch, &records, &invalid, &steals);
+        fprintf(stderr, "Processed %llu records (%llu invalid) in %.3f s on %d threads: %.0f records/s "
+                "(%u chunks, %lu steals)\n", records, invalid, seconds, threads,
+                seconds > 0 ? records / seconds : 0.0, batch.chunk_count, steals);
+        status = 0;
+    }
     
-    if (response == 'Y') {
-        traverseTree(root->yes_branch);
+    releaseBatchPool(&batch);
+    free(batch.chunks);
+    if (mapped) {
+        unmapFile(text, length);
     } else {
-        traverseTree(root->no_branch);
+        free(text);
     }
+    return status;
 }
 
 
-void freeTree(TreeNode* root) {
-    if (root == NULL) {
-        return;
+int runBatchScaling(const KnowledgeBase* kb, const char* path, Evaluator evaluator, int max_threads) {
+    ParallelBatch batch;
+    size_t length = 0;
+    int mapped = 0;
+    int status = 0;
+    double base_ms = 0.0;
+    uint64_t base_checksum = 0;
+    char* text = loadBatchInput(path, &length, &mapped);
+    
+    if (text == NULL) {
+        return 1;
+    }
+    memset(&batch, 0, sizeof(batch));
+    batch.kb = kb;
+    batch.evaluator = evaluator;
+    if (!splitBatchChunks(&batch, text, length, max_threads)) {
+        fprintf(stderr, "Memory allocation failed!\n");
+        status = 1;
     }
     
-    if (root->diagnosis != NULL) {
-        free(root->diagnosis);
+    printf("Batch scaling: %.1f MB in %u chunks, best of %d runs\n",
+           length / 1048576.0, batch.chunk_count, BATCH_SCALING_REPEATS);
+    printf("  threads        ms    Mrec/s  speedup  efficiency  steals  output\n");
+    for (int threads = 1; status == 0 && threads <= max_threads;
+         threads = threads < max_threads && threads * 2 > max_threads ? max_threads : threads * 2) {
+        double best_ms = 0.0;
+        unsigned long long records = 0, invalid = 0;
+        unsigned long steals = 0;
+        uint64_t checksum = 0;
+        
+        for (int run = 0; run < BATCH_SCALING_REPEATS && status == 0; run++) {
+            double start = monotonicMs();
+            if (!runBatchPool(&batch, threads)) {
+                fprintf(stderr, "Memory allocation failed!\n");
+                status = 1;
+            }
+            double elapsed = monotonicMs() - start;
+            if (run == 0 || elapsed < best_ms) {
+                best_ms = elapsed;
+                countBatch(&batch, &records, &invalid, &steals);
+            }
+            checksum = parallelBatchChecksum(&batch);
+            releaseBatchPool(&batch);
+            for (uint32_t i = 0; i < batch.chunk_count; i++) {
+                batch.chunks[i].records = 0;
+                batch.chunks[i].invalid = 0;
+            }
+        }
+        if (threads == 1) {
+            base_ms = best_ms;
+            base_checksum = checksum;
+        }
+        printf("  %7d %9.2f %9.2f %8.2f %10.0f%% %7lu  %s\n", threads, best_ms,
+               best_ms > 0 ? records / best_ms / 1000.0 : 0.0, best_ms > 0 ? base_ms / best_ms : 0.0,
+               best_ms > 0 ? base_ms / best_ms / threads * 100.0 : 0.0, steals,
+               checksum == base_checksum ? "identical" : "DIFFERS");
+        if (checksum != base_checksum) {
+            status = 1;
+        }
     }
     
-    freeTree(root->yes_branch);
-    freeTree(root->no_branch);
-    free(root);
+    free(batch.chunks);
+    if (mapped) {
+        unmapFile(text, length);
+    } else {
+        free(text);
+    }
+    return status;
 }
 
-int main() {
-    TreeNode* root;
+#else
+Journal* openJournal(const char* directory, uint64_t rotate_bytes) {
+    (void)rotate_bytes;
+    fprintf(stderr, "\033[31mThe session journal requires Linux (cannot open %s)\033[0m\n", directory);
+    return NULL;
+}
+
+
+void appendJournal(Journal* journal, const Session* session, JournalSource source) {
+    (void)journal; (void)session; (void)source;
+}
+
+
+void closeJournal(Journal* journal) {
+    (void)journal;
+}
+
+
+int runServer(KnowledgeBase* kb, const char* kb_path, int port, int threads, const char* root, Journal* journal,
+              const FacilityIndex* facilities) {
+    (void)kb_path; (void)port; (void)threads; (void)root; (void)journal; (void)facilities;
+    releaseKnowledgeBase(kb);
+    fprintf(stderr, "Server mode requires Linux (epoll)\n");
+    return 1;
+}
+
+
+int runClient(const KnowledgeBase* kb, int port, int sessions, int threads) {
+    (void)kb; (void)port; (void)sessions; (void)threads;
+    fprintf(stderr, "Client mode requires Linux\n");
+    return 1;
+}
+
+
+int runParallelBatch(const KnowledgeBase* kb, const char* path, Evaluator evaluator, int threads) {
+    (void)threads;
+    return runBatch(kb, path, evaluator);
+}
+
+
+int runBatchScaling(const KnowledgeBase* kb, const char* path, Evaluator evaluator, int max_threads) {
+    (void)kb; (void)path; (void)evaluator; (void)max_threads;
+    fprintf(stderr, "The batch scaling benchmark requires Linux\n");
+    return 1;
+}
+#endif
+
+
+#ifndef HEALTH_CHECKER_NO_MAIN
+int main(int argc, char* argv[]) {
+    KnowledgeBase* kb;
+    Session session;
+    const char* kb_path = NULL;
+    const char* resume = NULL;
+    const char* metrics_path = NULL;
+    const char* journal_path = NULL;
+    const char* facilities_path = NULL;
+    uint64_t journal_bytes = 0;
+    Journal* journal = NULL;
+    char resume_token[TOKEN_MAX_TEXT + 1] = "";
     char choice;
     
+    double started = monotonicMs();
+    
+    while (argc >= 2) {
+        const char* flag = argv[1];
+        const char** value = NULL;
+        
+        if (strcmp(flag, "--fast") == 0 || strcmp(flag, "--timing") == 0) {
+            if (strcmp(flag, "--fast") == 0) {
+                g_fast_mode = 1;
+            } else {
+                g_report_timing = 1;
+            }
+            argv[1] = argv[0];
+            argv++;
+            argc--;
+            continue;
+        }
+        
+        if (strcmp(flag, "--kb") == 0) {
+            value = &kb_path;
+        } else if (strcmp(flag, "--resume") == 0) {
+            value = &resume;
+        } else if (strcmp(flag, "--metrics") == 0) {
+            value = &metrics_path;
+        } else if (strcmp(flag, "--journal") == 0) {
+            value = &journal_path;
+        } else if (strcmp(flag, "--facilities") == 0) {
+            value = &facilities_path;
+        } else if (strcmp(flag, "--journal-size") != 0) {
+            break;
+        }
+        if (argc < 3) {
+            break;
+        }
+        if (value != NULL) {
+            *value = argv[2];
+        } else {
+            journal_bytes = (uint64_t)atol(argv[2]) << 20;
+        }
+        argv[2] = argv[0];
+        argv += 2;
+        argc -= 2;
+    }
+    if (getenv("HEALTH_CHECKER_FAST") != NULL) {
+        g_fast_mode = 1;
+    }
+    
+    if (argc >= 3 && (strcmp(argv[1], "--export-kb") == 0 || strcmp(argv[1], "--export-source") == 0)) {
+        kb = openKnowledgeBase(kb_path, 0);
+        if (kb == NULL) {
+            return 1;
+        }
+        int ok = strcmp(argv[1], "--export-kb") == 0 ? exportKnowledgeBase(kb, argv[2])
+                                                     : exportKnowledgeBaseSource(kb, argv[2]);
+        if (ok) {
+            printf("Wrote %s (%u nodes, version %08x)\n", argv[2], kb->node_count, kb->version);
+        }
+        releaseKnowledgeBase(kb);
+        return ok ? 0 : 1;
+    }
+    
+    if (argc >= 3 && strcmp(argv[1], "--search") == 0) {
+        TextBuffer query = { NULL, 0, 0, 0 };
+        for (int i = 2; i < argc; i++) {
+            if (i > 2) {
+                textAppendString(&query, " ");
+            }
+            textAppend(&query, argv[i], strlen(argv[i]) + 1);
+            query.used--;
+        }
+        kb = openKnowledgeBase(kb_path, KB_OPEN_SEARCH);
+        if (kb == NULL || query.failed) {
+            free(query.data);
+            releaseKnowledgeBase(kb);
+            return 1;
+        }
+        int ok = printSearchResults(kb, query.data);
+        free(query.data);
+        releaseKnowledgeBase(kb);
+        return ok ? 0 : 1;
+    }
+    
+    if (argc >= 4 && strcmp(argv[1], "--nearest") == 0) {
+        int limit = argc >= 5 ? atoi(argv[4]) : FACILITY_DEFAULT_RESULTS;
+        double radius_km = argc >= 6 ? atof(argv[5]) : 0;
+        if (facilities_path == NULL || limit <= 0 || limit > FACILITY_MAX_RESULTS) {
+            fprintf(stderr, "Usage: --facilities FILE --nearest LAT LON [COUNT (max %d)] [RADIUS_KM]\n",
+                    FACILITY_MAX_RESULTS);
+            return 1;
+        }
+        FacilityIndex* facilities = loadFacilityIndex(facilities_path);
+        if (facilities == NULL) {
+            return 1;
+        }
+        printNearestFacilities(facilities, atof(argv[2]), atof(argv[3]), limit, radius_km);
+        releaseFacilityIndex(facilities);
+        return 0;
+    }
+    
+    if (argc >= 2 && strcmp(argv[1], "--kb-stats") == 0) {
+        kb = openKnowledgeBase(kb_path, KB_OPEN_RENDER | KB_OPEN_SEARCH);
+        if (kb == NULL) {
+            return 1;
+        }
+        reportKnowledgeBaseMemory(kb);
+        releaseKnowledgeBase(kb);
+        return 0;
+    }
+    
+    if (argc >= 3 && strcmp(argv[1], "--kb-chunk") == 0) {
+        TextBuffer out = { NULL, 0, 0, 0 };
+        kb = openKnowledgeBase(kb_path, 0);
+        if (kb == NULL) {
+            return 1;
+        }
+        int ok = appendKbChunk(&out, kb, (uint32_t)strtoul(argv[2], NULL, 10));
+        if (!ok) {
+            fprintf(stderr, "No node %s (knowledge base has %u)\n", argv[2], kb->node_count);
+        } else if (out.failed || !writeAll(1, out.data, out.used)) {
+            ok = 0;
+        }
+        free(out.data);
+        releaseKnowledgeBase(kb);
+        return ok ? 0 : 1;
+    }
+    
+    if (argc >= 3 && strcmp(argv[1], "--render") == 0) {
+        RenderFormat format = RENDER_ANSI;
+        size_t length;
+        if (argc >= 4 && strcmp(argv[3], "plain") == 0) {
+            format = RENDER_PLAIN;
+        } else if (argc >= 4 && strcmp(argv[3], "json") == 0) {
+            format = RENDER_JSON;
+        } else if (argc >= 4 && strcmp(argv[3], "ansi") != 0) {
+            fprintf(stderr, "Unknown format '%s' (use ansi, plain or json)\n", argv[3]);
+            return 1;
+        }
+        kb = openKnowledgeBase(kb_path, KB_OPEN_RENDER);
+        if (kb == NULL) {
+            return 1;
+        }
+        const char* output = diagnosisOutput(kb, (uint32_t)atol(argv[2]), format, &length);
+        int ok = output != NULL && writeAll(1, output, length);
+        if (output == NULL) {
+            fprintf(stderr, "No diagnosis %s (knowledge base has %u)\n", argv[2], kb->diagnosis_count);
+        }
+        releaseKnowledgeBase(kb);
+        return ok ? 0 : 1;
+    }
+    
+    if (argc >= 2 && (strcmp(argv[1], "--serve") == 0 || strcmp(argv[1], "--client") == 0)) {
+        int serve = strcmp(argv[1], "--serve") == 0;
+        int port = argc >= 3 ? atoi(argv[2]) : HTTP_DEFAULT_PORT;
+        int count = argc >= 4 ? atoi(argv[3]) : (serve ? HTTP_DEFAULT_THREADS : 1000);
+        int threads = !serve && argc >= 5 ? atoi(argv[4]) : HTTP_DEFAULT_THREADS;
+        if (port <= 0 || port > 65535 || count <= 0 || threads <= 0) {
+            fprintf(stderr, "Usage: --serve [PORT] [THREADS] [ROOT] | --client [PORT] [SESSIONS] [CONNECTIONS]\n");
+            return 1;
+        }
+        kb = openKnowledgeBase(kb_path, serve ? KB_OPEN_RENDER | KB_OPEN_SEARCH : KB_OPEN_RENDER);
+        if (kb == NULL) {
+            return 1;
+        }
+        if (serve) {
+            FacilityIndex* facilities = NULL;
+            if (facilities_path != NULL && (facilities = loadFacilityIndex(facilities_path)) == NULL) {
+                releaseKnowledgeBase(kb);
+                return 1;
+            }
+            if (journal_path != NULL && (journal = openJournal(journal_path, journal_bytes)) == NULL) {
+                releaseFacilityIndex(facilities);
+                releaseKnowledgeBase(kb);
+                return 1;
+            }
+            int status = runServer(kb, kb_path, port, count, argc >= 5 ? argv[4] : "frontend", journal, facilities);
+            closeJournal(journal);
+            releaseFacilityIndex(facilities);
+            return status;
+        }
+        int status = runClient(kb, port, count, threads);
+        releaseKnowledgeBase(kb);
+        return status;
+    }
+    
+    if (argc >= 2 && strcmp(argv[1], "--bench-sessions") == 0) {
+        if (journal_path != NULL && (journal = openJournal(journal_path, journal_bytes)) == NULL) {
+            return 1;
+        }
+        benchmarkSessions(argc >= 3 ? atoi(argv[2]) : 0, journal);
+        closeJournal(journal);
+        return 0;
+    }
+    
+    if (argc >= 2 && (strcmp(argv[1], "--batch-parallel") == 0 || strcmp(argv[1], "--batch-scaling") == 0)) {
+        Evaluator evaluator = EVAL_SCALAR;
+        int threads = argc >= 4 ? atoi(argv[3]) : 0;
+        int status;
+        if (argc >= 5 && !parseEvaluator(argv[4], &evaluator)) {
+            fprintf(stderr, "Unknown evaluator '%s' (use scalar, lookup or generated)\n", argv[4]);
+            return 1;
+        }
+        if (threads <= 0) {
+#ifdef _WIN32
+            threads = 1;
+#else
+            threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+        }
+        kb = openKnowledgeBase(kb_path, 0);
+        if (kb == NULL) {
+            return 1;
+        }
+        if (evaluator == EVAL_LOOKUP && !buildLookupTable(kb)) {
+            evaluator = EVAL_SCALAR;
+        }
+        if (strcmp(argv[1], "--batch-parallel") == 0) {
+            status = runParallelBatch(kb, argc >= 3 ? argv[2] : NULL, evaluator, threads > 0 ? threads : 1);
+        } else if (argc < 3) {
+            fprintf(stderr, "Usage: --batch-scaling FILE [MAX_THREADS] [scalar|lookup|generated]\n");
+            status = 1;
+        } else {
+            status = runBatchScaling(kb, argv[2], evaluator, threads > 0 ? threads : 1);
+        }
+        releaseKnowledgeBase(kb);
+        return status;
+    }
+    
+    if (argc >= 2 && (strcmp(argv[1], "--batch") == 0 || strcmp(argv[1], "--gen-records") == 0
+                      || strcmp(argv[1], "--list") == 0 || strcmp(argv[1], "--selftest") == 0)) {
+        Evaluator evaluator = EVAL_SCALAR;
+        int status = 0;
+        if (argc >= 4 && strcmp(argv[1], "--batch") == 0 && !parseEvaluator(argv[3], &evaluator)) {
+            fprintf(stderr, "Unknown evaluator '%s' (use scalar, lookup or generated)\n", argv[3]);
+            return 1;
+        }
+        kb = openKnowledgeBase(kb_path, 0);
+        if (kb == NULL) {
+            return 1;
+        }
+        if (strcmp(argv[1], "--batch") == 0) {
+            if (evaluator == EVAL_LOOKUP && !buildLookupTable(kb)) {
+                evaluator = EVAL_SCALAR;
+            }
+            status = runBatch(kb, argc >= 3 ? argv[2] : NULL, evaluator);
+        } else if (strcmp(argv[1], "--selftest") == 0) {
+            if (buildLookupTable(kb)) {
+                printf("Lookup table:        %u questions, %zu entries, checked against the tree\n",
+                       kb->lookup_bits, (size_t)1 << kb->lookup_bits);
+            }
+            status = checkGeneratedCode(kb);
+            status = runSelfTest(kb, argc >= 3 ? atol(argv[2]) : 200000) || status;
+        } else if (strcmp(argv[1], "--gen-records") == 0) {
+            generateRecords(kb, argc >= 3 ? atol(argv[2]) : 1000,
+                            argc >= 4 ? (unsigned int)atoi(argv[3]) : 1);
+        } else {
+            listKnowledgeBase(kb);
+        }
+        releaseKnowledgeBase(kb);
+        return status;
+    }
+    
+    
+    int shared_key = loadTokenKey() == 1;
+    if (resume != NULL && !shared_key) {
+        fprintf(stderr, "--resume needs HEALTH_CHECKER_TOKEN_KEY set to the key that signed the token\n");
+        return 1;
+    }
     
     enableANSI();
     
+    clearScreen();
+    displayProgress("Initializing symptom checker");
+    kb = openKnowledgeBase(kb_path, KB_OPEN_RENDER);
+    if (kb == NULL) {
+        return 1;
+    }
+    if (metrics_path != NULL && !enableMetrics(kb, 1)) {
+        printf("\033[31mMemory allocation failed!\033[0m\n");
+        releaseKnowledgeBase(kb);
+        return 1;
+    }
+    if (journal_path != NULL && (journal = openJournal(journal_path, journal_bytes)) == NULL) {
+        releaseKnowledgeBase(kb);
+        return 1;
+    }
+    
     do {
-        system("cls");
+        clearScreen();
         displayWelcome();
         
         printf("\n\033[36mPress ENTER to begin assessment...\033[0m");
-        getchar();
-        
-        system("cls");
-        displayProgress("Initializing symptom checker");
-        
-        
-        root = buildSymptomTree();
-        
+        fflush(stdout);
+        if (g_report_timing && started != 0.0) {
+            fprintf(stderr, "timing: startup_ms=%.3f\n", monotonicMs() - started);
+            started = 0.0;
+        }
+        if (getchar() == EOF) {
+            break;
+        }
         
-        traverseTree(root);
+        clearScreen();
         
         
-        freeTree(root);
+        if (resume != NULL) {
+            TokenStatus status = decodeSessionToken(kb, resume, strlen(resume), &session);
+            resume = NULL;
+            if (status != TOKEN_VALID) {
+                printf("\033[31mCannot resume session: %s\033[0m\n", tokenStatusMessage(status));
+                startSession(&session, kb);
+            }
+        } else {
+            startSession(&session, kb);
+        }
+        int finished = traverseTree(&session);
+        if (metrics_path != NULL && !writeMetricsFile(kb, metrics_path)) {
+            fprintf(stderr, "Cannot write metrics to %s\n", metrics_path);
+        }
+        if (finished) {
+            appendJournal(journal, &session, JOURNAL_CLI);
+        }
+        if (!finished) {
+            if (shared_key && session.questions_asked > 0) {
+                encodeSessionToken(&session, resume_token);
+            }
+            break;
+        }
         
         
         printf("\n\n");
@@ -704,7 +7295,10 @@ int main() {
         
     } while (choice == 'Y');
     
-    system("cls");
+    closeJournal(journal);
+    releaseKnowledgeBase(kb);
+    
+    clearScreen();
     displayHeader("Thank You", "\033[32m");
     printf("\n");
     printf("  \033[32m* Thank you for using the HEALTH CHECKER!\033[0m\n");
@@ -713,6 +7307,10 @@ int main() {
     printf("\n");
     printSeparator('=', 70);
     printf("\n\n");
+    if (resume_token[0] != '\0') {
+        printf("  To continue this assessment later, run with --resume %s\n\n", resume_token);
+    }
     
     return 0;
 }
+#endif
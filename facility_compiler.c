@@ -0,0 +1,334 @@
+#define HEALTH_CHECKER_NO_MAIN
+#include "Health_Checker.c"
+
+#define CSV_MAX_FIELDS 64
+#define ADDRESS_PARTS 4
+
+typedef enum {
+    COLUMN_LAT,
+    COLUMN_LON,
+    COLUMN_NAME,
+    COLUMN_AMENITY,
+    COLUMN_ADDRESS,
+    COLUMN_PHONE,
+    COLUMN_WEBSITE,
+    COLUMN_ID,
+    COLUMN_HOUSENUMBER,
+    COLUMN_STREET,
+    COLUMN_CITY,
+    COLUMN_POSTCODE,
+    COLUMN_KINDS
+} ColumnKind;
+
+typedef struct {
+    const char* path;
+    float* points;
+    Facility* facilities;
+    uint32_t count;
+    uint32_t capacity;
+    StringPool strings;
+    StringPool ids;
+    int columns[COLUMN_KINDS];
+    unsigned long duplicates;
+    unsigned long unplaced;
+    int errors;
+} FacilitySource;
+
+static const char* column_names[COLUMN_KINDS] = {
+    "lat|latitude|y", "lon|lng|longitude|x", "name", "amenity|type", "address|addr:full",
+    "phone|contact:phone", "website|contact:website", "id|@id|osm_id",
+    "addr:housenumber", "addr:street", "addr:city", "addr:postcode"
+};
+
+char* readCsvFile(const char* path);
+char* trimField(char* text);
+int columnMatches(const char* header, const char* names);
+int parseCsvRecord(char** cursor, char** fields, int max_fields, int* line);
+const char* columnText(const FacilitySource* src, char** fields, int count, ColumnKind kind);
+int parseCoordinate(const char* text, double low, double high, double* value);
+int addFacility(FacilitySource* src, char** fields, int count, int line);
+void releaseFacilitySource(FacilitySource* src);
+
+
+char* readCsvFile(const char* path) {
+    size_t size = 0;
+    const char* view = (const char*)mapFile(path, &size);
+    char* buffer;
+    
+    if (view == NULL) {
+        return NULL;
+    }
+    buffer = (char*)trackedMalloc(size + 1);
+    if (buffer != NULL) {
+        memcpy(buffer, view, size);
+        buffer[size] = '\0';
+    }
+    unmapFile(view, size);
+    return buffer;
+}
+
+
+char* trimField(char* text) {
+    size_t length;
+    
+    while (*text == ' ' || *text == '\t') {
+        text++;
+    }
+    length = strlen(text);
+    while (length > 0 && isspace((unsigned char)text[length - 1])) {
+        text[--length] = '\0';
+    }
+    return text;
+}
+
+
+int columnMatches(const char* header, const char* names) {
+    while (*names != '\0') {
+        const char* h = header;
+        while (*names != '\0' && *names != '|' && tolower((unsigned char)*h) == *names) {
+            h++;
+            names++;
+        }
+        if (*h == '\0' && (*names == '\0' || *names == '|')) {
+            return 1;
+        }
+        while (*names != '\0' && *names != '|') {
+            names++;
+        }
+        if (*names == '|') {
+            names++;
+        }
+    }
+    return 0;
+}
+
+
+int parseCsvRecord(char** cursor, char** fields, int max_fields, int* line) {
+    char* p = *cursor;
+    int count = 0;
+    
+    if (*p == '\0') {
+        return -1;
+    }
+    for (;;) {
+        char* field = p;
+        char* out = p;
+        if (*p == '"') {
+            p++;
+            while (*p != '\0') {
+                if (*p == '"' && p[1] == '"') {
+                    *out++ = '"';
+                    p += 2;
+                } else if (*p == '"') {
+                    p++;
+                    break;
+                } else {
+                    *line += *p == '\n';
+                    *out++ = *p++;
+                }
+            }
+        }
+        while (*p != ',' && *p != '\n' && *p != '\0') {
+            *out++ = *p++;
+        }
+    
+        char end = *p;
+        *out = '\0';
+        if (out > field && out[-1] == '\r') {
+            out[-1] = '\0';
+        }
+        if (count < max_fields) {
+            fields[count++] = field;
+        }
+        if (end != '\0') {
+            p++;
+        }
+        if (end != ',') {
+            *line += end == '\n';
+            break;
+        }
+    }
+    *cursor = p;
+    return count;
+}
+
+
+const char* columnText(const FacilitySource* src, char** fields, int count, ColumnKind kind) {
+    int column = src->columns[kind];
+    return column >= 0 && column < count ? trimField(fields[column]) : "";
+}
+
+
+int parseCoordinate(const char* text, double low, double high, double* value) {
+    char* end;
+    *value = strtod(text, &end);
+    return end != text && *end == '\0' && *value >= low && *value <= high;
+}
+
+
+int addFacility(FacilitySource* src, char** fields, int count, int line) {
+    const char* lat_text = columnText(src, fields, count, COLUMN_LAT);
+    const char* lon_text = columnText(src, fields, count, COLUMN_LON);
+    const char* id = columnText(src, fields, count, COLUMN_ID);
+    const char* address = columnText(src, fields, count, COLUMN_ADDRESS);
+    char joined[MAX_TEXT];
+    double lat, lon, point[3];
+    
+    if (lat_text[0] == '\0' || lon_text[0] == '\0') {
+        src->unplaced++;
+        return 1;
+    }
+    if (!parseCoordinate(lat_text, -90.0, 90.0, &lat) || !parseCoordinate(lon_text, -180.0, 180.0, &lon)) {
+        fprintf(stderr, "\033[31m%s:%d: invalid coordinates '%s', '%s'\033[0m\n", src->path, line, lat_text, lon_text);
+        src->errors++;
+        return 1;
+    }
+    if (id[0] != '\0') {
+        uint32_t known = src->ids.string_count;
+        if (poolIntern(&src->ids, id) == POOL_INVALID) {
+            return 0;
+        }
+        if (src->ids.string_count == known) {
+            src->duplicates++;
+            return 1;
+        }
+    }
+    
+    if (address[0] == '\0') {
+        size_t used = 0;
+        joined[0] = '\0';
+        for (int kind = COLUMN_HOUSENUMBER; kind < COLUMN_HOUSENUMBER + ADDRESS_PARTS; kind++) {
+            const char* part = columnText(src, fields, count, (ColumnKind)kind);
+            if (part[0] != '\0' && used < sizeof(joined)) {
+                used += (size_t)snprintf(joined + used, sizeof(joined) - used, "%s%s", used > 0 ? ", " : "", part);
+            }
+        }
+        address = joined;
+    }
+    
+    if (src->count == src->capacity) {
+        uint32_t capacity = src->capacity == 0 ? 1024 : src->capacity * 2;
+        float* points = (float*)realloc(src->points, (size_t)capacity * 3 * sizeof(float));
+        if (points == NULL) {
+            return 0;
+        }
+        src->points = points;
+        Facility* facilities = (Facility*)realloc(src->facilities, (size_t)capacity * sizeof(Facility));
+        if (facilities == NULL) {
+            return 0;
+        }
+        src->facilities = facilities;
+        src->capacity = capacity;
+    }
+    
+    Facility* facility = &src->facilities[src->count];
+    facility->lat = (float)lat;
+    facility->lon = (float)lon;
+    facility->name = poolIntern(&src->strings, columnText(src, fields, count, COLUMN_NAME));
+    facility->amenity = poolIntern(&src->strings, columnText(src, fields, count, COLUMN_AMENITY));
+    facility->address = poolIntern(&src->strings, address);
+    facility->phone = poolIntern(&src->strings, columnText(src, fields, count, COLUMN_PHONE));
+    facility->website = poolIntern(&src->strings, columnText(src, fields, count, COLUMN_WEBSITE));
+    facilityPoint(lat, lon, point);
+    for (int axis = 0; axis < 3; axis++) {
+        src->points[3 * (size_t)src->count + axis] = (float)point[axis];
+    }
+    src->count++;
+    return !src->strings.failed;
+}
+
+
+void releaseFacilitySource(FacilitySource* src) {
+    free(src->points);
+    free(src->facilities);
+    poolRelease(&src->strings);
+    poolRelease(&src->ids);
+}
+
+
+int main(int argc, char* argv[]) {
+    FacilitySource src;
+    char* fields[CSV_MAX_FIELDS];
+    char* buffer;
+    char* cursor;
+    int line = 1;
+    int count;
+    double start;
+    
+    if (argc != 3) {
+        fprintf(stderr, "Usage: facility_compiler FACILITIES.csv OUTPUT.fidx\n");
+        fprintf(stderr, "       the CSV header names the columns: lat/latitude/y, lon/lng/longitude/x, and optionally\n");
+        fprintf(stderr, "       name, amenity, address or addr:*, phone, website and id (rows repeating an id are dropped)\n");
+        return 2;
+    }
+    
+    start = monotonicMs();
+    memset(&src, 0, sizeof(src));
+    src.path = argv[1];
+    buffer = readCsvFile(argv[1]);
+    if (buffer == NULL) {
+        fprintf(stderr, "Cannot read %s\n", argv[1]);
+        return 1;
+    }
+    if (!poolInit(&src.strings) || !poolInit(&src.ids)) {
+        fprintf(stderr, "Memory allocation failed!\n");
+        free(buffer);
+        releaseFacilitySource(&src);
+        return 1;
+    }
+    
+    cursor = buffer;
+    if (strncmp(cursor, "\xEF\xBB\xBF", 3) == 0) {
+        cursor += 3;
+    }
+    count = parseCsvRecord(&cursor, fields, CSV_MAX_FIELDS, &line);
+    for (int kind = 0; kind < COLUMN_KINDS; kind++) {
+        src.columns[kind] = -1;
+        for (int i = 0; i < count && src.columns[kind] < 0; i++) {
+            if (columnMatches(trimField(fields[i]), column_names[kind])) {
+                src.columns[kind] = i;
+            }
+        }
+    }
+    if (src.columns[COLUMN_LAT] < 0 || src.columns[COLUMN_LON] < 0) {
+        fprintf(stderr, "\033[31m%s:1: the header needs latitude and longitude columns\033[0m\n", src.path);
+        free(buffer);
+        releaseFacilitySource(&src);
+        return 1;
+    }
+    
+    for (;;) {
+        int record_line = line;
+        count = parseCsvRecord(&cursor, fields, CSV_MAX_FIELDS, &line);
+        if (count < 0) {
+            break;
+        }
+        if (count == 1 && trimField(fields[0])[0] == '\0') {
+            continue;
+        }
+        if (!addFacility(&src, fields, count, record_line)) {
+            fprintf(stderr, "Memory allocation failed!\n");
+            free(buffer);
+            releaseFacilitySource(&src);
+            return 1;
+        }
+    }
+    free(buffer);
+    
+    if (src.errors > 0) {
+        fprintf(stderr, "%s: %d error%s, nothing written\n", src.path, src.errors, src.errors == 1 ? "" : "s");
+        releaseFacilitySource(&src);
+        return 1;
+    }
+    
+    buildFacilityTree(src.points, src.facilities, 0, src.count, 0);
+    if (!exportFacilityIndex(src.points, src.facilities, src.count, &src.strings, argv[2])) {
+        releaseFacilitySource(&src);
+        return 1;
+    }
+    printf("Wrote %s: %u facilities, %lu duplicate ids dropped, %lu rows without coordinates, "
+           "%u string bytes (%.1f ms)\n", argv[2], src.count, src.duplicates, src.unplaced, src.strings.used,
+           monotonicMs() - start);
+    releaseFacilitySource(&src);
+    return 0;
+}
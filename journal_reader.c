@@ -0,0 +1,321 @@
+#define HEALTH_CHECKER_NO_MAIN
+#include "Health_Checker.c"
+
+#define READER_BUFFER_BYTES (1 << 20)
+#define READER_MAX_VERSIONS 64
+
+typedef struct {
+    uint32_t version;
+    unsigned long records;
+} VersionCount;
+
+typedef struct {
+    const KnowledgeBase* kb;
+    int summary;
+    uint64_t since_ms;
+    unsigned char* buffer;
+    unsigned long files;
+    unsigned long records;
+    unsigned long skipped;
+    unsigned long corrupt;
+    unsigned long torn;
+    unsigned long by_source[2];
+    unsigned long by_severity[4];
+    unsigned long long questions;
+    unsigned long long duration_ms;
+    uint64_t first_ms;
+    uint64_t last_ms;
+    VersionCount versions[READER_MAX_VERSIONS];
+    int version_count;
+} JournalReader;
+
+
+void formatTimestamp(uint64_t ms, char* out, size_t size);
+void printRecord(JournalReader* reader, const JournalRecord* record, const unsigned char* answers);
+void countRecord(JournalReader* reader, const JournalRecord* record);
+int readJournalFile(JournalReader* reader, const char* path);
+int readJournalPath(JournalReader* reader, const char* path);
+void printSummary(const JournalReader* reader);
+
+
+void formatTimestamp(uint64_t ms, char* out, size_t size) {
+    time_t seconds = (time_t)(ms / 1000);
+    struct tm* utc = gmtime(&seconds);
+    
+    if (utc == NULL) {
+        snprintf(out, size, "%llu", (unsigned long long)ms);
+        return;
+    }
+    size_t length = strftime(out, size, "%Y-%m-%dT%H:%M:%S", utc);
+    snprintf(out + length, size - length, ".%03uZ", (unsigned)(ms % 1000));
+}
+
+
+void printRecord(JournalReader* reader, const JournalRecord* record, const unsigned char* answers) {
+    char finished[40];
+    char path[TOKEN_MAX_ANSWERS + 1];
+    int stored = record->questions < TOKEN_MAX_ANSWERS ? record->questions : TOKEN_MAX_ANSWERS;
+    const char* condition = "";
+    
+    for (int i = 0; i < stored; i++) {
+        path[i] = (answers[i >> 3] >> (i & 7)) & 1 ? 'Y' : 'N';
+    }
+    path[stored] = '\0';
+    if (reader->kb != NULL && reader->kb->version == record->kb_version
+        && record->diagnosis < reader->kb->diagnosis_count) {
+        condition = kbText(reader->kb, reader->kb->diagnoses[record->diagnosis].condition);
+    }
+    formatTimestamp(record->finished_ms, finished, sizeof(finished));
+    printf("%s\t%llu\t%08x\t%s\t%s\t%u\t%u\t%s\t%s\n", finished,
+           (unsigned long long)(record->finished_ms >= record->started_ms ? record->finished_ms - record->started_ms : 0),
+           record->kb_version, record->source == JOURNAL_API ? "api" : "cli",
+           severityName((Severity)record->severity), record->diagnosis, record->questions,
+           path[0] != '\0' ? path : "-", condition);
+}
+
+
+void countRecord(JournalReader* reader, const JournalRecord* record) {
+    int v = 0;
+    
+    reader->by_source[record->source == JOURNAL_API]++;
+    if (record->severity < 4) {
+        reader->by_severity[record->severity]++;
+    }
+    reader->questions += record->questions;
+    if (record->finished_ms >= record->started_ms) {
+        reader->duration_ms += record->finished_ms - record->started_ms;
+    }
+    if (reader->records == 1 || record->finished_ms < reader->first_ms) {
+        reader->first_ms = record->finished_ms;
+    }
+    if (record->finished_ms > reader->last_ms) {
+        reader->last_ms = record->finished_ms;
+    }
+    
+    while (v < reader->version_count && reader->versions[v].version != record->kb_version) {
+        v++;
+    }
+    if (v == reader->version_count && v < READER_MAX_VERSIONS) {
+        reader->versions[v].version = record->kb_version;
+        reader->versions[v].records = 0;
+        reader->version_count++;
+    }
+    if (v < reader->version_count) {
+        reader->versions[v].records++;
+    }
+}
+
+
+int readJournalFile(JournalReader* reader, const char* path) {
+    FILE* file = fopen(path, "rb");
+    JournalFileHeader header;
+    size_t held = 0;
+    unsigned long long offset = sizeof(header);
+    int stop = 0;
+    int ok = 1;
+    
+    if (file == NULL) {
+        fprintf(stderr, "\033[31mCannot open %s\033[0m\n", path);
+        return 0;
+    }
+    if (fread(&header, sizeof(header), 1, file) != 1 || memcmp(header.magic, JOURNAL_MAGIC, 4) != 0
+        || header.format_version != JOURNAL_FORMAT_VERSION || header.header_size != sizeof(header)) {
+        fprintf(stderr, "\033[31m%s is not a session journal\033[0m\n", path);
+        fclose(file);
+        return 0;
+    }
+    reader->files++;
+    
+    for (;;) {
+        size_t got = fread(reader->buffer + held, 1, READER_BUFFER_BYTES - held, file);
+        size_t used = 0;
+        held += got;
+    
+        while (held - used >= sizeof(JournalRecord)) {
+            JournalRecord record;
+            memcpy(&record, reader->buffer + used, sizeof(record));
+            size_t stored = record.questions < TOKEN_MAX_ANSWERS ? record.questions : TOKEN_MAX_ANSWERS;
+            if (record.length != sizeof(record) + (stored + 7) / 8) {
+                fprintf(stderr, "\033[31m%s: bad record length at offset %llu; skipping the rest of the file\033[0m\n",
+                        path, offset);
+                reader->corrupt++;
+                stop = 1;
+                break;
+            }
+            if (held - used < record.length) {
+                break;
+            }
+            if (crc32Update(0, reader->buffer + used + 8, record.length - 8) != record.checksum) {
+                fprintf(stderr, "\033[31m%s: checksum mismatch at offset %llu\033[0m\n", path, offset);
+                reader->corrupt++;
+                ok = 0;
+            } else if (record.finished_ms < reader->since_ms) {
+                reader->skipped++;
+            } else {
+                reader->records++;
+                countRecord(reader, &record);
+                if (!reader->summary) {
+                    printRecord(reader, &record, reader->buffer + used + sizeof(record));
+                }
+            }
+            used += record.length;
+            offset += record.length;
+        }
+        if (stop) {
+            break;
+        }
+    
+        memmove(reader->buffer, reader->buffer + used, held - used);
+        held -= used;
+        if (got == 0) {
+            break;
+        }
+    }
+    
+    if (!stop && held > 0) {
+        fprintf(stderr, "%s: ignoring a torn %zu-byte record at offset %llu\n", path, held, offset);
+        reader->torn++;
+    }
+    fclose(file);
+    return ok && !stop;
+}
+
+
+static int compareSequences(const void* a, const void* b) {
+    uint32_t left = *(const uint32_t*)a;
+    uint32_t right = *(const uint32_t*)b;
+    return left < right ? -1 : left > right;
+}
+
+
+int readJournalPath(JournalReader* reader, const char* path) {
+#ifdef __linux__
+    DIR* dir = opendir(path);
+    struct dirent* entry;
+    uint32_t* sequences = NULL;
+    size_t count = 0;
+    size_t capacity = 0;
+    int ok = 1;
+    
+    if (dir == NULL) {
+        return readJournalFile(reader, path);
+    }
+    while ((entry = readdir(dir)) != NULL) {
+        uint32_t sequence;
+        if (!parseJournalFileName(entry->d_name, &sequence)) {
+            continue;
+        }
+        if (count == capacity) {
+            size_t grown = capacity == 0 ? 64 : capacity * 2;
+            uint32_t* larger = (uint32_t*)realloc(sequences, grown * sizeof(uint32_t));
+            if (larger == NULL) {
+                fprintf(stderr, "Memory allocation failed!\n");
+                free(sequences);
+                closedir(dir);
+                return 0;
+            }
+            sequences = larger;
+            capacity = grown;
+        }
+        sequences[count++] = sequence;
+    }
+    closedir(dir);
+    
+    qsort(sequences, count, sizeof(uint32_t), compareSequences);
+    for (size_t i = 0; i < count; i++) {
+        char file[1024];
+        snprintf(file, sizeof(file), "%s/journal-%06u.hcj", path, sequences[i]);
+        ok = readJournalFile(reader, file) && ok;
+    }
+    free(sequences);
+    return ok;
+#else
+    return readJournalFile(reader, path);
+#endif
+}
+
+
+void printSummary(const JournalReader* reader) {
+    char first[40], last[40];
+    
+    printf("Journal files:    %lu\n", reader->files);
+    printf("Sessions:         %lu (%lu cli, %lu api)\n", reader->records, reader->by_source[0],
+           reader->by_source[1]);
+    if (reader->skipped > 0) {
+        printf("Before --since:   %lu\n", reader->skipped);
+    }
+    if (reader->corrupt > 0 || reader->torn > 0) {
+        printf("Damaged:          %lu corrupt, %lu torn\n", reader->corrupt, reader->torn);
+    }
+    if (reader->records == 0) {
+        return;
+    }
+    formatTimestamp(reader->first_ms, first, sizeof(first));
+    formatTimestamp(reader->last_ms, last, sizeof(last));
+    printf("Finished between: %s and %s\n", first, last);
+    printf("Mean questions:   %.2f\n", (double)reader->questions / reader->records);
+    printf("Mean duration:    %.1f ms\n", (double)reader->duration_ms / reader->records);
+    printf("By severity:     ");
+    for (int s = 0; s < 4; s++) {
+        printf(" %s %lu", severityName((Severity)s), reader->by_severity[s]);
+    }
+    printf("\nBy knowledge base:");
+    for (int v = 0; v < reader->version_count; v++) {
+        printf(" %08x %lu", reader->versions[v].version, reader->versions[v].records);
+    }
+    printf("\n");
+}
+
+
+int main(int argc, char* argv[]) {
+    const char* kb_path = NULL;
+    JournalReader reader;
+    int ok = 1;
+    
+    memset(&reader, 0, sizeof(reader));
+    while (argc >= 2) {
+        if (argc >= 3 && (strcmp(argv[1], "--kb") == 0 || strcmp(argv[1], "--since") == 0)) {
+            if (argv[1][2] == 'k') {
+                kb_path = argv[2];
+            } else {
+                reader.since_ms = strtoull(argv[2], NULL, 10);
+            }
+            argv += 2;
+            argc -= 2;
+        } else if (strcmp(argv[1], "--summary") == 0) {
+            reader.summary = 1;
+            argv++;
+            argc--;
+        } else {
+            break;
+        }
+    }
+    if (argc < 2) {
+        fprintf(stderr, "Usage: journal_reader [--kb INPUT.kb] [--since EPOCH_MS] [--summary] JOURNAL...\n");
+        fprintf(stderr, "       JOURNAL is a journal directory or a single journal-NNNNNN.hcj file\n");
+        return 2;
+    }
+    
+    KnowledgeBase* kb = openKnowledgeBase(kb_path, 0);
+    if (kb == NULL) {
+        return 1;
+    }
+    reader.kb = kb;
+    reader.buffer = (unsigned char*)trackedMalloc(READER_BUFFER_BYTES);
+    if (reader.buffer == NULL) {
+        fprintf(stderr, "Memory allocation failed!\n");
+        releaseKnowledgeBase(kb);
+        return 1;
+    }
+    
+    for (int i = 1; i < argc; i++) {
+        ok = readJournalPath(&reader, argv[i]) && ok;
+    }
+    if (reader.summary) {
+        printSummary(&reader);
+    }
+    
+    free(reader.buffer);
+    releaseKnowledgeBase(kb);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,375 @@
+#define HEALTH_CHECKER_NO_MAIN
+#include "Health_Checker.c"
+
+#define BENCH_DEFAULT_MIN_MS 250.0
+#define BENCH_DEFAULT_MAX_NODES 1000000
+#define BENCH_MAX_ITERATIONS 1000000000L
+#define BENCH_WALL_FACTOR 8.0
+
+static volatile uint32_t g_bench_sink;
+
+typedef struct BenchCase BenchCase;
+typedef void (*BenchFunction)(BenchCase* bench, long iterations);
+
+typedef struct {
+    const char* name;
+    BenchFunction run;
+} Benchmark;
+
+struct BenchCase {
+    const char* tree;
+    uint32_t leaves;
+    KnowledgeBase* kb;
+    char* paths;
+    size_t paths_used;
+    size_t paths_capacity;
+    uint32_t* path_offsets;
+    uint32_t path_count;
+    uint32_t cursor;
+    TextBuffer sink;
+    RenderFormat format;
+    char* answers;
+    AnswerRecord records[EVAL_BLOCK_RECORDS];
+    double elapsed_ms;
+    size_t allocs;
+    size_t bytes;
+    int failed;
+};
+
+
+TreeNode* buildSyntheticSubtree(KnowledgeBase* kb, uint32_t leaves, uint32_t* next_question, uint32_t* next_leaf);
+KnowledgeBase* buildSyntheticKnowledgeBase(uint32_t leaves);
+KnowledgeBase* buildBenchTree(const BenchCase* bench);
+void collectBenchPath(const KnowledgeBase* kb, const char* answers, uint32_t depth, uint32_t leaf, void* context);
+void benchBuild(BenchCase* bench, long iterations);
+void benchTeardown(BenchCase* bench, long iterations);
+void benchTraverse(BenchCase* bench, long iterations);
+void benchRender(BenchCase* bench, long iterations);
+void benchEvaluate(BenchCase* bench, long iterations);
+int runBenchmark(BenchCase* bench, const Benchmark* benchmark, double min_ms, int table);
+
+
+TreeNode* buildSyntheticSubtree(KnowledgeBase* kb, uint32_t leaves, uint32_t* next_question, uint32_t* next_leaf) {
+    static const Severity severities[] = { MILD, MODERATE, MILD, URGENT, MODERATE, MILD, EMERGENCY };
+    char text[96];
+    
+    if (leaves == 1) {
+        uint32_t id = (*next_leaf)++;
+        snprintf(text, sizeof(text), "SYNTHETIC CONDITION %u", id);
+        Diagnosis* diag = createDiagnosis(kb, text, severities[id % 7],
+            "A generated condition used to measure the engine on large trees.",
+            "Rest, drink plenty of fluids and monitor your symptoms",
+            "Paracetamol or ibuprofen as directed on the label",
+            "If symptoms persist for more than a week or get worse",
+            "Wash hands regularly and keep vaccinations up to date");
+        return createDiagnosisNode(kb, diag);
+    }
+    
+    snprintf(text, sizeof(text), "Synthetic question %u: do you have this symptom?", (*next_question)++);
+    TreeNode* node = createNode(kb, QUESTION_NODE, text);
+    TreeNode* yes = node != NULL ? buildSyntheticSubtree(kb, leaves / 2, next_question, next_leaf) : NULL;
+    TreeNode* no = yes != NULL ? buildSyntheticSubtree(kb, leaves - leaves / 2, next_question, next_leaf) : NULL;
+    if (no == NULL) {
+        return NULL;
+    }
+    setYesBranch(node, yes);
+    setNoBranch(node, no);
+    return node;
+}
+
+
+KnowledgeBase* buildSyntheticKnowledgeBase(uint32_t leaves) {
+    KnowledgeBase* kb = beginKnowledgeBase();
+    uint32_t next_question = 0;
+    uint32_t next_leaf = 0;
+    
+    if (kb == NULL) {
+        return NULL;
+    }
+    kb->root = buildSyntheticSubtree(kb, leaves, &next_question, &next_leaf);
+    if (kb->root == NULL || !finishKnowledgeBase(kb)) {
+        releaseKnowledgeBase(kb);
+        return NULL;
+    }
+    return kb;
+}
+
+
+KnowledgeBase* buildBenchTree(const BenchCase* bench) {
+    return bench->leaves == 0 ? createKnowledgeBase() : buildSyntheticKnowledgeBase(bench->leaves);
+}
+
+
+void collectBenchPath(const KnowledgeBase* kb, const char* answers, uint32_t depth, uint32_t leaf, void* context) {
+    BenchCase* bench = (BenchCase*)context;
+    uint32_t node = 0;
+    
+    (void)leaf;
+    if (bench->failed) {
+        return;
+    }
+    if (bench->paths_used + depth > bench->paths_capacity) {
+        size_t capacity = bench->paths_capacity == 0 ? 4096 : bench->paths_capacity;
+        while (capacity < bench->paths_used + depth) {
+            capacity *= 2;
+        }
+        char* grown = (char*)realloc(bench->paths, capacity);
+        if (grown == NULL) {
+            bench->failed = 1;
+            return;
+        }
+        bench->paths = grown;
+        bench->paths_capacity = capacity;
+    }
+    
+    bench->path_offsets[bench->path_count++] = (uint32_t)bench->paths_used;
+    while (kb->flat[node].question != FLAT_LEAF) {
+        char answer = answers[kb->flat[node].question];
+        bench->paths[bench->paths_used++] = answer;
+        node = kb->flat[node].child[answer == 'Y'];
+    }
+    bench->path_offsets[bench->path_count] = (uint32_t)bench->paths_used;
+}
+
+
+void benchBuild(BenchCase* bench, long iterations) {
+    for (long i = 0; i < iterations; i++) {
+        size_t allocs = g_alloc_count;
+        size_t bytes = g_alloc_bytes;
+        double started = monotonicMs();
+        KnowledgeBase* kb = buildBenchTree(bench);
+        bench->elapsed_ms += monotonicMs() - started;
+        bench->allocs += g_alloc_count - allocs;
+        bench->bytes += g_alloc_bytes - bytes;
+        if (kb == NULL) {
+            bench->failed = 1;
+            return;
+        }
+        releaseKnowledgeBase(kb);
+    }
+}
+
+
+void benchTeardown(BenchCase* bench, long iterations) {
+    for (long i = 0; i < iterations; i++) {
+        KnowledgeBase* kb = buildBenchTree(bench);
+        if (kb == NULL) {
+            bench->failed = 1;
+            return;
+        }
+        size_t allocs = g_alloc_count;
+        size_t bytes = g_alloc_bytes;
+        double started = monotonicMs();
+        releaseKnowledgeBase(kb);
+        bench->elapsed_ms += monotonicMs() - started;
+        bench->allocs += g_alloc_count - allocs;
+        bench->bytes += g_alloc_bytes - bytes;
+    }
+}
+
+
+void benchTraverse(BenchCase* bench, long iterations) {
+    Session session;
+    size_t allocs = g_alloc_count;
+    size_t bytes = g_alloc_bytes;
+    uint32_t path = bench->cursor;
+    double started = monotonicMs();
+    
+    for (long i = 0; i < iterations; i++) {
+        const char* answer = bench->paths + bench->path_offsets[path];
+        startSession(&session, bench->kb);
+        while (!sessionFinished(&session)) {
+            sessionAnswer(&session, *answer++);
+        }
+        g_bench_sink += bench->kb->flat[session.node].payload;
+        if (++path == bench->path_count) {
+            path = 0;
+        }
+    }
+    bench->elapsed_ms += monotonicMs() - started;
+    bench->allocs += g_alloc_count - allocs;
+    bench->bytes += g_alloc_bytes - bytes;
+    bench->cursor = path;
+}
+
+
+void benchRender(BenchCase* bench, long iterations) {
+    size_t allocs = g_alloc_count;
+    size_t bytes = g_alloc_bytes;
+    uint32_t diagnosis = bench->cursor % bench->kb->diagnosis_count;
+    double started = monotonicMs();
+    
+    for (long i = 0; i < iterations; i++) {
+        bench->sink.used = 0;
+        renderDiagnosis(bench->kb, &bench->kb->diagnoses[diagnosis], bench->format, &bench->sink);
+        if (++diagnosis == bench->kb->diagnosis_count) {
+            diagnosis = 0;
+        }
+    }
+    bench->elapsed_ms += monotonicMs() - started;
+    bench->allocs += g_alloc_count - allocs;
+    bench->bytes += g_alloc_bytes - bytes;
+    bench->cursor = diagnosis;
+    if (bench->sink.failed) {
+        bench->failed = 1;
+    }
+}
+
+
+void benchEvaluate(BenchCase* bench, long iterations) {
+    uint32_t questions = bench->kb->question_count;
+    uint32_t results[EVAL_BLOCK_RECORDS];
+    
+    if (bench->answers == NULL) {
+        uint32_t seed = 12345;
+        bench->answers = (char*)trackedMalloc((size_t)EVAL_BLOCK_RECORDS * questions + 1);
+        if (bench->answers == NULL) {
+            bench->failed = 1;
+            return;
+        }
+        for (int lane = 0; lane < EVAL_BLOCK_RECORDS; lane++) {
+            char* text = bench->answers + (size_t)lane * questions;
+            for (uint32_t q = 0; q < questions; q++) {
+                seed = seed * 1103515245u + 12345u;
+                text[q] = (seed >> 16) & 1 ? 'Y' : 'N';
+            }
+            bench->records[lane].text = text;
+            bench->records[lane].length = questions;
+        }
+    }
+    
+    size_t allocs = g_alloc_count;
+    size_t bytes = g_alloc_bytes;
+    double started = monotonicMs();
+    for (long i = 0; i < iterations; i += EVAL_BLOCK_RECORDS) {
+        int count = iterations - i < EVAL_BLOCK_RECORDS ? (int)(iterations - i) : EVAL_BLOCK_RECORDS;
+        evaluateBlock(bench->kb, EVAL_SCALAR, bench->records, count, results);
+        g_bench_sink += results[count - 1];
+    }
+    bench->elapsed_ms += monotonicMs() - started;
+    bench->allocs += g_alloc_count - allocs;
+    bench->bytes += g_alloc_bytes - bytes;
+}
+
+
+int runBenchmark(BenchCase* bench, const Benchmark* benchmark, double min_ms, int table) {
+    long iterations = 1;
+    
+    for (;;) {
+        double started = monotonicMs();
+        bench->elapsed_ms = 0.0;
+        bench->allocs = 0;
+        bench->bytes = 0;
+        benchmark->run(bench, iterations);
+        if (bench->failed) {
+            fprintf(stderr, "\033[31m%s failed on the %s tree\033[0m\n", benchmark->name, bench->tree);
+            return 0;
+        }
+        double wall_ms = monotonicMs() - started;
+        if (bench->elapsed_ms >= min_ms || iterations >= BENCH_MAX_ITERATIONS || wall_ms >= min_ms * BENCH_WALL_FACTOR) {
+            break;
+        }
+        double budget = min_ms * 1.2 / (bench->elapsed_ms > 0.0 ? bench->elapsed_ms : min_ms / 100.0);
+        double wall_budget = min_ms * BENCH_WALL_FACTOR / wall_ms;
+        double predicted = iterations * (budget < wall_budget ? budget : wall_budget);
+        long next = predicted > iterations * 100.0 ? iterations * 100 : (long)predicted;
+        iterations = next > iterations ? (next < BENCH_MAX_ITERATIONS ? next : BENCH_MAX_ITERATIONS) : iterations + 1;
+    }
+    
+    double ns = bench->elapsed_ms * 1e6 / iterations;
+    double allocs = (double)bench->allocs / iterations;
+    double bytes = (double)bench->bytes / iterations;
+    if (table) {
+        printf("%-15s %-10s %9u %9u %12ld %14.1f %12.2f %14.1f\n", benchmark->name, bench->tree,
+               bench->kb->node_count, bench->kb->diagnosis_count, iterations, ns, allocs, bytes);
+    } else {
+        printf("{\"benchmark\":\"%s\",\"tree\":\"%s\",\"nodes\":%u,\"diagnoses\":%u,\"iterations\":%ld,"
+               "\"ns_per_op\":%.1f,\"allocs_per_op\":%.3f,\"bytes_per_op\":%.1f}\n",
+               benchmark->name, bench->tree, bench->kb->node_count, bench->kb->diagnosis_count, iterations,
+               ns, allocs, bytes);
+    }
+    fflush(stdout);
+    return 1;
+}
+
+
+int main(int argc, char* argv[]) {
+    static const Benchmark benchmarks[] = {
+        { "build", benchBuild },
+        { "teardown", benchTeardown },
+        { "traverse", benchTraverse },
+        { "render_ansi", benchRender },
+        { "render_json", benchRender },
+        { "evaluate_scalar", benchEvaluate }
+    };
+    double min_ms = BENCH_DEFAULT_MIN_MS;
+    long max_nodes = BENCH_DEFAULT_MAX_NODES;
+    const char* filter = NULL;
+    int table = 0;
+    int ok = 1;
+    
+    while (argc >= 2) {
+        if (argc >= 3 && (strcmp(argv[1], "--min-ms") == 0 || strcmp(argv[1], "--max-nodes") == 0
+                          || strcmp(argv[1], "--filter") == 0)) {
+            if (strcmp(argv[1], "--min-ms") == 0) {
+                min_ms = atof(argv[2]);
+            } else if (strcmp(argv[1], "--max-nodes") == 0) {
+                max_nodes = atol(argv[2]);
+            } else {
+                filter = argv[2];
+            }
+            argv += 2;
+            argc -= 2;
+        } else if (strcmp(argv[1], "--table") == 0) {
+            table = 1;
+            argv++;
+            argc--;
+        } else {
+            fprintf(stderr, "Usage: kb_bench [--min-ms MS] [--max-nodes N] [--filter NAME] [--table]\n");
+            fprintf(stderr, "       Prints one JSON object per benchmark and tree size (ns, allocations and bytes per op;\n");
+            fprintf(stderr, "       an evaluate_scalar op is one answer record, evaluated in blocks of %d)\n", EVAL_BLOCK_RECORDS);
+            return 2;
+        }
+    }
+    if (min_ms <= 0.0) {
+        min_ms = BENCH_DEFAULT_MIN_MS;
+    }
+    
+    if (table) {
+        printf("%-15s %-10s %9s %9s %12s %14s %12s %14s\n", "benchmark", "tree", "nodes", "diagnoses",
+               "iterations", "ns/op", "allocs/op", "bytes/op");
+    }
+    for (long nodes = 0; ok && nodes <= max_nodes; nodes = nodes == 0 ? 1000 : nodes * 10) {
+        BenchCase bench;
+        memset(&bench, 0, sizeof(bench));
+        bench.tree = nodes == 0 ? "builtin" : "synthetic";
+        bench.leaves = (uint32_t)((nodes + 1) / 2);
+        bench.kb = buildBenchTree(&bench);
+        if (bench.kb == NULL) {
+            return 1;
+        }
+        bench.path_offsets = (uint32_t*)trackedMalloc(((size_t)bench.kb->node_count + 1) * sizeof(uint32_t));
+        if (bench.path_offsets == NULL || enumeratePaths(bench.kb, collectBenchPath, &bench) < 0 || bench.failed) {
+            fprintf(stderr, "Memory allocation failed!\n");
+            releaseKnowledgeBase(bench.kb);
+            free(bench.path_offsets);
+            free(bench.paths);
+            return 1;
+        }
+    
+        for (size_t b = 0; ok && b < sizeof(benchmarks) / sizeof(benchmarks[0]); b++) {
+            if (filter != NULL && strstr(benchmarks[b].name, filter) == NULL) {
+                continue;
+            }
+            bench.format = strcmp(benchmarks[b].name, "render_json") == 0 ? RENDER_JSON : RENDER_ANSI;
+            bench.cursor = 0;
+            ok = runBenchmark(&bench, &benchmarks[b], min_ms, table);
+        }
+        releaseKnowledgeBase(bench.kb);
+        free(bench.path_offsets);
+        free(bench.paths);
+        free(bench.sink.data);
+        free(bench.answers);
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,171 @@
+#define HEALTH_CHECKER_NO_MAIN
+#include "Health_Checker.c"
+
+#define CODEGEN_LINE_BYTES 96
+
+
+void writeStringBlob(FILE* out, const char* data, uint32_t length);
+void writeTables(FILE* out, const KnowledgeBase* kb);
+void writeTarget(FILE* out, const KnowledgeBase* kb, uint32_t child, uint32_t next);
+void writeEvaluator(FILE* out, const KnowledgeBase* kb);
+int generateHeader(const KnowledgeBase* kb, const char* path, const char* source);
+
+
+void writeStringBlob(FILE* out, const char* data, uint32_t length) {
+    fprintf(out, "static const char g_generated_strings[GENERATED_STRING_BYTES + 1] =\n    \"");
+    for (uint32_t i = 0, column = 0; i < length; i++) {
+        unsigned char c = (unsigned char)data[i];
+        if (column >= CODEGEN_LINE_BYTES) {
+            fprintf(out, "\"\n    \"");
+            column = 0;
+        }
+        if (c == '"' || c == '\\') {
+            column += (uint32_t)fprintf(out, "\\%c", c);
+        } else if (c >= 0x20 && c < 0x7F && c != '?') {
+            fputc(c, out);
+            column++;
+        } else {
+            column += (uint32_t)fprintf(out, "\\%03o", c);
+        }
+    }
+    fprintf(out, "\";\n\n\n");
+}
+
+
+void writeTables(FILE* out, const KnowledgeBase* kb) {
+    fprintf(out, "static const FlatNode g_generated_flat[GENERATED_NODE_COUNT] = {\n");
+    for (uint32_t i = 0; i < kb->node_count; i++) {
+        const FlatNode* node = &kb->flat[i];
+        fprintf(out, "    {{%uu, %uu}, %uu, %uu},\n", node->child[0], node->child[1], node->payload, node->question);
+    }
+    fprintf(out, "};\n\n\n");
+    
+    fprintf(out, "static const Diagnosis g_generated_diagnoses[GENERATED_DIAGNOSIS_COUNT] = {\n");
+    for (uint32_t i = 0; i < kb->diagnosis_count; i++) {
+        const Diagnosis* diagnosis = &kb->diagnoses[i];
+        fprintf(out, "    {%uu, %s, %uu, %uu, %uu, %uu, %uu},\n", diagnosis->condition,
+                severityName(diagnosis->severity), diagnosis->description, diagnosis->remedies,
+                diagnosis->medications, diagnosis->when_to_see_doctor, diagnosis->prevention);
+    }
+    fprintf(out, "};\n\n\n");
+}
+
+
+void writeTarget(FILE* out, const KnowledgeBase* kb, uint32_t child, uint32_t next) {
+    if (kb->flat[child].question == FLAT_LEAF) {
+        fprintf(out, "return %uu;", kb->flat[child].payload);
+    } else if (child == next) {
+        fprintf(out, "break;");
+    } else {
+        fprintf(out, "goto n%u;", child);
+    }
+}
+
+
+void writeEvaluator(FILE* out, const KnowledgeBase* kb) {
+    uint8_t* labelled = (uint8_t*)trackedMalloc(kb->node_count);
+    
+    fprintf(out, "static uint32_t generatedEvaluate(const char* answers, size_t length) {\n");
+    if (labelled == NULL || kb->flat[0].question == FLAT_LEAF) {
+        fprintf(out, "    (void)answers;\n    (void)length;\n    return %uu;\n}\n",
+                labelled != NULL ? kb->flat[0].payload : FLAT_LEAF);
+        free(labelled);
+        return;
+    }
+    memset(labelled, 0, kb->node_count);
+    
+    for (uint32_t i = 0; i < kb->node_count; i++) {
+        uint32_t next = i + 1;
+        if (kb->flat[i].question == FLAT_LEAF) {
+            continue;
+        }
+        while (next < kb->node_count && kb->flat[next].question == FLAT_LEAF) {
+            next++;
+        }
+        for (int bit = 0; bit < 2; bit++) {
+            uint32_t child = kb->flat[i].child[bit];
+            if (kb->flat[child].question != FLAT_LEAF && !(bit == 0 && child == next)) {
+                labelled[child] = 1;
+            }
+        }
+    }
+    
+    for (uint32_t i = 0; i < kb->node_count; i++) {
+        const FlatNode* node = &kb->flat[i];
+        uint32_t next = i + 1;
+        if (node->question == FLAT_LEAF) {
+            continue;
+        }
+        while (next < kb->node_count && kb->flat[next].question == FLAT_LEAF) {
+            next++;
+        }
+        if (labelled[i]) {
+            fprintf(out, "n%u:\n", i);
+        }
+        fprintf(out, "    if (length <= %uu) {\n        return FLAT_LEAF;\n    }\n", node->question);
+        fprintf(out, "    switch (answers[%u]) {\n        case 'Y': case 'y': case '1': ", node->question);
+        writeTarget(out, kb, node->child[1], FLAT_LEAF);
+        fprintf(out, "\n        case 'N': case 'n': case '0': ");
+        writeTarget(out, kb, node->child[0], next);
+        fprintf(out, "\n        default: return FLAT_LEAF;\n    }\n");
+    }
+    fprintf(out, "    return FLAT_LEAF;\n}\n");
+    free(labelled);
+}
+
+
+int generateHeader(const KnowledgeBase* kb, const char* path, const char* source) {
+    FILE* out = fopen(path, "w");
+    if (out == NULL) {
+        fprintf(stderr, "Cannot create %s\n", path);
+        return 0;
+    }
+    
+    fprintf(out, "/* Generated by kb_codegen from %s; do not edit. */\n\n", source);
+    fprintf(out, "#define GENERATED_VERSION 0x%08xu\n", kb->version);
+    fprintf(out, "#define GENERATED_NODE_COUNT %uu\n", kb->node_count);
+    fprintf(out, "#define GENERATED_QUESTION_COUNT %uu\n", kb->question_count);
+    fprintf(out, "#define GENERATED_DIAGNOSIS_COUNT %uu\n", kb->diagnosis_count);
+    fprintf(out, "#define GENERATED_MAX_DEPTH %uu\n", kb->max_depth);
+    fprintf(out, "#define GENERATED_EXPECTED_DEPTH %.17g\n", kb->expected_depth);
+    fprintf(out, "#define GENERATED_STRING_BYTES %uu\n\n\n", kb->strings.used);
+    
+    writeStringBlob(out, kb->strings.data, kb->strings.used);
+    writeTables(out, kb);
+    writeEvaluator(out, kb);
+    
+    if (fclose(out) != 0) {
+        fprintf(stderr, "Failed to write %s\n", path);
+        return 0;
+    }
+    return 1;
+}
+
+
+int main(int argc, char* argv[]) {
+    const char* kb_path = NULL;
+    
+    if (argc >= 3 && strcmp(argv[1], "--kb") == 0) {
+        kb_path = argv[2];
+        argv += 2;
+        argc -= 2;
+    }
+    if (argc != 2) {
+        fprintf(stderr, "Usage: kb_codegen [--kb INPUT.kb] OUTPUT.h\n");
+        fprintf(stderr, "       then build with -DHEALTH_CHECKER_GENERATED to link the tree in as code\n");
+        return 2;
+    }
+    
+    KnowledgeBase* kb = kb_path != NULL ? loadKnowledgeBaseFile(kb_path) : interpretKnowledgeBase();
+    if (kb == NULL) {
+        return 1;
+    }
+    if (!generateHeader(kb, argv[1], kb_path != NULL ? kb_path : "buildSymptomTree")) {
+        releaseKnowledgeBase(kb);
+        return 1;
+    }
+    printf("Wrote %s: %u nodes, %u questions, %u diagnoses, %u string bytes, version %08x\n", argv[1],
+           kb->node_count, kb->question_count, kb->diagnosis_count, kb->strings.used, kb->version);
+    releaseKnowledgeBase(kb);
+    return 0;
+}
@@ -0,0 +1,557 @@
+#define HEALTH_CHECKER_NO_MAIN
+#include "Health_Checker.c"
+#include <stdarg.h>
+
+#define SOURCE_NO_RECORD 0xFFFFFFFFu
+#define SOURCE_FIELD_COUNT 6
+
+typedef enum {
+    RECORD_QUESTION,
+    RECORD_DIAGNOSIS
+} RecordKind;
+
+typedef enum {
+    COLOR_WHITE,
+    COLOR_GREY,
+    COLOR_BLACK
+} VisitColor;
+
+typedef struct {
+    RecordKind kind;
+    const char* name;
+    int line;
+    const char* text;
+    const char* yes;
+    const char* no;
+    int yes_line;
+    int no_line;
+    uint32_t yes_index;
+    uint32_t no_index;
+    const char* fields[SOURCE_FIELD_COUNT];
+    int has_severity;
+    Severity severity;
+    VisitColor color;
+    TreeNode* node;
+} SourceRecord;
+
+typedef struct {
+    const char* path;
+    char* buffer;
+    SourceRecord* records;
+    uint32_t count;
+    uint32_t capacity;
+    uint32_t* slots;
+    uint32_t slot_count;
+    const char* root_name;
+    int root_line;
+    uint32_t* order;
+    uint32_t order_count;
+    int errors;
+} SourceFile;
+
+static const char* field_names[SOURCE_FIELD_COUNT] = {
+    "condition", "description", "remedies", "medications", "when_to_see_doctor", "prevention"
+};
+
+void sourceError(SourceFile* src, int line, const char* format, ...);
+char* readSourceFile(const char* path);
+char* trimText(char* text);
+uint32_t findRecord(const SourceFile* src, const char* name);
+int addRecord(SourceFile* src, RecordKind kind, const char* name, int line);
+void parseField(SourceFile* src, SourceRecord* record, char* key, char* value, int line);
+int parseSource(SourceFile* src);
+uint32_t resolveReference(SourceFile* src, const char* name, int line);
+void resolveRecords(SourceFile* src);
+void checkStructure(SourceFile* src, uint32_t root);
+TreeNode* buildRecordTree(SourceFile* src, KnowledgeBase* kb, uint32_t root);
+void releaseSource(SourceFile* src);
+
+
+void sourceError(SourceFile* src, int line, const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    fprintf(stderr, "\033[31m%s:%d: ", src->path, line);
+    vfprintf(stderr, format, args);
+    va_end(args);
+    fprintf(stderr, "\033[0m\n");
+    src->errors++;
+}
+
+
+char* readSourceFile(const char* path) {
+    FILE* input = fopen(path, "rb");
+    if (input == NULL) {
+        return NULL;
+    }
+    
+    size_t capacity = 65536;
+    size_t length = 0;
+    char* buffer = (char*)trackedMalloc(capacity);
+    while (buffer != NULL) {
+        length += fread(buffer + length, 1, capacity - length - 1, input);
+        if (length < capacity - 1) {
+            break;
+        }
+        char* grown = (char*)realloc(buffer, capacity * 2);
+        if (grown == NULL) {
+            free(buffer);
+            buffer = NULL;
+            break;
+        }
+        buffer = grown;
+        capacity *= 2;
+    }
+    
+    if (buffer != NULL) {
+        buffer[length] = '\0';
+    }
+    fclose(input);
+    return buffer;
+}
+
+
+char* trimText(char* text) {
+    while (*text == ' ' || *text == '\t') {
+        text++;
+    }
+    
+    size_t length = strlen(text);
+    while (length > 0 && isspace((unsigned char)text[length - 1])) {
+        text[--length] = '\0';
+    }
+    return text;
+}
+
+
+uint32_t findRecord(const SourceFile* src, const char* name) {
+    uint32_t slot = hashString(name, strlen(name)) & (src->slot_count - 1);
+    
+    while (src->slots[slot] != SOURCE_NO_RECORD) {
+        if (strcmp(src->records[src->slots[slot]].name, name) == 0) {
+            return src->slots[slot];
+        }
+        slot = (slot + 1) & (src->slot_count - 1);
+    }
+    return SOURCE_NO_RECORD;
+}
+
+
+int addRecord(SourceFile* src, RecordKind kind, const char* name, int line) {
+    if (src->count * 2 >= src->slot_count) {
+        uint32_t slot_count = src->slot_count * 2;
+        uint32_t* slots = (uint32_t*)trackedMalloc(slot_count * sizeof(uint32_t));
+        if (slots == NULL) {
+            return 0;
+        }
+        memset(slots, 0xFF, slot_count * sizeof(uint32_t));
+        for (uint32_t i = 0; i < src->count; i++) {
+            uint32_t slot = hashString(src->records[i].name, strlen(src->records[i].name)) & (slot_count - 1);
+            while (slots[slot] != SOURCE_NO_RECORD) {
+                slot = (slot + 1) & (slot_count - 1);
+            }
+            slots[slot] = i;
+        }
+        free(src->slots);
+        src->slots = slots;
+        src->slot_count = slot_count;
+    }
+    
+    if (src->count == src->capacity) {
+        uint32_t capacity = src->capacity * 2;
+        SourceRecord* records = (SourceRecord*)realloc(src->records, capacity * sizeof(SourceRecord));
+        if (records == NULL) {
+            return 0;
+        }
+        src->records = records;
+        src->capacity = capacity;
+    }
+    
+    uint32_t existing = findRecord(src, name);
+    if (existing != SOURCE_NO_RECORD) {
+        sourceError(src, line, "duplicate record name '%s'", name);
+        fprintf(stderr, "%s:%d: note: first defined here\n", src->path, src->records[existing].line);
+        return 1;
+    }
+    
+    SourceRecord* record = &src->records[src->count];
+    memset(record, 0, sizeof(SourceRecord));
+    record->kind = kind;
+    record->name = name;
+    record->line = line;
+    record->yes_index = SOURCE_NO_RECORD;
+    record->no_index = SOURCE_NO_RECORD;
+    record->color = COLOR_WHITE;
+    
+    uint32_t slot = hashString(name, strlen(name)) & (src->slot_count - 1);
+    while (src->slots[slot] != SOURCE_NO_RECORD) {
+        slot = (slot + 1) & (src->slot_count - 1);
+    }
+    src->slots[slot] = src->count++;
+    return 1;
+}
+
+
+void parseField(SourceFile* src, SourceRecord* record, char* key, char* value, int line) {
+    const char** target = NULL;
+    
+    if (record->kind == RECORD_QUESTION) {
+        if (strcmp(key, "text") == 0) {
+            target = &record->text;
+        } else if (strcmp(key, "yes") == 0) {
+            target = &record->yes;
+            record->yes_line = line;
+        } else if (strcmp(key, "no") == 0) {
+            target = &record->no;
+            record->no_line = line;
+        }
+    } else if (strcmp(key, "severity") == 0) {
+        if (record->has_severity) {
+            sourceError(src, line, "duplicate field '%s'", key);
+            return;
+        }
+        record->has_severity = 1;
+        if (strcmp(value, "EMERGENCY") == 0) {
+            record->severity = EMERGENCY;
+        } else if (strcmp(value, "URGENT") == 0) {
+            record->severity = URGENT;
+        } else if (strcmp(value, "MODERATE") == 0) {
+            record->severity = MODERATE;
+        } else if (strcmp(value, "MILD") == 0) {
+            record->severity = MILD;
+        } else {
+            sourceError(src, line, "unknown severity '%s'", value);
+        }
+        return;
+    } else {
+        for (int i = 0; i < SOURCE_FIELD_COUNT; i++) {
+            if (strcmp(key, field_names[i]) == 0) {
+                target = &record->fields[i];
+            }
+        }
+    }
+    
+    if (target == NULL) {
+        sourceError(src, line, "unknown field '%s'", key);
+    } else if (*target != NULL) {
+        sourceError(src, line, "duplicate field '%s'", key);
+    } else {
+        *target = value;
+    }
+}
+
+
+int parseSource(SourceFile* src) {
+    char* cursor = src->buffer;
+    int line = 0;
+    int skipping = 0;
+    SourceRecord* current = NULL;
+    
+    while (*cursor != '\0') {
+        char* start = cursor;
+        char* end = strchr(cursor, '\n');
+        if (end != NULL) {
+            *end = '\0';
+            cursor = end + 1;
+        } else {
+            cursor += strlen(cursor);
+        }
+        line++;
+    
+        int indented = (*start == ' ' || *start == '\t');
+        char* text = trimText(start);
+        if (*text == '\0' || *text == '#') {
+            continue;
+        }
+    
+        if (indented) {
+            char* colon = strchr(text, ':');
+            if (current == NULL && skipping) {
+                continue;
+            } else if (current == NULL) {
+                sourceError(src, line, "field outside of a record");
+            } else if (colon == NULL) {
+                sourceError(src, line, "expected 'key: value', got '%s'", text);
+            } else {
+                *colon = '\0';
+                parseField(src, current, trimText(text), trimText(colon + 1), line);
+            }
+            continue;
+        }
+    
+        char* name = text;
+        while (*name != '\0' && !isspace((unsigned char)*name)) {
+            name++;
+        }
+        if (*name != '\0') {
+            *name++ = '\0';
+            name = trimText(name);
+        }
+        current = NULL;
+        skipping = 0;
+    
+        if (*name == '\0' || strpbrk(name, " \t") != NULL) {
+            sourceError(src, line, "'%s' expects a single name", text);
+        } else if (strcmp(text, "question") == 0 || strcmp(text, "diagnosis") == 0) {
+            uint32_t count = src->count;
+            if (!addRecord(src, text[0] == 'q' ? RECORD_QUESTION : RECORD_DIAGNOSIS, name, line)) {
+                fprintf(stderr, "Memory allocation failed!\n");
+                return 0;
+            }
+            if (src->count > count) {
+                current = &src->records[count];
+            } else {
+                skipping = 1;
+            }
+        } else if (strcmp(text, "root") == 0) {
+            if (src->root_name != NULL) {
+                sourceError(src, line, "duplicate root directive '%s'", name);
+            }
+            src->root_name = name;
+            src->root_line = line;
+        } else if (strcmp(text, "version") == 0) {
+            sourceError(src, line, "the version is a checksum of the content and cannot be set");
+        } else {
+            sourceError(src, line, "unknown directive '%s'", text);
+        }
+    }
+    
+    return 1;
+}
+
+
+uint32_t resolveReference(SourceFile* src, const char* name, int line) {
+    uint32_t index = findRecord(src, name);
+    if (index == SOURCE_NO_RECORD) {
+        sourceError(src, line, "branch refers to undefined record '%s'", name);
+    }
+    return index;
+}
+
+
+void resolveRecords(SourceFile* src) {
+    for (uint32_t i = 0; i < src->count; i++) {
+        SourceRecord* record = &src->records[i];
+    
+        if (record->kind == RECORD_DIAGNOSIS) {
+            if (!record->has_severity) {
+                sourceError(src, record->line, "diagnosis '%s' has no severity", record->name);
+            }
+            for (int f = 0; f < SOURCE_FIELD_COUNT; f++) {
+                if (record->fields[f] == NULL) {
+                    sourceError(src, record->line, "diagnosis '%s' has no %s", record->name, field_names[f]);
+                }
+            }
+            continue;
+        }
+    
+        if (record->text == NULL) {
+            sourceError(src, record->line, "question '%s' has no text", record->name);
+        }
+        if (record->yes == NULL) {
+            sourceError(src, record->line, "question '%s' has no yes branch", record->name);
+        } else {
+            record->yes_index = resolveReference(src, record->yes, record->yes_line);
+        }
+        if (record->no == NULL) {
+            sourceError(src, record->line, "question '%s' has no no branch", record->name);
+        } else {
+            record->no_index = resolveReference(src, record->no, record->no_line);
+        }
+    }
+}
+
+
+void checkStructure(SourceFile* src, uint32_t root) {
+    uint32_t* stack = (uint32_t*)trackedMalloc(src->count * sizeof(uint32_t));
+    src->order = (uint32_t*)trackedMalloc(src->count * sizeof(uint32_t));
+    if (stack == NULL || src->order == NULL) {
+        free(stack);
+        fprintf(stderr, "Memory allocation failed!\n");
+        src->errors++;
+        return;
+    }
+    
+    uint32_t sp = 0;
+    stack[sp++] = root;
+    src->records[root].color = COLOR_GREY;
+    while (sp > 0) {
+        SourceRecord* record = &src->records[stack[sp - 1]];
+        uint32_t next = SOURCE_NO_RECORD;
+    
+        if (record->kind == RECORD_QUESTION) {
+            uint32_t children[2] = { record->yes_index, record->no_index };
+            for (int i = 0; i < 2 && next == SOURCE_NO_RECORD; i++) {
+                if (children[i] == SOURCE_NO_RECORD) {
+                    continue;
+                }
+                SourceRecord* child = &src->records[children[i]];
+                if (child->color == COLOR_WHITE) {
+                    next = children[i];
+                } else if (child->color == COLOR_GREY) {
+                    sourceError(src, i == 0 ? record->yes_line : record->no_line,
+                                "branch to '%s' creates a cycle", child->name);
+                    if (i == 0) {
+                        record->yes_index = SOURCE_NO_RECORD;
+                    } else {
+                        record->no_index = SOURCE_NO_RECORD;
+                    }
+                }
+            }
+        }
+    
+        if (next != SOURCE_NO_RECORD) {
+            src->records[next].color = COLOR_GREY;
+            stack[sp++] = next;
+            continue;
+        }
+    
+        record->color = COLOR_BLACK;
+        src->order[src->order_count++] = stack[--sp];
+    }
+    free(stack);
+    
+    for (uint32_t i = 0; i < src->count; i++) {
+        if (src->records[i].color == COLOR_WHITE) {
+            sourceError(src, src->records[i].line, "record '%s' is unreachable from the root",
+                        src->records[i].name);
+        }
+    }
+}
+
+
+TreeNode* buildRecordTree(SourceFile* src, KnowledgeBase* kb, uint32_t root) {
+    for (uint32_t i = 0; i < src->order_count; i++) {
+        SourceRecord* record = &src->records[src->order[i]];
+    
+        if (record->kind == RECORD_DIAGNOSIS) {
+            const char** fields = record->fields;
+            record->node = createDiagnosisNode(kb, createDiagnosis(kb, fields[0], record->severity,
+                                                                   fields[1], fields[2], fields[3],
+                                                                   fields[4], fields[5]));
+        } else {
+            record->node = createNode(kb, QUESTION_NODE, record->text);
+            setYesBranch(record->node, src->records[record->yes_index].node);
+            setNoBranch(record->node, src->records[record->no_index].node);
+        }
+    
+        if (record->node == NULL) {
+            return NULL;
+        }
+    }
+    
+    if (kb->nodes.failed || kb->payload.failed || kb->strings.failed) {
+        return NULL;
+    }
+    return src->records[root].node;
+}
+
+
+void releaseSource(SourceFile* src) {
+    free(src->buffer);
+    free(src->records);
+    free(src->slots);
+    free(src->order);
+}
+
+
+int main(int argc, char* argv[]) {
+    int check_only = 0;
+    double start;
+    SourceFile src;
+    
+    if (argc >= 2 && strcmp(argv[1], "--check") == 0) {
+        check_only = 1;
+        argv++;
+        argc--;
+    }
+    if (argc != (check_only ? 2 : 3)) {
+        fprintf(stderr, "Usage: kb_compiler SOURCE OUTPUT.kb\n");
+        fprintf(stderr, "       kb_compiler --check SOURCE\n");
+        return 2;
+    }
+    
+    start = monotonicMs();
+    memset(&src, 0, sizeof(src));
+    src.path = argv[1];
+    src.buffer = readSourceFile(argv[1]);
+    if (src.buffer == NULL) {
+        fprintf(stderr, "Cannot read %s\n", argv[1]);
+        return 1;
+    }
+    
+    src.capacity = 256;
+    src.slot_count = 512;
+    src.records = (SourceRecord*)trackedMalloc(src.capacity * sizeof(SourceRecord));
+    src.slots = (uint32_t*)trackedMalloc(src.slot_count * sizeof(uint32_t));
+    if (src.records == NULL || src.slots == NULL) {
+        fprintf(stderr, "Memory allocation failed!\n");
+        releaseSource(&src);
+        return 1;
+    }
+    memset(src.slots, 0xFF, src.slot_count * sizeof(uint32_t));
+    
+    if (!parseSource(&src)) {
+        releaseSource(&src);
+        return 1;
+    }
+    resolveRecords(&src);
+    
+    uint32_t root = SOURCE_NO_RECORD;
+    if (src.root_name != NULL) {
+        root = findRecord(&src, src.root_name);
+        if (root == SOURCE_NO_RECORD) {
+            sourceError(&src, src.root_line, "root refers to undefined record '%s'", src.root_name);
+        }
+    } else {
+        for (uint32_t i = 0; i < src.count && root == SOURCE_NO_RECORD; i++) {
+            if (src.records[i].kind == RECORD_QUESTION) {
+                root = i;
+            }
+        }
+        if (root == SOURCE_NO_RECORD) {
+            sourceError(&src, 1, "no question records");
+        }
+    }
+    if (root != SOURCE_NO_RECORD && src.records[root].kind != RECORD_QUESTION) {
+        sourceError(&src, src.root_line, "root '%s' must be a question", src.records[root].name);
+    }
+    
+    if (src.errors == 0) {
+        checkStructure(&src, root);
+    }
+    if (src.errors > 0) {
+        fprintf(stderr, "%s: %d error%s, nothing written\n", src.path, src.errors, src.errors == 1 ? "" : "s");
+        releaseSource(&src);
+        return 1;
+    }
+    
+    KnowledgeBase* kb = beginKnowledgeBase();
+    if (kb == NULL) {
+        releaseSource(&src);
+        return 1;
+    }
+    kb->root = buildRecordTree(&src, kb, root);
+    if (kb->root == NULL) {
+        fprintf(stderr, "Memory allocation failed while building the symptom tree!\n");
+        releaseKnowledgeBase(kb);
+        releaseSource(&src);
+        return 1;
+    }
+    if (!finishKnowledgeBase(kb)) {
+        releaseKnowledgeBase(kb);
+        releaseSource(&src);
+        return 1;
+    }
+    int ok = check_only || exportKnowledgeBase(kb, argv[2]);
+    if (ok) {
+        printf("%s: %u records -> %u nodes (%u questions, %u leaves)\n", src.path, src.count,
+               kb->node_count, kb->question_count, kb->diagnosis_count);
+        printf("  max depth %u, expected path length %.3f, version %08x\n",
+               kb->max_depth, kb->expected_depth, kb->version);
+        printf("  %s in %.2f ms\n", check_only ? "checked" : "wrote", monotonicMs() - start);
+    }
+    
+    releaseKnowledgeBase(kb);
+    releaseSource(&src);
+    return ok ? 0 : 1;
+}
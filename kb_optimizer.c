@@ -0,0 +1,620 @@
+#define HEALTH_CHECKER_NO_MAIN
+#include "Health_Checker.c"
+#include <math.h>
+
+#define OPTIMIZER_MAX_RULES (1u << 20)
+#define OPTIMIZER_NO_PIN 0xFFFFFFFFu
+#define OPTIMIZER_EXHAUSTIVE_QUESTIONS 20
+#define OPTIMIZER_RANDOM_CHECKS 200000
+
+typedef struct {
+    uint32_t diagnosis;
+    uint32_t first;
+    uint32_t count;
+} DecisionRule;
+
+typedef struct {
+    const KnowledgeBase* kb;
+    DecisionRule* rules;
+    uint32_t rule_count;
+    uint32_t rule_capacity;
+    uint32_t* literals;
+    size_t literal_count;
+    size_t literal_capacity;
+    uint32_t path[TOKEN_MAX_ANSWERS];
+    double* yes_probability;
+    unsigned long* yes_counts;
+    unsigned long* answer_counts;
+    signed char* assigned;
+    uint32_t* stamps;
+    uint32_t stamp;
+    double* side_mass[2];
+    uint32_t* touched;
+    uint32_t pinned;
+    KnowledgeBase* out;
+    TreeNode** leaves;
+    uint32_t* question_texts;
+    double expected;
+    uint32_t max_depth;
+    uint32_t question_nodes;
+    int failed;
+} Optimizer;
+
+int collectRules(Optimizer* opt, uint32_t node, uint32_t depth);
+int loadAnswerStatistics(Optimizer* opt, const char* path);
+uint32_t findEmergencyQuestion(const KnowledgeBase* kb);
+double expectedQuestions(const KnowledgeBase* kb, const double* yes_probability);
+double ruleMass(const Optimizer* opt, const DecisionRule* rule);
+double splitEntropy(Optimizer* opt, const uint32_t* active, uint32_t count, const double* mass, uint32_t question);
+TreeNode* leafFor(Optimizer* opt, uint32_t diagnosis);
+TreeNode* buildOptimized(Optimizer* opt, const uint32_t* active, uint32_t count, double reach, uint32_t depth);
+long verifyEquivalent(const KnowledgeBase* original, const KnowledgeBase* optimized);
+void releaseOptimizer(Optimizer* opt);
+
+
+int collectRules(Optimizer* opt, uint32_t node, uint32_t depth) {
+    const FlatNode* flat = &opt->kb->flat[node];
+    
+    if (flat->question == FLAT_LEAF) {
+        if (opt->rule_count == OPTIMIZER_MAX_RULES) {
+            fprintf(stderr, "More than %u root-to-leaf paths; the tree is too large to optimize\n",
+                    OPTIMIZER_MAX_RULES);
+            return 0;
+        }
+        if (opt->rule_count == opt->rule_capacity) {
+            uint32_t capacity = opt->rule_capacity > 0 ? opt->rule_capacity * 2 : 256;
+            DecisionRule* rules = (DecisionRule*)realloc(opt->rules, capacity * sizeof(DecisionRule));
+            if (rules == NULL) {
+                return 0;
+            }
+            opt->rules = rules;
+            opt->rule_capacity = capacity;
+        }
+        if (opt->literal_count + depth > opt->literal_capacity) {
+            size_t capacity = opt->literal_capacity > 0 ? opt->literal_capacity * 2 : 4096;
+            while (capacity < opt->literal_count + depth) {
+                capacity *= 2;
+            }
+            uint32_t* literals = (uint32_t*)realloc(opt->literals, capacity * sizeof(uint32_t));
+            if (literals == NULL) {
+                return 0;
+            }
+            opt->literals = literals;
+            opt->literal_capacity = capacity;
+        }
+    
+        DecisionRule* rule = &opt->rules[opt->rule_count++];
+        rule->diagnosis = flat->payload;
+        rule->first = (uint32_t)opt->literal_count;
+        rule->count = depth;
+        memcpy(opt->literals + opt->literal_count, opt->path, depth * sizeof(uint32_t));
+        opt->literal_count += depth;
+        return 1;
+    }
+    
+    for (int bit = 1; bit >= 0; bit--) {
+        uint32_t literal = flat->question << 1 | (uint32_t)bit;
+        int repeated = 0;
+        for (uint32_t i = 0; i < depth; i++) {
+            if (opt->path[i] >> 1 == flat->question) {
+                repeated = opt->path[i] == literal ? 1 : -1;
+            }
+        }
+        if (repeated < 0) {
+            continue;
+        }
+        if (repeated == 0 && depth == TOKEN_MAX_ANSWERS) {
+            fprintf(stderr, "Paths deeper than %d questions cannot be optimized\n", TOKEN_MAX_ANSWERS);
+            return 0;
+        }
+        if (repeated == 0) {
+            opt->path[depth] = literal;
+        }
+        if (!collectRules(opt, flat->child[bit], depth + (repeated == 0))) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+
+int loadAnswerStatistics(Optimizer* opt, const char* path) {
+    const KnowledgeBase* kb = opt->kb;
+    FILE* in = fopen(path, "rb");
+    char* line = (char*)trackedMalloc(BATCH_READ_BUFFER);
+    long records = 0;
+    long samples = 0;
+    long line_number = 0;
+    long foreign = 0;
+    int ok = 1;
+    
+    if (in == NULL || line == NULL) {
+        fprintf(stderr, "Cannot read %s\n", path);
+        if (in != NULL) {
+            fclose(in);
+        }
+        free(line);
+        return 0;
+    }
+    
+    while (ok && fgets(line, BATCH_READ_BUFFER, in) != NULL) {
+        size_t length = strcspn(line, "\r\n");
+        line_number++;
+        if (line[length] == '\0' && !feof(in)) {
+            if (length == BATCH_READ_BUFFER - 1) {
+                fprintf(stderr, "%s:%ld: line longer than %d bytes\n", path, line_number, BATCH_READ_BUFFER);
+            } else {
+                fprintf(stderr, "%s:%ld: line contains a NUL byte\n", path, line_number);
+            }
+            ok = 0;
+            break;
+        }
+        if (strncmp(line, "health_checker_node_answers_total{", 34) == 0) {
+            const char* version = strstr(line, "kb=\"");
+            const char* node = strstr(line, "node=\"");
+            const char* answer = strstr(line, "answer=\"");
+            const char* value = strchr(line, '}');
+            unsigned long index;
+            if (version == NULL || node == NULL || answer == NULL || value == NULL) {
+                fprintf(stderr, "%s:%ld: malformed answer metric\n", path, line_number);
+                ok = 0;
+                break;
+            }
+            if (strtoul(version + 4, NULL, 16) != kb->version) {
+                foreign++;
+                continue;
+            }
+            if ((index = strtoul(node + 6, NULL, 10)) >= kb->node_count
+                || kb->flat[index].question == FLAT_LEAF) {
+                fprintf(stderr, "%s:%ld: node %lu is not a question\n", path, line_number, index);
+                ok = 0;
+                break;
+            }
+            unsigned long count = strtoul(value + 1, NULL, 10);
+            uint32_t question = kb->flat[index].question;
+            opt->answer_counts[question] += count;
+            if (strncmp(answer + 8, "yes", 3) == 0) {
+                opt->yes_counts[question] += count;
+            }
+            samples += (long)count;
+            continue;
+        }
+        if (line[0] == '#' || length == 0 || strncmp(line, "health_checker_", 15) == 0) {
+            continue;
+        }
+        if (length != kb->question_count) {
+            fprintf(stderr, "%s:%ld: answer record has %zu answers, expected %u\n",
+                    path, line_number, length, kb->question_count);
+            ok = 0;
+            break;
+        }
+        for (uint32_t q = 0; q < kb->question_count; q++) {
+            int bit = answerBit(line[q]);
+            if (bit < 0 && line[q] != '?') {
+                fprintf(stderr, "%s:%ld: answer record has byte 0x%02x at position %u (expected Y, N or ?)\n",
+                        path, line_number, (unsigned char)line[q], q + 1);
+                ok = 0;
+                break;
+            }
+            if (bit >= 0) {
+                opt->answer_counts[q]++;
+                opt->yes_counts[q] += (unsigned long)bit;
+                samples++;
+            }
+        }
+        records++;
+    }
+    
+    fclose(in);
+    free(line);
+    if (!ok) {
+        return 0;
+    }
+    if (samples == 0) {
+        fprintf(stderr, "%s: no observed answers for knowledge base %08x", path, kb->version);
+        if (foreign > 0) {
+            fprintf(stderr, " (%ld answer metrics are for other versions)", foreign);
+        }
+        fprintf(stderr, "\n");
+        return 0;
+    }
+    printf("Statistics from %s: %ld answer records, %ld observed answers\n", path, records, samples);
+    if (foreign > 0) {
+        printf("  ignored %ld answer metrics for other knowledge base versions\n", foreign);
+    }
+    return 1;
+}
+
+
+uint32_t findEmergencyQuestion(const KnowledgeBase* kb) {
+    for (uint32_t i = 0; i < kb->node_count; i++) {
+        const FlatNode* node = &kb->flat[i];
+        if (node->question == FLAT_LEAF) {
+            continue;
+        }
+        for (int bit = 0; bit < 2; bit++) {
+            const FlatNode* child = &kb->flat[node->child[bit]];
+            if (child->question == FLAT_LEAF && kb->diagnoses[child->payload].severity == EMERGENCY) {
+                return node->question;
+            }
+        }
+    }
+    return OPTIMIZER_NO_PIN;
+}
+
+
+double expectedQuestions(const KnowledgeBase* kb, const double* yes_probability) {
+    double* reach = (double*)trackedMalloc((size_t)kb->node_count * sizeof(double));
+    double expected = 0.0;
+    
+    if (reach == NULL) {
+        return 0.0;
+    }
+    memset(reach, 0, (size_t)kb->node_count * sizeof(double));
+    reach[0] = 1.0;
+    for (uint32_t i = 0; i < kb->node_count; i++) {
+        const FlatNode* node = &kb->flat[i];
+        if (node->question == FLAT_LEAF) {
+            continue;
+        }
+        expected += reach[i];
+        reach[node->child[1]] += reach[i] * yes_probability[node->question];
+        reach[node->child[0]] += reach[i] * (1.0 - yes_probability[node->question]);
+    }
+    free(reach);
+    return expected;
+}
+
+
+double ruleMass(const Optimizer* opt, const DecisionRule* rule) {
+    double mass = 1.0;
+    
+    for (uint32_t i = 0; i < rule->count; i++) {
+        uint32_t literal = opt->literals[rule->first + i];
+        uint32_t question = literal >> 1;
+        if (opt->assigned[question] < 0) {
+            mass *= (literal & 1) ? opt->yes_probability[question] : 1.0 - opt->yes_probability[question];
+        }
+    }
+    return mass;
+}
+
+
+double splitEntropy(Optimizer* opt, const uint32_t* active, uint32_t count, const double* mass, uint32_t question) {
+    double p = opt->yes_probability[question];
+    double side_total[2] = { 0.0, 0.0 };
+    double entropy = 0.0;
+    uint32_t touched = 0;
+    
+    for (uint32_t i = 0; i < count; i++) {
+        const DecisionRule* rule = &opt->rules[active[i]];
+        int answer = -1;
+        for (uint32_t j = 0; j < rule->count && answer < 0; j++) {
+            if (opt->literals[rule->first + j] >> 1 == question) {
+                answer = (int)(opt->literals[rule->first + j] & 1);
+            }
+        }
+        if (opt->side_mass[0][rule->diagnosis] == 0.0 && opt->side_mass[1][rule->diagnosis] == 0.0) {
+            opt->touched[touched++] = rule->diagnosis;
+        }
+        for (int side = 0; side < 2; side++) {
+            double weight = answer < 0 ? mass[i] : answer == side ? mass[i] / (side ? p : 1.0 - p) : 0.0;
+            opt->side_mass[side][rule->diagnosis] += weight;
+            side_total[side] += weight;
+        }
+    }
+    
+    for (uint32_t i = 0; i < touched; i++) {
+        for (int side = 0; side < 2; side++) {
+            double share = side_total[side] > 0.0 ? opt->side_mass[side][opt->touched[i]] / side_total[side] : 0.0;
+            if (share > 0.0) {
+                entropy -= (side ? p : 1.0 - p) * share * log2(share);
+            }
+            opt->side_mass[side][opt->touched[i]] = 0.0;
+        }
+    }
+    return entropy;
+}
+
+
+TreeNode* leafFor(Optimizer* opt, uint32_t diagnosis) {
+    if (opt->leaves[diagnosis] == NULL) {
+        const KnowledgeBase* kb = opt->kb;
+        const Diagnosis* diag = &kb->diagnoses[diagnosis];
+        opt->leaves[diagnosis] = createDiagnosisNode(opt->out,
+            createDiagnosis(opt->out, kbText(kb, diag->condition), diag->severity, kbText(kb, diag->description),
+                            kbText(kb, diag->remedies), kbText(kb, diag->medications),
+                            kbText(kb, diag->when_to_see_doctor), kbText(kb, diag->prevention)));
+    }
+    return opt->leaves[diagnosis];
+}
+
+
+TreeNode* buildOptimized(Optimizer* opt, const uint32_t* active, uint32_t count, double reach, uint32_t depth) {
+    const KnowledgeBase* kb = opt->kb;
+    uint32_t best = OPTIMIZER_NO_PIN;
+    double best_entropy = 0.0;
+    int uniform = 1;
+    
+    for (uint32_t i = 1; i < count && uniform; i++) {
+        uniform = opt->rules[active[i]].diagnosis == opt->rules[active[0]].diagnosis;
+    }
+    if (uniform || opt->failed) {
+        if (depth > opt->max_depth) {
+            opt->max_depth = depth;
+        }
+        return leafFor(opt, opt->rules[active[0]].diagnosis);
+    }
+    
+    double* mass = (double*)trackedMalloc(count * sizeof(double));
+    uint32_t* sides = (uint32_t*)trackedMalloc(2 * (size_t)count * sizeof(uint32_t));
+    if (mass == NULL || sides == NULL) {
+        free(mass);
+        free(sides);
+        opt->failed = 1;
+        return NULL;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        mass[i] = ruleMass(opt, &opt->rules[active[i]]);
+    }
+    
+    if (depth == 0 && opt->pinned != OPTIMIZER_NO_PIN) {
+        best = opt->pinned;
+    } else {
+        opt->stamp++;
+        for (uint32_t i = 0; i < count; i++) {
+            const DecisionRule* rule = &opt->rules[active[i]];
+            for (uint32_t j = 0; j < rule->count; j++) {
+                uint32_t question = opt->literals[rule->first + j] >> 1;
+                if (opt->assigned[question] >= 0 || opt->stamps[question] == opt->stamp) {
+                    continue;
+                }
+                opt->stamps[question] = opt->stamp;
+                double entropy = splitEntropy(opt, active, count, mass, question);
+                if (best == OPTIMIZER_NO_PIN || entropy < best_entropy - 1e-12
+                    || (entropy < best_entropy + 1e-12 && question < best)) {
+                    best = question;
+                    best_entropy = entropy;
+                }
+            }
+        }
+    }
+    free(mass);
+    
+    uint32_t side_count[2] = { 0, 0 };
+    for (uint32_t i = 0; i < count; i++) {
+        const DecisionRule* rule = &opt->rules[active[i]];
+        int answer = -1;
+        for (uint32_t j = 0; j < rule->count && answer < 0; j++) {
+            if (opt->literals[rule->first + j] >> 1 == best) {
+                answer = (int)(opt->literals[rule->first + j] & 1);
+            }
+        }
+        for (int side = 0; side < 2; side++) {
+            if (answer < 0 || answer == side) {
+                sides[(size_t)side * count + side_count[side]++] = active[i];
+            }
+        }
+    }
+    
+    TreeNode* node = createNode(opt->out, QUESTION_NODE, kbText(kb, opt->question_texts[best]));
+    double p = opt->yes_probability[best];
+    opt->expected += reach;
+    opt->question_nodes++;
+    for (int side = 1; side >= 0 && node != NULL; side--) {
+        opt->assigned[best] = (signed char)side;
+        TreeNode* child = buildOptimized(opt, sides + (size_t)side * count, side_count[side],
+                                         reach * (side ? p : 1.0 - p), depth + 1);
+        if (side) {
+            setYesBranch(node, child);
+        } else {
+            setNoBranch(node, child);
+        }
+    }
+    opt->assigned[best] = -1;
+    free(sides);
+    if (node == NULL) {
+        opt->failed = 1;
+    }
+    return node;
+}
+
+
+long verifyEquivalent(const KnowledgeBase* original, const KnowledgeBase* optimized) {
+    uint32_t questions = original->question_count;
+    char* answers = (char*)trackedMalloc(questions + 1);
+    unsigned int seed = 2024;
+    long vectors = questions <= OPTIMIZER_EXHAUSTIVE_QUESTIONS ? 1L << questions : OPTIMIZER_RANDOM_CHECKS;
+    long mismatches = 0;
+    
+    if (answers == NULL) {
+        return -1;
+    }
+    for (long v = 0; v < vectors; v++) {
+        for (uint32_t q = 0; q < questions; q++) {
+            answers[q] = questions <= OPTIMIZER_EXHAUSTIVE_QUESTIONS ? ((v >> q) & 1 ? 'Y' : 'N')
+                                                                    : scriptedResponse(&seed);
+        }
+        uint32_t a = evaluateAnswers(original, answers, questions);
+        uint32_t b = evaluateAnswers(optimized, answers, questions);
+        if (a == FLAT_LEAF || b == FLAT_LEAF
+            || strcmp(kbText(original, original->diagnoses[a].condition),
+                      kbText(optimized, optimized->diagnoses[b].condition)) != 0
+            || original->diagnoses[a].severity != optimized->diagnoses[b].severity) {
+            mismatches++;
+        }
+    }
+    free(answers);
+    printf("  checked %ld answer vectors%s: %ld mismatches\n", vectors,
+           questions <= OPTIMIZER_EXHAUSTIVE_QUESTIONS ? " (exhaustive)" : "", mismatches);
+    return mismatches;
+}
+
+
+void releaseOptimizer(Optimizer* opt) {
+    free(opt->rules);
+    free(opt->literals);
+    free(opt->yes_probability);
+    free(opt->yes_counts);
+    free(opt->answer_counts);
+    free(opt->assigned);
+    free(opt->stamps);
+    free(opt->side_mass[0]);
+    free(opt->side_mass[1]);
+    free(opt->touched);
+    free(opt->leaves);
+    free(opt->question_texts);
+    releaseKnowledgeBase(opt->out);
+}
+
+
+int main(int argc, char* argv[]) {
+    const char* kb_path = NULL;
+    const char* pin = NULL;
+    const char* stats_path = NULL;
+    const char* output_path;
+    KnowledgeBase* kb;
+    Optimizer opt;
+    double start;
+    
+    while (argc >= 3 && (strcmp(argv[1], "--kb") == 0 || strcmp(argv[1], "--pin") == 0)) {
+        if (argv[1][2] == 'k') {
+            kb_path = argv[2];
+        } else {
+            pin = argv[2];
+        }
+        argv += 2;
+        argc -= 2;
+    }
+    if (argc != 2 && argc != 3) {
+        fprintf(stderr, "Usage: kb_optimizer [--kb INPUT.kb] [--pin QUESTION_ID|none] [STATISTICS] OUTPUT.kb\n");
+        fprintf(stderr, "       STATISTICS is a file of answer records or a /metrics snapshot\n");
+        return 2;
+    }
+    stats_path = argc == 3 ? argv[1] : NULL;
+    output_path = argv[argc - 1];
+    
+    start = monotonicMs();
+    kb = openKnowledgeBase(kb_path, 0);
+    if (kb == NULL) {
+        return 1;
+    }
+    
+    uint32_t questions = kb->question_count;
+    memset(&opt, 0, sizeof(opt));
+    opt.kb = kb;
+    opt.yes_probability = (double*)trackedMalloc(questions * sizeof(double));
+    opt.yes_counts = (unsigned long*)calloc(questions, sizeof(unsigned long));
+    opt.answer_counts = (unsigned long*)calloc(questions, sizeof(unsigned long));
+    opt.assigned = (signed char*)trackedMalloc(questions);
+    opt.stamps = (uint32_t*)calloc(questions, sizeof(uint32_t));
+    opt.side_mass[0] = (double*)calloc(kb->diagnosis_count, sizeof(double));
+    opt.side_mass[1] = (double*)calloc(kb->diagnosis_count, sizeof(double));
+    opt.touched = (uint32_t*)trackedMalloc(kb->diagnosis_count * sizeof(uint32_t));
+    opt.leaves = (TreeNode**)calloc(kb->diagnosis_count, sizeof(TreeNode*));
+    opt.question_texts = (uint32_t*)trackedMalloc(questions * sizeof(uint32_t));
+    opt.out = beginKnowledgeBase();
+    if (opt.yes_probability == NULL || opt.yes_counts == NULL || opt.answer_counts == NULL || opt.assigned == NULL
+        || opt.stamps == NULL || opt.side_mass[0] == NULL || opt.side_mass[1] == NULL || opt.touched == NULL
+        || opt.leaves == NULL || opt.question_texts == NULL || opt.out == NULL) {
+        fprintf(stderr, "Memory allocation failed!\n");
+        releaseOptimizer(&opt);
+        releaseKnowledgeBase(kb);
+        return 1;
+    }
+    memset(opt.assigned, -1, questions);
+    for (uint32_t i = 0; i < kb->node_count; i++) {
+        if (kb->flat[i].question != FLAT_LEAF) {
+            opt.question_texts[kb->flat[i].question] = kb->flat[i].payload;
+        }
+    }
+    
+    if (stats_path != NULL && !loadAnswerStatistics(&opt, stats_path)) {
+        releaseOptimizer(&opt);
+        releaseKnowledgeBase(kb);
+        return 1;
+    }
+    for (uint32_t q = 0; q < questions; q++) {
+        opt.yes_probability[q] = (opt.yes_counts[q] + 1.0) / (opt.answer_counts[q] + 2.0);
+    }
+    
+    opt.pinned = findEmergencyQuestion(kb);
+    if (pin != NULL) {
+        opt.pinned = strcmp(pin, "none") == 0 ? OPTIMIZER_NO_PIN : (uint32_t)strtoul(pin, NULL, 10);
+        if (opt.pinned != OPTIMIZER_NO_PIN && opt.pinned >= questions) {
+            fprintf(stderr, "Question %s does not exist (the knowledge base has %u)\n", pin, questions);
+            releaseOptimizer(&opt);
+            releaseKnowledgeBase(kb);
+            return 1;
+        }
+    }
+    
+    if (!collectRules(&opt, 0, 0)) {
+        releaseOptimizer(&opt);
+        releaseKnowledgeBase(kb);
+        return 1;
+    }
+    uint32_t* active = (uint32_t*)trackedMalloc(opt.rule_count * sizeof(uint32_t));
+    if (active == NULL) {
+        fprintf(stderr, "Memory allocation failed!\n");
+        releaseOptimizer(&opt);
+        releaseKnowledgeBase(kb);
+        return 1;
+    }
+    for (uint32_t i = 0; i < opt.rule_count; i++) {
+        active[i] = i;
+    }
+    
+    uint32_t* order = (uint32_t*)trackedMalloc(questions * sizeof(uint32_t));
+    opt.out->root = buildOptimized(&opt, active, opt.rule_count, 1.0, 0);
+    free(active);
+    if (order != NULL && opt.out->root != NULL) {
+        for (uint32_t q = 0; q < questions; q++) {
+            order[q] = poolIntern(&opt.out->strings, kbText(kb, opt.question_texts[q]));
+        }
+        opt.out->question_order = order;
+        opt.out->question_order_count = questions;
+    }
+    if (order == NULL || opt.failed || opt.out->root == NULL || opt.out->strings.failed
+        || !finishKnowledgeBase(opt.out)) {
+        fprintf(stderr, "Memory allocation failed while building the optimized tree!\n");
+        free(order);
+        releaseOptimizer(&opt);
+        releaseKnowledgeBase(kb);
+        return 1;
+    }
+    opt.out->question_order = NULL;
+    free(order);
+    
+    double before = expectedQuestions(kb, opt.yes_probability);
+    double after = expectedQuestions(opt.out, opt.yes_probability);
+    printf("%s: %u questions, %u diagnoses, %u decision rules\n", kb_path != NULL ? kb_path : "built-in tree",
+           questions, kb->diagnosis_count, opt.rule_count);
+    if (opt.pinned != OPTIMIZER_NO_PIN) {
+        printf("  pinned first question %u: %s\n", opt.pinned, kbText(kb, opt.question_texts[opt.pinned]));
+    }
+    printf("  %-26s %10s %10s\n", "", "before", "after");
+    printf("  %-26s %10.3f %10.3f\n", "expected questions", before, after);
+    printf("  %-26s %10.3f %10.3f\n", "expected (uniform answers)", kb->expected_depth, opt.out->expected_depth);
+    printf("  %-26s %10u %10u\n", "max questions", kb->max_depth, opt.out->max_depth);
+    printf("  %-26s %10u %10u\n", "nodes", kb->node_count, opt.out->node_count);
+    
+    long mismatches = verifyEquivalent(kb, opt.out);
+    int ok = mismatches == 0;
+    if (!ok) {
+        fprintf(stderr, "\033[31mOptimized tree is not equivalent; nothing written\033[0m\n");
+    } else if (after > before + 1e-9) {
+        printf("  no improvement under these statistics; writing the original tree\n");
+        ok = exportKnowledgeBase(kb, output_path);
+    } else {
+        printf("  %.1f%% fewer questions per session\n", before > 0.0 ? (before - after) * 100.0 / before : 0.0);
+        ok = exportKnowledgeBase(opt.out, output_path);
+    }
+    if (ok) {
+        printf("  wrote %s in %.2f ms\n", output_path, monotonicMs() - start);
+    }
+    
+    releaseOptimizer(&opt);
+    releaseKnowledgeBase(kb);
+    return ok ? 0 : 1;
+}